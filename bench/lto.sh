@@ -0,0 +1,41 @@
+#!/usr/bin/env bash
+#
+# These codes are licensed under MIT License
+# See the LICENSE for details
+#
+# Copyright (c) 2022 Hiramoto Ittou
+#
+# Compare run time of a multi-file program with and without --lto.
+#
+# Usage: bench/lto.sh [path/to/twinkle]
+
+set -eu
+
+readonly root=$(cd "$(dirname "$0")/.." && pwd)
+readonly twinkle=$(realpath "${1:-$root/build/twinkle}")
+readonly sources=("$root/bench/lto/main.twk" "$root/bench/lto/geometry.twk")
+
+workdir=$(mktemp -d)
+trap 'rm -rf "$workdir"' EXIT
+cd "$workdir"
+
+# Seconds elapsed while running the given command
+elapsed() {
+  local start end
+  start=$(date +%s.%N)
+  "$@" > /dev/null
+  end=$(date +%s.%N)
+  echo "$end - $start" | bc
+}
+
+printf '%-8s %12s %12s\n' mode compile[s] run[s]
+
+for mode in default full thin; do
+  flags=()
+  [ "$mode" != default ] && flags+=(--lto-mode="$mode")
+
+  compile_time=$(elapsed "$twinkle" --emit exe -O 2 "${flags[@]}" "${sources[@]}")
+  run_time=$(elapsed ./a.out)
+
+  printf '%-8s %12.3f %12.3f\n' "$mode" "$compile_time" "$run_time"
+done
@@ -0,0 +1,43 @@
+#!/usr/bin/env bash
+#
+# These codes are licensed under MIT License
+# See the LICENSE for details
+#
+# Copyright (c) 2022 Hiramoto Ittou
+#
+# Compare compile time, run time and executable size of the examples at each
+# optimization level.
+#
+# Usage: bench/optimization.sh [path/to/twinkle]
+
+set -eu
+
+readonly root=$(cd "$(dirname "$0")/.." && pwd)
+readonly twinkle=$(realpath "${1:-$root/build/twinkle}")
+readonly examples=(raytracer quick_sort)
+
+workdir=$(mktemp -d)
+trap 'rm -rf "$workdir"' EXIT
+cd "$workdir"
+
+# Seconds elapsed while running the given command
+elapsed() {
+  local start end
+  start=$(date +%s.%N)
+  "$@" > /dev/null
+  end=$(date +%s.%N)
+  echo "$end - $start" | bc
+}
+
+printf '%-12s %-4s %12s %12s %10s\n' example opt compile[s] run[s] size[B]
+
+for example in "${examples[@]}"; do
+  for opt in 0 1 2 3 s z; do
+    compile_time=$(elapsed "$twinkle" --emit exe -O "$opt" \
+                     "$root/examples/$example.twk")
+    run_time=$(elapsed ./a.out)
+
+    printf '%-12s -O%-2s %12.3f %12.3f %10d\n' \
+      "$example" "$opt" "$compile_time" "$run_time" "$(stat -c %s a.out)"
+  done
+done
@@ -0,0 +1,35 @@
+#!/usr/bin/env bash
+#
+# These codes are licensed under MIT License
+# See the LICENSE for details
+#
+# Copyright (c) 2022 Hiramoto Ittou
+#
+# Measure the time from starting the compiler with --JIT until the first
+# instruction of main is executed, for a hello world program.
+#
+# Usage: bench/startup.sh [path/to/twinkle] [runs]
+
+set -eu
+
+readonly root=$(cd "$(dirname "$0")/.." && pwd)
+readonly twinkle=$(realpath "${1:-$root/build/twinkle}")
+readonly runs=${2:-20}
+readonly source="$root/bench/startup/hello.twk"
+
+# Warm up the page cache
+"$twinkle" --JIT "$source" > /dev/null
+
+times=()
+
+for _ in $(seq "$runs"); do
+  start=$(date +%s%N)
+  entered=$("$twinkle" --JIT "$source")
+  times+=($(( (entered - start) / 1000 )))
+done
+
+sorted=($(printf '%s\n' "${times[@]}" | sort -n))
+
+printf '%-6s %12s %12s %12s\n' runs min[us] median[us] max[us]
+printf '%-6s %12d %12d %12d\n' \
+  "$runs" "${sorted[0]}" "${sorted[$(( runs / 2 ))]}" "${sorted[$(( runs - 1 ))]}"
@@ -0,0 +1,48 @@
+#!/usr/bin/env bash
+#
+# These codes are licensed under MIT License
+# See the LICENSE for details
+#
+# Copyright (c) 2022 Hiramoto Ittou
+#
+# Measure how programs using spawn and join scale with the number of threads
+# of the runtime, from 1 to the number of online CPUs.
+#
+# Usage: bench/tasks.sh [path/to/twinkle]
+
+set -eu
+
+readonly root=$(cd "$(dirname "$0")/.." && pwd)
+readonly twinkle=$(realpath "${1:-$root/build/twinkle}")
+readonly programs=(fib quicksort)
+
+workdir=$(mktemp -d)
+trap 'rm -rf "$workdir"' EXIT
+cd "$workdir"
+
+# Seconds elapsed while running the given command
+elapsed() {
+  local start end
+  start=$(date +%s.%N)
+  "$@" > /dev/null
+  end=$(date +%s.%N)
+  echo "$end - $start" | bc
+}
+
+for program in "${programs[@]}"; do
+  "$twinkle" --emit exe -O 2 "$root/bench/tasks/$program.twk"
+  mv a.out "$program"
+done
+
+printf '%-10s %8s %12s %8s\n' program threads run[s] speedup
+
+for program in "${programs[@]}"; do
+  for threads in $(seq "$(nproc)"); do
+    run_time=$(TWINKLE_NUM_THREADS=$threads elapsed "./$program")
+    [ "$threads" = 1 ] && base_time=$run_time
+    speedup=$(echo "$base_time / $run_time" | bc -l)
+
+    printf '%-10s %8d %12.3f %8.2f\n' \
+      "$program" "$threads" "$run_time" "$speedup"
+  done
+done
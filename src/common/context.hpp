@@ -21,42 +21,118 @@ namespace twinkle
 
 constexpr unsigned int DEFAULT_OPT_LEVEL = 2;
 
+constexpr unsigned int DEFAULT_SIZE_LEVEL = 0;
+
+constexpr unsigned int DEFAULT_JOBS = 1;
+
+constexpr unsigned int DEFAULT_CODEGEN_PARTITIONS = 1;
+
+constexpr unsigned int DEFAULT_TIME_TRACE_GRANULARITY = 500;
+
 #define EMIT_EXE_ARG    "exe"
 #define EMIT_OBJ_ARG    "obj"
 #define EMIT_ASM_ARG    "asm"
 #define EMIT_LLVMIR_ARG "llvm"
 
-struct Context {
-  Context(std::vector<std::string>&&   input_files,
-          const bool                   jit,
-          std::string&&                emit_target,
-          const unsigned int           opt_level,
-          std::string&&                relocation_model,
-          std::vector<std::string>&&   linked_libs,
-          std::optional<std::string>&& target_triple) noexcept
-    : input_files{std::move(input_files)}
-    , jit{jit}
-    , emit_target{std::move(emit_target)}
-    , opt_level{opt_level}
-    , relocation_model{std::move(relocation_model)}
-    , linked_libs{std::move(linked_libs)}
-    , target_triple{std::move(target_triple)}
-  {
-  }
+#define LTO_FULL_ARG "full"
+#define LTO_THIN_ARG "thin"
 
+// Options of a compilation
+// Initialize it with designated initializers (e.g. Context{.input_files = ...,
+// .jit = true}), so that the fields not given keep the defaults of the command
+// line options
+struct Context {
   const std::vector<std::string> input_files;
 
-  const bool jit;
+  const bool jit = false;
+
+  const std::string emit_target = EMIT_EXE_ARG;
 
-  const std::string emit_target;
+  // Directory the output files are written to
+  // If empty, they are written to the current directory
+  const std::string output_dir;
 
-  const unsigned int opt_level;
+  const unsigned int opt_level = DEFAULT_OPT_LEVEL;
 
-  const std::string relocation_model;
+  // 0 optimizes for speed, 1 for size (-Os) and 2 for size aggressively (-Oz)
+  const unsigned int size_level = DEFAULT_SIZE_LEVEL;
+
+  // If set, this pass pipeline replaces the default one of the optimization
+  // level (same format as opt's -passes)
+  const std::optional<std::string> passes;
+
+  // If set, instrument the program to write its profile (.profraw) at exit
+  // to this directory
+  // If empty, it is written to the current directory of the program
+  const std::optional<std::string> profile_generate;
+
+  // If set, optimize with this profile (.profdata)
+  const std::optional<std::string> profile_use;
+
+  // If set, optimize with this sample profile (e.g. converted from perf data)
+  // Line tables are emitted as well, since samples are attributed by them
+  const std::optional<std::string> profile_sample_use;
+
+  // If true, emit line tables
+  const bool debug_line_tables = false;
+
+  const std::string relocation_model = "pic";
 
   const std::vector<std::string> linked_libs;
 
   const std::optional<std::string> target_triple;
+
+  // Name of the target CPU, or 'native' for the host CPU
+  // If not set, 'generic' is used, except for JIT compilation which uses the
+  // host CPU
+  const std::optional<std::string> mcpu;
+
+  // Target features to enable or disable (e.g. '+avx2,-fma')
+  const std::optional<std::string> mattr;
+
+  // Number of threads to compile translation units in parallel
+  // 0 means the number of hardware threads
+  const unsigned int jobs = DEFAULT_JOBS;
+
+  // Number of partitions each module is split into for code generation
+  const unsigned int codegen_partitions = DEFAULT_CODEGEN_PARTITIONS;
+
+  // If set, objects are cached in this directory
+  const std::optional<std::string> cache_dir;
+
+  // Same format as llvm::parseCachePruningPolicy
+  const std::string cache_policy;
+
+  // External linker driver (e.g. gcc)
+  // If not set, the internal linker is used if available
+  const std::optional<std::string> linker;
+
+  // Archive of the runtime linked into executables
+  // If not set, the one installed with the compiler is used
+  const std::optional<std::string> runtime;
+
+  // Kind of link time optimization ('full' or 'thin')
+  const std::optional<std::string> lto;
+
+  // If set, a Chrome trace of compile time is written to this file
+  // If empty, it is written to <first input file stem>.time-trace in the output
+  // directory
+  const std::optional<std::string> time_trace;
+
+  // Minimum duration of time trace events in microseconds
+  const unsigned int time_trace_granularity = DEFAULT_TIME_TRACE_GRANULARITY;
+
+  // If true, print statistics of the compilation to stderr
+  const bool stats = false;
+
+  // If set, statistics are written to this file as JSON
+  const std::optional<std::string> stats_file;
+
+  // If set, run as a compile server listening on this Unix domain socket
+  const std::optional<std::string> server;
+
+  // If set, compile by the compile server listening on this Unix domain socket
+  const std::optional<std::string> connect;
 };
 
 } // namespace twinkle
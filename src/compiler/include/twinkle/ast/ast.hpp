@@ -152,6 +152,9 @@ struct UserDefinedTemplateType;
 struct ArrayType;
 struct PointerType;
 struct ReferenceType;
+struct VectorType;
+struct TaskType;
+struct FutureType;
 
 using Type = boost::variant<boost::blank,
                             BuiltinType,
@@ -159,7 +162,10 @@ using Type = boost::variant<boost::blank,
                             boost::recursive_wrapper<UserDefinedTemplateType>,
                             boost::recursive_wrapper<ArrayType>,
                             boost::recursive_wrapper<PointerType>,
-                            boost::recursive_wrapper<ReferenceType>>;
+                            boost::recursive_wrapper<ReferenceType>,
+                            boost::recursive_wrapper<VectorType>,
+                            boost::recursive_wrapper<TaskType>,
+                            boost::recursive_wrapper<FutureType>>;
 
 struct UserDefinedType : x3::position_tagged {
   explicit UserDefinedType(Identifier&& name)
@@ -233,6 +239,42 @@ struct ArrayType : x3::position_tagged {
   }
 };
 
+// Example: task<i32>
+struct TaskType : x3::position_tagged {
+  explicit TaskType(Type&& result_type) noexcept
+    : result_type{std::move(result_type)}
+  {
+  }
+
+  TaskType() = default;
+
+  Type result_type;
+
+  // Implemented to be a key in std::map
+  [[nodiscard]] bool operator<(const TaskType& other) const
+  {
+    return result_type < other.result_type;
+  }
+};
+
+// Example: future<i32>
+struct FutureType : x3::position_tagged {
+  explicit FutureType(Type&& result_type) noexcept
+    : result_type{std::move(result_type)}
+  {
+  }
+
+  FutureType() = default;
+
+  Type result_type;
+
+  // Implemented to be a key in std::map
+  [[nodiscard]] bool operator<(const FutureType& other) const
+  {
+    return result_type < other.result_type;
+  }
+};
+
 struct PointerType : x3::position_tagged {
   explicit PointerType(Type&& pointee_type) noexcept
     : n_ops{boost::blank{}} // size 1
@@ -275,6 +317,27 @@ struct ReferenceType : x3::position_tagged {
   }
 };
 
+// Example: vec<f32, 4>
+struct VectorType : x3::position_tagged {
+  VectorType(Type&& element_type, const std::uint32_t size)
+    : element_type{std::move(element_type)}
+    , size{size}
+  {
+  }
+
+  VectorType() = default;
+
+  Type          element_type;
+  std::uint32_t size;
+
+  // Implemented to be a key in std::map
+  [[nodiscard]] bool operator<(const VectorType& other) const
+  {
+    return std::tie(element_type, size)
+           < std::tie(other.element_type, other.size);
+  }
+};
+
 //===----------------------------------------------------------------------===//
 // Expression AST
 //===----------------------------------------------------------------------===//
@@ -316,6 +379,9 @@ struct UnaryOp;
 struct Reference;
 struct New;
 struct Delete;
+struct Spawn;
+struct Join;
+struct Await;
 struct Dereference;
 struct FunctionCall;
 struct FunctionTemplateCall;
@@ -403,7 +469,16 @@ using ExprT20 = boost::mpl::push_back<ExprT19, SizeOfType>::type;
 
 using ExprT21 = boost::mpl::push_back<ExprT20, NullPointer>::type;
 
-using ExprTypes = ExprT21;
+using ExprT22
+  = boost::mpl::push_back<ExprT21, boost::recursive_wrapper<Spawn>>::type;
+
+using ExprT23
+  = boost::mpl::push_back<ExprT22, boost::recursive_wrapper<Join>>::type;
+
+using ExprT24
+  = boost::mpl::push_back<ExprT23, boost::recursive_wrapper<Await>>::type;
+
+using ExprTypes = ExprT24;
 
 using Expr = boost::make_variant_over<ExprTypes>::type;
 
@@ -560,6 +635,21 @@ struct Delete : x3::position_tagged {
   Expr operand;
 };
 
+// Example: spawn f(x)
+struct Spawn : x3::position_tagged {
+  Expr call;
+};
+
+// Example: join t
+struct Join : x3::position_tagged {
+  Expr task;
+};
+
+// Example: await f(x)
+struct Await : x3::position_tagged {
+  Expr future;
+};
+
 struct Dereference : x3::position_tagged {
   Expr operand;
 
@@ -661,6 +751,28 @@ struct ScopeResolution : x3::position_tagged {
   Expr rhs;
 };
 
+//===----------------------------------------------------------------------===//
+// Attribute AST
+//===----------------------------------------------------------------------===//
+
+using AttrArgValue = boost::variant<std::uint32_t, StringLiteral>;
+
+// Example: 8, "avx2", width: 8
+struct AttrArg : x3::position_tagged {
+  // Empty if the argument is not named
+  std::u32string name;
+  AttrArgValue   value;
+};
+
+// Example: target_clones("avx2", "default")
+struct Attr : x3::position_tagged {
+  std::u32string       name;
+  std::vector<AttrArg> args;
+};
+
+// Example: [[nodiscard, nomangle]]
+using Attrs = std::vector<Attr>;
+
 //===----------------------------------------------------------------------===//
 // Statement AST
 //===----------------------------------------------------------------------===//
@@ -780,6 +892,8 @@ struct Break : x3::position_tagged {};
 
 struct Continue : x3::position_tagged {};
 
+struct Sync : x3::position_tagged {};
+
 struct If;
 struct Loop;
 struct While;
@@ -800,6 +914,7 @@ using StmtT0 = boost::mpl::vector<boost::blank,
                                   PrefixIncrementDecrement,
                                   Break,
                                   Continue,
+                                  Sync,
                                   boost::recursive_wrapper<If>>;
 
 using StmtT1
@@ -849,18 +964,21 @@ struct If : x3::position_tagged {
 
   If() = default;
 
+  Attrs               attrs;
   Expr                condition;
   Stmt                then_statement;
   std::optional<Stmt> else_statement;
 };
 
 struct Loop : x3::position_tagged {
-  Stmt body;
+  Attrs attrs;
+  Stmt  body;
 };
 
 struct While : x3::position_tagged {
-  Expr cond_expr;
-  Stmt body;
+  Attrs attrs;
+  Expr  cond_expr;
+  Stmt  body;
 };
 
 using ForInitVariant = boost::variant<boost::blank, Assignment, VariableDef>;
@@ -868,6 +986,7 @@ using ForLoopVariant
   = boost::variant<boost::blank, PrefixIncrementDecrement, Assignment>;
 
 struct For : x3::position_tagged {
+  Attrs                         attrs;
   std::optional<ForInitVariant> init_stmt;
   std::optional<Expr>           cond_expr;
   std::optional<ForLoopVariant> loop_stmt;
@@ -964,7 +1083,12 @@ struct FunctionDef : x3::position_tagged {
 
   FunctionDef() = default;
 
+  // Attributes of methods and of function templates
+  // The attributes of the other functions are in TopLevelWithAttr, and those
+  // here are added to them
+  Attrs        attrs;
   bool         is_public;
+  bool         is_async = false;
   FunctionDecl decl;
   Stmt         body;
 };
@@ -1143,9 +1267,6 @@ using TopLevel = boost::variant<boost::blank,
                                 Import,
                                 Namespace>;
 
-// Example: [[nodiscard, nomangle]]
-using Attrs = std::vector<std::u32string>;
-
 struct TopLevelWithAttr : x3::position_tagged {
   Attrs    attrs;
   TopLevel top_level;
@@ -74,6 +74,22 @@ BOOST_FUSION_ADAPT_STRUCT(
   (twinkle::ast::Type, refee_type)
 )
 
+BOOST_FUSION_ADAPT_STRUCT(
+  twinkle::ast::VectorType,
+  (twinkle::ast::Type, element_type)
+  (std::uint32_t, size)
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+  twinkle::ast::TaskType,
+  (twinkle::ast::Type, result_type)
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+  twinkle::ast::FutureType,
+  (twinkle::ast::Type, result_type)
+)
+
 //===----------------------------------------------------------------------===//
 // Expression AST adapt
 //===----------------------------------------------------------------------===//
@@ -132,6 +148,21 @@ BOOST_FUSION_ADAPT_STRUCT(
   (twinkle::ast::Expr, operand)
 )
 
+BOOST_FUSION_ADAPT_STRUCT(
+  twinkle::ast::Spawn,
+  (twinkle::ast::Expr, call)
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+  twinkle::ast::Join,
+  (twinkle::ast::Expr, task)
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+  twinkle::ast::Await,
+  (twinkle::ast::Expr, future)
+)
+
 BOOST_FUSION_ADAPT_STRUCT(
   twinkle::ast::Dereference,
   (twinkle::ast::Expr, operand)
@@ -197,6 +228,22 @@ BOOST_FUSION_ADAPT_STRUCT(
   (twinkle::ast::Expr, rhs)
 )
 
+//===----------------------------------------------------------------------===//
+// Attribute AST adapt
+//===----------------------------------------------------------------------===//
+
+BOOST_FUSION_ADAPT_STRUCT(
+  twinkle::ast::AttrArg,
+  (std::u32string, name)
+  (twinkle::ast::AttrArgValue, value)
+)
+
+BOOST_FUSION_ADAPT_STRUCT(
+  twinkle::ast::Attr,
+  (std::u32string, name)
+  (std::vector<twinkle::ast::AttrArg>, args)
+)
+
 //===----------------------------------------------------------------------===//
 // Statement AST adapt
 //===----------------------------------------------------------------------===//
@@ -240,8 +287,13 @@ BOOST_FUSION_ADAPT_STRUCT(
   twinkle::ast::Continue,
 )
 
+BOOST_FUSION_ADAPT_STRUCT(
+  twinkle::ast::Sync,
+)
+
 BOOST_FUSION_ADAPT_STRUCT(
   twinkle::ast::If,
+  (twinkle::ast::Attrs, attrs)
   (twinkle::ast::Expr, condition)
   (twinkle::ast::Stmt, then_statement)
   (std::optional<twinkle::ast::Stmt>, else_statement)
@@ -249,17 +301,20 @@ BOOST_FUSION_ADAPT_STRUCT(
 
 BOOST_FUSION_ADAPT_STRUCT(
   twinkle::ast::Loop,
+  (twinkle::ast::Attrs, attrs)
   (twinkle::ast::Stmt, body)
 )
 
 BOOST_FUSION_ADAPT_STRUCT(
   twinkle::ast::While,
+  (twinkle::ast::Attrs, attrs)
   (twinkle::ast::Expr, cond_expr)
   (twinkle::ast::Stmt, body)
 )
 
 BOOST_FUSION_ADAPT_STRUCT(
   twinkle::ast::For,
+  (twinkle::ast::Attrs, attrs)
   (std::optional<twinkle::ast::ForInitVariant>, init_stmt)
   (std::optional<twinkle::ast::Expr>, cond_expr)
   (std::optional<twinkle::ast::ForLoopVariant>, loop_stmt)
@@ -363,7 +418,9 @@ BOOST_FUSION_ADAPT_STRUCT(
 
 BOOST_FUSION_ADAPT_STRUCT(
   twinkle::ast::FunctionDef,
+  (twinkle::ast::Attrs, attrs)
   (bool, is_public)
+  (bool, is_async)
 	(twinkle::ast::FunctionDecl, decl)
   (twinkle::ast::Stmt, body)
 )
@@ -0,0 +1,69 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#ifndef _7386bc6c_ce74_4f1b_a1e3_00938c34e6c8
+#define _7386bc6c_ce74_4f1b_a1e3_00938c34e6c8
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <twinkle/pch/pch.hpp>
+#include <twinkle/support/exception.hpp>
+
+namespace twinkle::cache
+{
+
+// Exception class for errors related to the cache.
+struct CacheError : public ErrorBase {
+  explicit CacheError(const std::string& what_arg)
+    : ErrorBase{what_arg}
+  {
+  }
+};
+
+// Returns the hexadecimal SHA-1 digest of the concatenation of the strings
+[[nodiscard]] std::string
+hash(std::initializer_list<const std::string_view> strings);
+
+// Content-addressed on-disk cache
+// Entries are written to a temporary file in the cache directory and then
+// renamed, which is atomic even on NFS, so several processes and machines can
+// share the same directory without locking
+// Files are named the same as LLVM's cache so that llvm::pruneCache evicts them
+struct Cache : private boost::noncopyable {
+  // The policy is the same format as llvm::parseCachePruningPolicy
+  // e.g. "cache_size_bytes=1g:prune_after=24h"
+  Cache(const std::string_view       argv_front,
+        const std::filesystem::path& dir,
+        const std::string&           policy);
+
+  // Evict entries according to the policy
+  ~Cache();
+
+  [[nodiscard]] std::optional<std::string> get(const std::string& key) const;
+
+  // Errors are ignored, since failing to cache does not affect the result
+  void put(const std::string& key, const llvm::StringRef data) const;
+
+  [[nodiscard]] const std::filesystem::path& getDirectory() const noexcept
+  {
+    return dir;
+  }
+
+private:
+  [[nodiscard]] std::filesystem::path
+  getEntryPath(const std::string& key) const;
+
+  const std::filesystem::path dir;
+
+  llvm::CachePruningPolicy policy;
+};
+
+} // namespace twinkle::cache
+
+#endif
@@ -15,6 +15,10 @@
 #include <twinkle/pch/pch.hpp>
 #include <twinkle/ast/ast.hpp>
 #include <twinkle/codegen/type.hpp>
+#include <twinkle/codegen/optimizer.hpp>
+#include <twinkle/codegen/debug_info.hpp>
+#include <twinkle/codegen/target_clones.hpp>
+#include <twinkle/codegen/coroutine.hpp>
 #include <twinkle/support/utils.hpp>
 #include <twinkle/support/typedef.hpp>
 #include <twinkle/jit/jit.hpp>
@@ -266,17 +270,21 @@ concept PositionTaggedClass
 
 // Codegen context
 struct CGContext : private boost::noncopyable {
-  CGContext(llvm::LLVMContext&      context,
-            PositionCache&&         current_file_poscache,
-            std::filesystem::path&& file,
-            const std::string&      source_code,
-            const unsigned int      opt_level,
-            const bool              jit) noexcept;
+  CGContext(llvm::LLVMContext&         context,
+            PositionCache&&            current_file_poscache,
+            std::filesystem::path&&    file,
+            const std::string&         source_code,
+            const OptimizationOptions& optimization_options,
+            const bool                 debug_info,
+            const bool                 jit) noexcept;
 
   [[nodiscard]] std::string
   formatError(const boost::iterator_range<InputIterator>& pos,
               const std::string_view                      message) const;
 
+  // Run function_simplifier on the function
+  void runFunctionPasses(llvm::Function& func);
+
   // LLVM
   llvm::LLVMContext&            context;
   std::unique_ptr<llvm::Module> module;
@@ -354,7 +362,31 @@ struct CGContext : private boost::noncopyable {
   mangle::Mangler mangler;
 
   // Pass manager
-  llvm::legacy::FunctionPassManager fpm;
+  FunctionSimplifier function_simplifier;
+
+  // If debug information is not emitted, nullptr
+  std::unique_ptr<DebugInfo> debug_info;
+
+  // Functions with target_clones attribute, which are cloned after the whole
+  // module is generated
+  std::vector<TargetClones> target_clones;
+
+  // Groups of the tasks spawned by the functions being generated, which are
+  // created on the first spawn and waited for when the functions return
+  std::unordered_map<llvm::Function*, llvm::AllocaInst*> task_groups;
+
+  // Async functions being generated, which are removed when their bodies are
+  // finished
+  std::unordered_map<llvm::Function*, Coroutine> coroutines;
+
+  // Paths of imported files, as written in the import declarations
+  // They are relative to the directory of the translation unit
+  FilePaths imported_files;
+
+  // Parse results of imported files, which may be shared with other
+  // compilations through the import cache
+  std::vector<std::shared_ptr<const parse::Parser::Result>>
+    imported_parse_results;
 
   // If true, suppress optimization
   const bool jit;
@@ -366,13 +398,38 @@ private:
   calcRows(const boost::iterator_range<InputIterator>& pos) const;
 };
 
+// Initialize the target of the triple, or the host target if not specified
+// It does nothing for the targets already initialized
+// Thread-safe
+void initializeTargets(const std::optional<std::string>& target_triple);
+
+struct TargetCPU {
+  std::string cpu;
+
+  // Comma separated (e.g. '+avx2,-fma')
+  std::string features;
+};
+
+// 'native' is resolved to the host CPU and its features, and mattr is
+// appended to the features
+// If mcpu is not set, 'generic' is used, except for JIT compilation which
+// uses the host CPU since the code runs where it is compiled
+[[nodiscard]] TargetCPU getTargetCPU(const std::optional<std::string>& mcpu,
+                                     const std::optional<std::string>& mattr,
+                                     const bool                        jit);
+
 struct CodeGenerator : private boost::noncopyable {
   CodeGenerator(const std::string_view               program_name,
                 std::vector<parse::Parser::Result>&& parse_results,
-                const unsigned int                   opt_level,
+                OptimizationOptions&&                optimization_options,
                 const llvm::Reloc::Model             relocation_model,
                 const std::optional<std::string>&    target_triple_arg,
-                const bool                           jit);
+                TargetCPU&&                          target_cpu,
+                const bool                           jit,
+                const bool                           debug_info,
+                const unsigned int                   jobs,
+                const unsigned int                   codegen_partitions,
+                const std::filesystem::path&         output_dir);
 
   // Returns the created file paths
   [[nodiscard]] FilePaths emitLlvmIRFiles();
@@ -380,8 +437,9 @@ struct CodeGenerator : private boost::noncopyable {
   // Returns the created file paths
   [[nodiscard]] FilePaths emitObjectFiles();
 
+  // Objects are kept in memory if possible (see createMemoryFile)
   // Returns the created file paths
-  [[nodiscard]] FilePaths emitTemporaryObjectFiles();
+  [[nodiscard]] FilePaths emitMemoryObjectFiles();
 
   // Returns the created file paths
   [[nodiscard]] FilePaths emitAssemblyFiles();
@@ -389,32 +447,107 @@ struct CodeGenerator : private boost::noncopyable {
   // Returns the return value from the main function
   [[nodiscard]] int doJIT();
 
+  // Link all modules into one and run link time optimization on it
+  // Everything other than main and the functions with nomangle attribute is
+  // internalized, so the result must be linked as an executable
+  void doLTO();
+
+  // Run ThinLTO over all modules using their summaries, and run the backends
+  // in parallel
+  // If a cache directory is given, the objects of unchanged modules are reused
+  // Objects are kept in memory if possible (see createMemoryFile)
+  // Returns the created file paths
+  [[nodiscard]] FilePaths emitThinLTOObjectFiles(
+    const std::optional<std::filesystem::path>& cache_dir);
+
+  // Returns the files imported by each translation unit
+  [[nodiscard]] std::vector<FilePaths> getImportedFiles() const;
+
 private:
-  void verifyOptLevel(const unsigned int opt_level) const;
+  void verifyOptimizationOptions() const;
+
+  // Each translation unit has its own context so that they can be generated
+  // in parallel
+  // Since module has a reference to context, it also holds context
+  struct Result {
+    std::unique_ptr<llvm::LLVMContext> context;
+    std::unique_ptr<llvm::Module>      module;
+    std::filesystem::path              file;
+    FilePaths                          imported_files;
+  };
 
-  using Result
-    = std::tuple<std::unique_ptr<llvm::Module>, std::filesystem::path>;
+  [[nodiscard]] Result generateModule(parse::Parser::Result& parse_result,
+                                      const bool             jit) const;
 
-  void codegen(const ast::TranslationUnit& ast, CGContext& ctx);
+  void codegen(const ast::TranslationUnit& ast, CGContext& ctx) const;
+
+  // Set the target CPU and features to the functions, so that they are kept
+  // through LTO and the clones of target_clones extend them
+  void setTargetAttributes(llvm::Module& module) const;
+
+  // Link all modules into the first one
+  void linkModules();
+
+  [[nodiscard]] llvm::CodeGenOpt::Level getCodeGenOptLevel() const;
+
+  // Run module-level optimization (inlining, IPO, etc.) according to the
+  // optimization options
+  void optimizeModule(llvm::Module&        module,
+                      llvm::TargetMachine& target_machine) const;
 
   // Returns the created file paths
   [[nodiscard]] FilePaths emitFiles(const llvm::CodeGenFileType cgft,
-                                    const bool create_as_tmpfile = false);
+                                    const bool                  in_memory = false);
 
-  void initTargetTripleAndMachine(
-    const std::optional<std::string>& target_triple_arg);
+  void emitFile(llvm::Module&                module,
+                const std::filesystem::path& file,
+                const std::filesystem::path& output_file,
+                const llvm::CodeGenFileType  cgft) const;
 
-  const std::string_view argv_front;
+  // Returns the path of the created memory file
+  [[nodiscard]] std::filesystem::path
+  emitMemoryFile(llvm::Module&               module,
+                 const std::string&          name,
+                 const llvm::CodeGenFileType cgft) const;
+
+  void emitFile(llvm::Module&               module,
+                llvm::raw_pwrite_stream&    ostream,
+                const llvm::CodeGenFileType cgft) const;
+
+  void initTarget(const std::optional<std::string>& target_triple_arg);
+
+  void verifyTargetCPU() const;
 
-  std::unique_ptr<llvm::LLVMContext> context;
+  // TargetMachine is not thread-safe, so each thread needs its own
+  [[nodiscard]] std::unique_ptr<llvm::TargetMachine>
+  createTargetMachine() const;
+
+  const std::string_view argv_front;
 
   bool jit_compiled = false;
 
-  std::string          target_triple;
-  llvm::TargetMachine* target_machine;
+  std::string         target_triple;
+  const llvm::Target* target;
+
+  const TargetCPU target_cpu;
 
   const llvm::Reloc::Model relocation_model;
 
+  const OptimizationOptions optimization_options;
+
+  // If true, emit line tables
+  const bool debug_info;
+
+  const unsigned int jobs;
+
+  // Number of partitions each module is split into for object and assembly
+  // emission
+  const unsigned int codegen_partitions;
+
+  // Directory the output files are written to (empty for the current
+  // directory)
+  const std::filesystem::path output_dir;
+
   std::vector<Result> results;
 
   std::vector<parse::Parser::Result> parse_results;
@@ -96,7 +96,8 @@ private:
 struct Variable {
   [[nodiscard]] virtual Value getValue(CGContext& ctx) const = 0;
 
-  [[nodiscard]] virtual llvm::AllocaInst* getAllocaInst() const noexcept = 0;
+  // Returns the pointer to the storage of the variable
+  [[nodiscard]] virtual llvm::Value* getAddress() const noexcept = 0;
 
   [[nodiscard]] virtual std::shared_ptr<Type> getType() const = 0;
 
@@ -126,11 +127,16 @@ struct AllocaVariable : public Variable {
             getType()};
   }
 
-  [[nodiscard]] llvm::AllocaInst* getAllocaInst() const noexcept override
+  [[nodiscard]] llvm::AllocaInst* getAllocaInst() const noexcept
   {
     return llvm::cast<llvm::AllocaInst>(alloca.getValue());
   }
 
+  [[nodiscard]] llvm::Value* getAddress() const noexcept override
+  {
+    return getAllocaInst();
+  }
+
   [[nodiscard]] std::shared_ptr<Type> getType() const override
   {
     return alloca.getType();
@@ -152,6 +158,54 @@ private:
   const bool is_mutable;
 };
 
+// Variable of another function, which is accessed through its address
+// The bodies of parallel loops are outlined into functions, and refer to the
+// variables of the enclosing function in this way
+struct CapturedVariable : public Variable {
+  CapturedVariable(llvm::Value* const           address,
+                   const std::shared_ptr<Type>& type,
+                   const bool                   is_mutable) noexcept
+    : address{address}
+    , type{type}
+    , is_mutable{is_mutable}
+  {
+  }
+
+  CapturedVariable() = delete;
+
+  [[nodiscard]] Value getValue(CGContext& ctx) const override
+  {
+    return {ctx.builder.CreateLoad(type->getLLVMType(ctx), address), type};
+  }
+
+  [[nodiscard]] llvm::Value* getAddress() const noexcept override
+  {
+    return address;
+  }
+
+  [[nodiscard]] std::shared_ptr<Type> getType() const override
+  {
+    return type;
+  }
+
+  [[nodiscard]] bool isSigned(CGContext& ctx) const override
+  {
+    return type->isSigned(ctx);
+  }
+
+  [[nodiscard]] bool isMutable() const override
+  {
+    return is_mutable;
+  }
+
+private:
+  llvm::Value* const address;
+
+  const std::shared_ptr<Type> type;
+
+  const bool is_mutable;
+};
+
 // Returns a AST of a class template and a namespace information where it is
 // located
 [[nodiscard]] std::optional<std::pair<ClassTemplateTableValue, NamespaceStack>>
@@ -200,6 +254,20 @@ private:
 
 [[nodiscard]] llvm::Type* getFloatNTy(CGContext& ctx, const int mantissa_width);
 
+// Returns the group of the tasks spawned by the function, which is a pointer
+// to the list of the tasks in the runtime
+[[nodiscard]] llvm::AllocaInst* getTaskGroup(CGContext&            ctx,
+                                             llvm::Function* const func);
+
+// Wait for the tasks spawned by the function that have not been joined, if
+// the function spawns tasks
+// Must be called where the function returns, after the body is generated
+void createTaskGroupExit(CGContext& ctx, llvm::Function* const func);
+
+// Wait for the tasks spawned by the function so far, if the function spawns
+// tasks, without leaving the group
+void createTaskGroupSync(CGContext& ctx, llvm::Function* const func);
+
 /*
   |--------------------------------|
   |     Left |    Right |   Result |
@@ -221,6 +289,10 @@ resultIntegerTypeOf(CGContext&                   ctx,
                     const std::shared_ptr<Type>& lhs_t,
                     const std::shared_ptr<Type>& rhs_t);
 
+// Returns bool, or a mask of the same size if the operand is a vector
+[[nodiscard]] std::shared_ptr<Type> boolTypeOf(CGContext&   ctx,
+                                               const Value& operand);
+
 [[nodiscard]] Value createAddInverse(CGContext& ctx, const Value& value);
 
 [[nodiscard]] Value
@@ -0,0 +1,94 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#ifndef _75d679b9_2fde_47b6_be31_7e46c95489c2
+#define _75d679b9_2fde_47b6_be31_7e46c95489c2
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <twinkle/pch/pch.hpp>
+#include <twinkle/ast/ast.hpp>
+#include <twinkle/support/typedef.hpp>
+
+namespace twinkle::codegen
+{
+
+struct CGContext;
+struct Value;
+struct Type;
+
+// Async function being generated, which is lowered to a switched-resume
+// coroutine of LLVM and split by the coroutine passes
+// The function returns the handle of the coroutine, and its result is kept in
+// the promise until the future is awaited
+struct Coroutine {
+  llvm::Value* id;
+  llvm::Value* handle;
+
+  // { i8* waiter, i1 detached, T result }, where the result is omitted for
+  // void
+  // The waiter is the handle of the coroutine awaiting the future, and the
+  // detached flag is set when the future is discarded
+  llvm::AllocaInst* promise;
+
+  // Frees the frame, when the coroutine is destroyed or finishes detached
+  llvm::BasicBlock* cleanup_bb;
+
+  // Returns to the caller or resumer
+  llvm::BasicBlock* suspend_bb;
+};
+
+// Begin the function as a coroutine whose result has the type
+// Must be called at the beginning of the entry block
+void beginCoroutine(CGContext&                   ctx,
+                    llvm::Function* const        func,
+                    const std::shared_ptr<Type>& result_type);
+
+// Store the result into the promise, schedule the waiter, and suspend at the
+// final suspend point
+// Must be called where the function returns, after the body is generated
+// The result is nullptr for void
+void endCoroutine(CGContext&            ctx,
+                  llvm::Function* const func,
+                  llvm::Value* const    result);
+
+// Returns nullptr if the function is not a coroutine
+[[nodiscard]] const Coroutine* findCoroutine(CGContext&            ctx,
+                                             llvm::Function* const func);
+
+// Suspend the coroutine, and continue where it is resumed
+// Whoever resumes it must be arranged before this
+void createSuspend(CGContext& ctx, const Coroutine& coroutine);
+
+// Futures cannot be copied, since the coroutine of a future is destroyed when
+// it is awaited, so they are only moved out of calls
+// Throws if the value of the expression is a future but it is not a call
+void verifyFutureMove(CGContext&           ctx,
+                      const ast::Expr&     node,
+                      const Value&         value,
+                      const PositionRange& pos);
+
+// Wait for the future and take its result, and destroy its coroutine
+// In a coroutine, it suspends until the future completes, and otherwise the
+// executor runs on the thread until it completes
+// Variables are emptied when their futures are awaited, and awaiting an empty
+// future traps
+[[nodiscard]] Value createAwait(CGContext& ctx, const Value& future);
+
+// The coroutine of the future frees itself when it completes, or is destroyed
+// if it has already completed
+void createDetach(CGContext& ctx, const Value& future);
+
+// Detach the future of a variable at the end of its scope, unless it has been
+// awaited
+void createDetachUnlessAwaited(CGContext& ctx, const Value& future);
+
+} // namespace twinkle::codegen
+
+#endif
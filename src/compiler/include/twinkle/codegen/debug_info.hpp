@@ -0,0 +1,69 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#ifndef _58da98a2_9906_4db9_adf9_94e7cccee70a
+#define _58da98a2_9906_4db9_adf9_94e7cccee70a
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <twinkle/pch/pch.hpp>
+#include <twinkle/support/typedef.hpp>
+
+namespace twinkle::codegen
+{
+
+// Debug information of a module
+// Only line tables are emitted (like clang's -gline-tables-only), which is
+// enough to attribute samples of perf to lines and to symbolize stack traces
+struct DebugInfo : private boost::noncopyable {
+  // source must be the input the positions refer to, and outlive this
+  DebugInfo(llvm::Module&                module,
+            const std::filesystem::path& file,
+            const std::string&           source,
+            const bool                   optimized);
+
+  // Attach a subprogram to the function defined at pos
+  // If pos is not in this file (e.g. templates of imported files), the
+  // function is left without debug information
+  void createSubprogram(llvm::Function&        func,
+                        const std::string_view name,
+                        const PositionRange&   pos);
+
+  // Returns the location of pos in the function, or nullptr if either has no
+  // debug information
+  [[nodiscard]] llvm::DILocation* getLocation(const llvm::Function& func,
+                                              const PositionRange& pos) const;
+
+  // Must be called before verifying the module
+  void finalize();
+
+private:
+  struct LineAndColumn {
+    unsigned int line;
+    unsigned int column;
+  };
+
+  // Returns std::nullopt if pos is not in the source
+  [[nodiscard]] std::optional<LineAndColumn>
+  getLineAndColumn(const PositionRange& pos) const;
+
+  llvm::DIBuilder builder;
+
+  llvm::DIFile*        file;
+  llvm::DICompileUnit* compile_unit;
+
+  const std::string& source;
+
+  // Offset of the beginning of each line
+  std::vector<std::size_t> line_offsets;
+};
+
+} // namespace twinkle::codegen
+
+#endif
@@ -53,6 +53,13 @@ createScopeResolutionResult(CGContext& ctx, const ast::ScopeResolution& node);
                                const StmtContext& stmt_ctx,
                                const ast::Expr&   expr);
 
+// If one of the operands is a vector and the other is a scalar, broadcast the
+// scalar to all lanes
+[[nodiscard]] std::pair<Value, Value>
+splatScalar(CGContext&                     ctx,
+            const std::pair<Value, Value>& operands,
+            const PositionRange&           pos);
+
 } // namespace twinkle::codegen
 
 #endif
@@ -20,6 +20,52 @@ enum class BuiltinMacroKind {
   infinity_,
   huge_valf,
   huge_val,
+  atomic_relaxed,
+  atomic_consume,
+  atomic_acquire,
+  atomic_release,
+  atomic_acq_rel,
+  atomic_seq_cst,
+};
+
+enum class BuiltinFunctionKind {
+  unknown,
+  shufflevector,
+  select,
+  reduce_add,
+  reduce_mul,
+  reduce_and,
+  reduce_or,
+  reduce_xor,
+  reduce_min,
+  reduce_max,
+  expect,
+  prefetch,
+  assume,
+  unreachable,
+  readcyclecounter,
+  popcount,
+  clz,
+  ctz,
+  bswap,
+  rotl,
+  rotr,
+  atomic_load,
+  atomic_store,
+  atomic_exchange,
+  atomic_cmpxchg,
+  atomic_fetch_add,
+  atomic_fetch_sub,
+  atomic_fetch_and,
+  atomic_fetch_or,
+  atomic_fetch_xor,
+  atomic_fetch_nand,
+  atomic_fetch_min,
+  atomic_fetch_max,
+  atomic_thread_fence,
+  atomic_signal_fence,
+  async_yield,
+  async_wait_fd,
 };
 
 } // namespace twinkle::codegen
@@ -0,0 +1,106 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#ifndef _ea7f352e_b381_4a54_841d_dd28cf142d02
+#define _ea7f352e_b381_4a54_841d_dd28cf142d02
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <twinkle/pch/pch.hpp>
+
+namespace twinkle::codegen
+{
+
+// Optimization pipeline shared by AOT and JIT compilation
+struct OptimizationOptions {
+  // 0 to 3
+  unsigned int opt_level;
+
+  // 0 optimizes for speed, 1 for size (-Os) and 2 for size aggressively (-Oz)
+  unsigned int size_level;
+
+  // Textual pipeline in the same format as opt's -passes
+  // (e.g. 'function(sroa,instcombine)')
+  // If set, it replaces the default pipeline of the optimization level
+  std::optional<std::string> passes;
+
+  // If set, functions are instrumented to write the raw profile to this path
+  // at exit (patterns such as %m are expanded by the profile runtime)
+  std::optional<std::string> profile_generate;
+
+  // If set, the indexed profile is attached to the modules before
+  // optimization
+  // Functions are matched by their names, and internal functions also by the
+  // source file names of their modules
+  std::optional<std::string> profile_use;
+
+  // If set, the sample profile (e.g. converted from perf data) is attached to
+  // the modules before optimization
+  // Samples are attributed through the line tables, so the modules must have
+  // debug information
+  std::optional<std::string> profile_sample_use;
+};
+
+[[nodiscard]] llvm::OptimizationLevel
+getOptimizationLevel(const OptimizationOptions& options);
+
+// Returns an error if the pipeline cannot be parsed
+[[nodiscard]] llvm::Error
+verifyPassPipeline(const std::string&   passes,
+                   llvm::TargetMachine* target_machine);
+
+// Returns an error if the profile cannot be read
+[[nodiscard]] llvm::Error verifyProfile(const std::string& profile);
+
+// Returns an error if the sample profile cannot be read
+[[nodiscard]] llvm::Error verifySampleProfile(const std::string& profile);
+
+// Run the module pipeline of the optimization level, or the given pipeline
+// target_machine may be nullptr
+[[nodiscard]] llvm::Error
+optimizeModule(llvm::Module&              module,
+               llvm::TargetMachine*       target_machine,
+               const OptimizationOptions& options);
+
+using MustPreserveGlobal = std::function<bool(const llvm::GlobalValue&)>;
+
+// Run the full LTO pipeline on the module linked from the whole program
+// Global values for which must_preserve returns false are internalized first
+[[nodiscard]] llvm::Error
+optimizeLTOModule(llvm::Module&              module,
+                  llvm::TargetMachine*       target_machine,
+                  const OptimizationOptions& options,
+                  MustPreserveGlobal&&       must_preserve);
+
+// Light simplification run on each function as soon as its body has been
+// generated, which keeps the modules small before the module pipeline
+struct FunctionSimplifier : private boost::noncopyable {
+  // If enabled is false, run does nothing
+  explicit FunctionSimplifier(const bool enabled);
+
+  void run(llvm::Function& func);
+
+private:
+  const bool enabled;
+
+  // The analyses registered by the pass builder refer to it
+  llvm::PassBuilder pass_builder;
+
+  // Destroyed in reverse order, since they refer to each other
+  llvm::LoopAnalysisManager     lam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::CGSCCAnalysisManager    cgam;
+  llvm::ModuleAnalysisManager   mam;
+
+  llvm::FunctionPassManager fpm;
+};
+
+} // namespace twinkle::codegen
+
+#endif
@@ -0,0 +1,45 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#ifndef _30691b5b_c0c0_42a3_9286_56565b3b4dd4
+#define _30691b5b_c0c0_42a3_9286_56565b3b4dd4
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <twinkle/pch/pch.hpp>
+
+namespace twinkle::codegen
+{
+
+// Function compiled once for each target, and selected by the features of the
+// CPU when the program is loaded
+// Like GCC and clang, this is implemented with an ifunc, so it is only
+// available on x86 ELF targets
+struct TargetClones {
+  llvm::Function* func;
+
+  // Names of x86 features (e.g. avx2) and 'default'
+  std::vector<std::string> targets;
+};
+
+// Returns an error message if the targets cannot be cloned for the triple
+[[nodiscard]] std::optional<std::string>
+verifyTargetClones(const llvm::Triple&             triple,
+                   const std::vector<std::string>& targets);
+
+// Clone the function for each target, and replace it with an ifunc of the
+// same name whose resolver returns the clone of the highest priority feature
+// the CPU supports, or the original function for 'default'
+// Must be called after the whole module is generated, since references to
+// the function are replaced
+void createTargetClones(llvm::Module& module, const TargetClones& clones);
+
+} // namespace twinkle::codegen
+
+#endif
@@ -22,18 +22,30 @@ namespace twinkle::codegen
 [[nodiscard]] std::optional<bool>
 isVariadicArgs(const ast::ParameterList& params);
 
+// pos is the position of the function declaration
+// For async functions, return_type is the result type of the future
 void createFunctionBody(CGContext&                  ctx,
                         llvm::Function* const       func,
                         const std::string_view      name,
                         const ast::ParameterList&   params,
                         const std::shared_ptr<Type> return_type,
-                        const ast::Stmt&            body);
+                        const ast::Stmt&            body,
+                        const PositionRange&        pos,
+                        const bool                  is_async);
+
+// Async functions return the future of the declared return type
+[[nodiscard]] std::shared_ptr<Type>
+createReturnType(CGContext&               ctx,
+                 const ast::FunctionDecl& decl,
+                 const bool               is_async);
 
 [[nodiscard]] llvm::Function*
 declareFunction(CGContext&                   ctx,
                 const ast::FunctionDecl&     node,
                 const std::string_view       mangled_name,
-                const std::shared_ptr<Type>& return_type);
+                const std::shared_ptr<Type>& return_type,
+                // Attributes other than function attributes are ignored
+                const ast::Attrs&            attrs);
 
 // Indicates whether methods will be declared, defined, or both
 enum class MethodGeneration {
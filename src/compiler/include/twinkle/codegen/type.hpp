@@ -115,6 +115,29 @@ struct Type {
     unreachable();
   }
 
+  [[nodiscard]] virtual std::shared_ptr<Type>
+  getVectorElementType(CGContext&) const
+  {
+    unreachable();
+  }
+
+  [[nodiscard]] virtual std::uint32_t getVectorSize(CGContext&) const
+  {
+    unreachable();
+  }
+
+  [[nodiscard]] virtual std::shared_ptr<Type>
+  getTaskResultType(CGContext&) const
+  {
+    unreachable();
+  }
+
+  [[nodiscard]] virtual std::shared_ptr<Type>
+  getFutureResultType(CGContext&) const
+  {
+    unreachable();
+  }
+
   [[nodiscard]] virtual std::string getClassName(CGContext&) const
   {
     unreachable();
@@ -170,6 +193,21 @@ struct Type {
     return false;
   }
 
+  [[nodiscard]] virtual bool isVectorTy(CGContext&) const
+  {
+    return false;
+  }
+
+  [[nodiscard]] virtual bool isTaskTy(CGContext&) const
+  {
+    return false;
+  }
+
+  [[nodiscard]] virtual bool isFutureTy(CGContext&) const
+  {
+    return false;
+  }
+
   [[nodiscard]] virtual bool isUserDefinedType() const
   {
     return false;
@@ -332,6 +370,11 @@ struct UserDefinedType : public Type {
     return getRealType(ctx)->isRefTy(ctx);
   }
 
+  [[nodiscard]] bool isVectorTy(CGContext& ctx) const override
+  {
+    return getRealType(ctx)->isVectorTy(ctx);
+  }
+
   [[nodiscard]] const UnionVariants&
   getUnionVariants(CGContext& ctx) const override
   {
@@ -348,6 +391,17 @@ struct UserDefinedType : public Type {
     return getRealType(ctx)->getArraySize(ctx);
   }
 
+  [[nodiscard]] std::shared_ptr<Type>
+  getVectorElementType(CGContext& ctx) const override
+  {
+    return getRealType(ctx)->getVectorElementType(ctx);
+  }
+
+  [[nodiscard]] std::uint32_t getVectorSize(CGContext& ctx) const override
+  {
+    return getRealType(ctx)->getVectorSize(ctx);
+  }
+
   [[nodiscard]] std::string getClassName(CGContext& ctx) const override
   {
     return getRealType(ctx)->getClassName(ctx);
@@ -659,6 +713,152 @@ private:
   const std::uint64_t         array_size;
 };
 
+// SIMD vector of integers, floating point numbers or bools
+// The layout is that of LLVM vectors, which is the same as the vector
+// extension of GCC and clang (e.g. __attribute__((vector_size(16))) float), so
+// vectors can be shared with C through memory
+// They are passed to functions as LLVM vectors, which does not follow the
+// calling convention of C (clang lowers it in its frontend), so they cannot be
+// passed to or returned from C functions by value
+// Vectors of bools are masks, and are not compatible with C
+struct VectorType : public Type {
+  VectorType(const std::shared_ptr<Type>& element_type,
+             const std::uint32_t          size,
+             const bool                   is_mutable)
+    : Type{is_mutable}
+    , element_type{element_type}
+    , size{size}
+  {
+  }
+
+  [[nodiscard]] std::shared_ptr<Type> clone() const override
+  {
+    return std::make_shared<VectorType>(*this);
+  }
+
+  [[nodiscard]] std::string getMangledName(CGContext& ctx) const override;
+
+  [[nodiscard]] llvm::Type* getLLVMType(CGContext& ctx) const override
+  {
+    return llvm::FixedVectorType::get(element_type->getLLVMType(ctx), size);
+  }
+
+  [[nodiscard]] std::shared_ptr<Type>
+  getVectorElementType(CGContext&) const override
+  {
+    return element_type;
+  }
+
+  [[nodiscard]] std::uint32_t getVectorSize(CGContext&) const override
+  {
+    return size;
+  }
+
+  [[nodiscard]] bool isVectorTy(CGContext&) const override
+  {
+    return true;
+  }
+
+  // Same as the elements, so that operations on integers choose signed or
+  // unsigned instructions
+  [[nodiscard]] SignKind getSignKind(CGContext& ctx) const override
+  {
+    return element_type->getSignKind(ctx);
+  }
+
+  void setMutable(CGContext& ctx, const bool is_mutable) override
+  {
+    this->is_mutable = is_mutable;
+    element_type->setMutable(ctx, is_mutable);
+  }
+
+private:
+  const std::shared_ptr<Type> element_type;
+  const std::uint32_t         size;
+};
+
+// Handle of a task created by spawn, whose result is taken by join
+// It points to the task of the runtime
+struct TaskType : public Type {
+  TaskType(const std::shared_ptr<Type>& result_type, const bool is_mutable)
+    : Type{is_mutable}
+    , result_type{result_type}
+  {
+  }
+
+  [[nodiscard]] std::shared_ptr<Type> clone() const override
+  {
+    return std::make_shared<TaskType>(*this);
+  }
+
+  [[nodiscard]] std::string getMangledName(CGContext& ctx) const override
+  {
+    return "T" + result_type->getMangledName(ctx);
+  }
+
+  [[nodiscard]] llvm::Type* getLLVMType(CGContext& ctx) const override;
+
+  [[nodiscard]] std::shared_ptr<Type>
+  getTaskResultType(CGContext&) const override
+  {
+    return result_type;
+  }
+
+  [[nodiscard]] bool isTaskTy(CGContext&) const override
+  {
+    return true;
+  }
+
+  [[nodiscard]] SignKind getSignKind(CGContext&) const override
+  {
+    return SignKind::no_sign;
+  }
+
+private:
+  const std::shared_ptr<Type> result_type;
+};
+
+// Result of a call of an async function, whose result is taken by await
+// It is the handle of the coroutine of the call
+struct FutureType : public Type {
+  FutureType(const std::shared_ptr<Type>& result_type, const bool is_mutable)
+    : Type{is_mutable}
+    , result_type{result_type}
+  {
+  }
+
+  [[nodiscard]] std::shared_ptr<Type> clone() const override
+  {
+    return std::make_shared<FutureType>(*this);
+  }
+
+  [[nodiscard]] std::string getMangledName(CGContext& ctx) const override
+  {
+    return "F" + result_type->getMangledName(ctx);
+  }
+
+  [[nodiscard]] llvm::Type* getLLVMType(CGContext& ctx) const override;
+
+  [[nodiscard]] std::shared_ptr<Type>
+  getFutureResultType(CGContext&) const override
+  {
+    return result_type;
+  }
+
+  [[nodiscard]] bool isFutureTy(CGContext&) const override
+  {
+    return true;
+  }
+
+  [[nodiscard]] SignKind getSignKind(CGContext&) const override
+  {
+    return SignKind::no_sign;
+  }
+
+private:
+  const std::shared_ptr<Type> result_type;
+};
+
 // Hold pointer type
 // However, implement so that dereferences are not required when referencing
 struct ReferenceType : public Type {
@@ -16,6 +16,7 @@
 #include <optional>
 #include <variant>
 #include <filesystem>
+#include <ostream>
 
 namespace twinkle
 {
@@ -41,9 +42,63 @@ struct AOTResult {
 
 using CompileResult = std::variant<JITResult, AOTResult>;
 
+// Diagnostics are written to std::cerr
 std::optional<CompileResult> compile(const Context&         ctx,
                                      const std::string_view argv_front);
 
+std::optional<CompileResult> compile(const Context&         ctx,
+                                     const std::string_view argv_front,
+                                     std::ostream&          diagnostics);
+
+struct BatchResult {
+  // std::nullopt if the compilation failed
+  std::optional<CompileResult> result;
+
+  std::string diagnostics;
+};
+
+// Compile independent programs in this process, running up to threads of them
+// concurrently (0 means the number of hardware threads)
+// Initialized targets and parsed imported files are shared by the jobs
+// Results are in the same order as contexts
+// --time-trace and --stats cannot be used, since they are per process
+[[nodiscard]] std::vector<BatchResult>
+compileBatch(const std::vector<Context>& contexts,
+             const std::string_view      argv_front,
+             const unsigned int          threads);
+
+// Remove the temporary files created by compilations, such as the object
+// files of executables, which are kept in memory if possible
+// Call this once the created files have been linked
+void cleanupTemporaryFiles() noexcept;
+
+// Initialize what can be shared by the compilations of a compile server (the
+// host target), and enable the import cache
+void initializeServer();
+
+// Returns the absolute paths of the imported files that were not found in the
+// import cache
+[[nodiscard]] std::vector<std::string> getImportCacheMisses();
+
+// Parse the files and add them to the import cache
+// The files that cannot be parsed are ignored, since they are reported by the
+// compilation that imports them
+void warmImportCache(const std::vector<std::string>& files,
+                     const std::string_view          argv_front) noexcept;
+
+// Path of the executable linked from the objects, a.out in the output
+// directory
+[[nodiscard]] std::filesystem::path getExecutablePath(const Context& ctx);
+
+// Returns true if the compiler was built with lld
+[[nodiscard]] bool hasInternalLinker() noexcept;
+
+// Link object files into an executable in-process with lld
+// Returns linker exit status
+[[nodiscard]] int linkInProcess(const Context&                            ctx,
+                                const std::vector<std::filesystem::path>& files,
+                                const std::string_view argv_front);
+
 } // namespace twinkle
 
 #endif
@@ -13,6 +13,7 @@
 #endif // _MSC_VER > 1000
 
 #include <twinkle/pch/pch.hpp>
+#include <twinkle/codegen/optimizer.hpp>
 
 namespace twinkle::jit
 {
@@ -21,11 +22,17 @@ struct JitCompiler {
   JitCompiler(std::unique_ptr<llvm::orc::ExecutionSession>    exec_session,
               std::unique_ptr<llvm::orc::EPCIndirectionUtils> epciu,
               llvm::orc::JITTargetMachineBuilder              jit_tmb,
-              llvm::DataLayout                                data_layout);
+              llvm::DataLayout                                data_layout,
+              const codegen::OptimizationOptions&             options);
 
   ~JitCompiler();
 
-  [[nodiscard]] static llvm::Expected<std::unique_ptr<JitCompiler>> create();
+  // Modules are optimized in the same way as AOT compilation
+  // features is comma separated (e.g. '+avx2,-fma')
+  [[nodiscard]] static llvm::Expected<std::unique_ptr<JitCompiler>>
+  create(const codegen::OptimizationOptions& options,
+         const std::string&                  cpu,
+         const std::string&                  features);
 
   [[nodiscard]] const llvm::DataLayout& getDataLayout() const
   {
@@ -54,6 +61,11 @@ private:
   llvm::DataLayout             data_layout;
   llvm::orc::MangleAndInterner mangle;
 
+  // Used to create the target machines of the optimization
+  const llvm::orc::JITTargetMachineBuilder jit_tmb;
+
+  const codegen::OptimizationOptions optimization_options;
+
   llvm::orc::RTDyldObjectLinkingLayer object_layer;
   llvm::orc::IRCompileLayer           compile_layer;
   llvm::orc::IRTransformLayer         optimize_layer;
@@ -67,9 +79,9 @@ private:
     exit(1);
   }
 
-  [[nodiscard]] static llvm::Expected<llvm::orc::ThreadSafeModule>
+  [[nodiscard]] llvm::Expected<llvm::orc::ThreadSafeModule>
   optimizeModule(llvm::orc::ThreadSafeModule tsm,
-                 const llvm::orc::MaterializationResponsibility&);
+                 const llvm::orc::MaterializationResponsibility&) const;
 };
 
 } // namespace twinkle::jit
@@ -0,0 +1,47 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#ifndef _99a4aa0f_0453_4690_a742_c49e3d729e9e
+#define _99a4aa0f_0453_4690_a742_c49e3d729e9e
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <twinkle/pch/pch.hpp>
+#include <twinkle/support/exception.hpp>
+
+namespace twinkle::link
+{
+
+// Exception class for errors related to linking.
+struct LinkError : public ErrorBase {
+  explicit LinkError(const std::string& what_arg)
+    : ErrorBase{what_arg}
+  {
+  }
+};
+
+// Returns true if the compiler was built with lld
+[[nodiscard]] bool hasInternalLinker() noexcept;
+
+// Link object files into an executable with lld's ELF driver in the current
+// process, instead of spawning the gcc driver
+// The C runtime files are searched for in the standard locations, as the gcc
+// driver does
+// Returns true on success
+[[nodiscard]] bool
+linkInProcess(const std::string_view                    argv_front,
+              const std::filesystem::path&              output_file,
+              const std::vector<std::filesystem::path>& files,
+              const std::vector<std::string>&           linked_libs,
+              const std::optional<std::string>&         target_triple,
+              const bool                                pie);
+
+} // namespace twinkle::link
+
+#endif
@@ -60,6 +60,44 @@ private:
   std::filesystem::path file;
 };
 
+// Parsed imported files are kept in this cache while it is enabled, so that
+// the compilations of a compile server or a batch do not parse the same
+// imports (e.g. std/memory.twk) again
+// Since the server forks a process for each compilation, the cache is filled
+// by the server from the misses reported by the processes, on a thread of its
+// own
+namespace import_cache
+{
+
+void enable();
+
+// Disable the cache and drop the cached files
+void disable();
+
+[[nodiscard]] bool isEnabled();
+
+// Returns nullptr if the file is not cached or has been modified since
+// Misses are recorded while the cache is enabled
+[[nodiscard]] std::shared_ptr<const Parser::Result>
+find(const std::filesystem::path& path);
+
+// Parse the file and add it to the cache
+void insert(const std::string_view argv_front, const std::filesystem::path& path);
+
+// Add the result of the file parsed by the caller to the cache
+// Does nothing unless the cache is enabled
+void insert(const std::filesystem::path&          path,
+            std::shared_ptr<const Parser::Result> result);
+
+// Returns the absolute paths of the files that were not found in the cache
+[[nodiscard]] std::vector<std::filesystem::path> getMisses();
+
+} // namespace import_cache
+
+// Returns the number of nodes of each kind (--stats)
+[[nodiscard]] std::map<std::string, std::size_t>
+countAstNodes(const ast::TranslationUnit& ast);
+
 } // namespace twinkle::parse
 
 #endif
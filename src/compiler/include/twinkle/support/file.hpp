@@ -30,6 +30,29 @@ struct FileError : public ErrorBase {
 [[nodiscard]] std::string loadFile(const std::string_view       argv_front,
                                    const std::filesystem::path& path);
 
+// Write std::string to a file.
+void writeFile(const std::string_view       argv_front,
+               const std::filesystem::path& path,
+               const std::string_view       data);
+
+// Returns a unique path in the temporary directory, ending with the suffix.
+// The file is removed by removeTemporaryFiles.
+[[nodiscard]] std::string
+createTemporaryFilepath(const std::string_view suffix = "");
+
+// Returns a path from which data can be read by this process and its child
+// processes (e.g. a linker driver). On Linux, data is kept in memory and is
+// never written to the disk. Otherwise, it is written to a temporary file.
+// The name is only used to identify the file (e.g. in diagnostics).
+// The file is removed by removeTemporaryFiles.
+[[nodiscard]] std::filesystem::path
+createMemoryFile(const std::string_view argv_front,
+                 const std::string_view name,
+                 const std::string_view data);
+
+// Remove the files created by createTemporaryFilepath and createMemoryFile.
+void removeTemporaryFiles() noexcept;
+
 } // namespace twinkle
 
 #endif
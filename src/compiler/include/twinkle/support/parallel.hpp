@@ -0,0 +1,67 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#ifndef _4c1e2f8a_6d5b_4e7f_9a3c_2b8d0e6f1a57
+#define _4c1e2f8a_6d5b_4e7f_9a3c_2b8d0e6f1a57
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <twinkle/pch/pch.hpp>
+#include <twinkle/support/time_trace.hpp>
+#include <exception>
+
+namespace twinkle
+{
+
+// Call 'func' with each index in [0, count) on up to 'jobs' threads
+// If 'jobs' is 0, the number of hardware threads is used
+// When some calls throw, the exception of the smallest index is rethrown after
+// all calls have finished, so errors are the same as in a sequential run
+template <typename F>
+void parallelFor(const unsigned int jobs, const std::size_t count, F&& func)
+{
+  if (jobs == 1 || count < 2) {
+    for (std::size_t idx = 0; idx < count; ++idx)
+      func(idx);
+
+    return;
+  }
+
+  std::vector<std::exception_ptr> errors(count);
+
+  const auto time_trace = llvm::timeTraceProfilerEnabled();
+
+  {
+    llvm::ThreadPool pool{llvm::hardware_concurrency(jobs)};
+
+    for (std::size_t idx = 0; idx < count; ++idx) {
+      pool.async([&func, &errors, idx, time_trace] {
+        const TimeTraceThread time_trace_thread{time_trace};
+
+        try {
+          func(idx);
+        }
+        catch (...) {
+          errors[idx] = std::current_exception();
+        }
+      });
+    }
+
+    pool.wait();
+  }
+
+  for (const auto& r : errors) {
+    if (r)
+      std::rethrow_exception(r);
+  }
+}
+
+} // namespace twinkle
+
+#endif
@@ -0,0 +1,64 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#ifndef _1cb0a6be_7791_4164_a0c8_089c4fef1a90
+#define _1cb0a6be_7791_4164_a0c8_089c4fef1a90
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <twinkle/pch/pch.hpp>
+
+namespace twinkle::stats
+{
+
+// Counters of the compilation pipeline (--stats)
+// They are only recorded while a Collector exists, so callers should check
+// enabled() before computing anything expensive
+// All functions are thread-safe
+
+enum class TemplateKind {
+  function,
+  class_,
+  union_,
+};
+
+[[nodiscard]] bool enabled() noexcept;
+
+void addFile(const std::filesystem::path& file, const std::string_view source);
+
+void addAstNodes(const std::map<std::string, std::size_t>& counts);
+
+void addTemplateInstantiation(const TemplateKind kind, const std::string& name);
+
+void addFunction(const std::size_t basic_blocks);
+
+// Number of IR instructions of a function before and after the function pass
+// manager is run on it
+void addFunctionPasses(const std::size_t instructions_before,
+                       const std::size_t instructions_after);
+
+struct Collector : private boost::noncopyable {
+  // Also enables LLVM's statistics (STATISTIC)
+  // They are only counted if LLVM was built with assertions or
+  // LLVM_FORCE_ENABLE_STATS
+  explicit Collector(const std::string_view argv_front);
+
+  ~Collector();
+
+  void print(std::ostream& os) const;
+
+  void writeJSON(const std::filesystem::path& file) const;
+
+private:
+  const std::string_view argv_front;
+};
+
+} // namespace twinkle::stats
+
+#endif
@@ -0,0 +1,54 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#ifndef _d040459f_ecb8_40f7_80b0_52481c5c1b43
+#define _d040459f_ecb8_40f7_80b0_52481c5c1b43
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <twinkle/pch/pch.hpp>
+
+namespace twinkle
+{
+
+// Records compile time as Chrome trace events using LLVM's time trace
+// profiler, while this exists
+// Events are added with llvm::TimeTraceScope
+struct TimeTraceProfiler : private boost::noncopyable {
+  // Events shorter than granularity (microseconds) are not recorded
+  TimeTraceProfiler(const unsigned int granularity,
+                    const std::string_view argv_front);
+
+  ~TimeTraceProfiler();
+
+  // If file is empty, '<fallback>.time-trace' is written
+  void write(const std::string& file, const std::string& fallback) const;
+
+private:
+  const std::string_view argv_front;
+};
+
+// Granularity the profiler was created with
+[[nodiscard]] unsigned int getTimeTraceGranularity() noexcept;
+
+// The profiler is per thread, so it needs to be enabled on worker threads as
+// well while they are working
+struct TimeTraceThread : private boost::noncopyable {
+  // If enabled is false, do nothing
+  explicit TimeTraceThread(const bool enabled);
+
+  ~TimeTraceThread();
+
+private:
+  const bool enabled;
+};
+
+} // namespace twinkle
+
+#endif
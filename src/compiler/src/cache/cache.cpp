@@ -0,0 +1,121 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#include <twinkle/cache/cache.hpp>
+#include <twinkle/support/utils.hpp>
+
+namespace twinkle::cache
+{
+
+[[nodiscard]] std::string
+hash(std::initializer_list<const std::string_view> strings)
+{
+  llvm::SHA1 sha1;
+
+  for (const auto& r : strings) {
+    sha1.update(llvm::StringRef{r.data(), r.size()});
+
+    // Separator, so that ("ab", "c") and ("a", "bc") are different
+    sha1.update(llvm::StringRef{"\0", 1});
+  }
+
+  return llvm::toHex(sha1.final(), true);
+}
+
+Cache::Cache(const std::string_view       argv_front,
+             const std::filesystem::path& dir,
+             const std::string&           policy)
+  : dir{dir}
+{
+  auto policy_expected = llvm::parseCachePruningPolicy(policy);
+
+  if (auto err = policy_expected.takeError()) {
+    throw CacheError{
+      formatError(argv_front,
+                  fmt::format("invalid cache policy '{}': {}",
+                              policy,
+                              llvm::toString(std::move(err))))};
+  }
+
+  this->policy = *policy_expected;
+
+  if (const auto ec = llvm::sys::fs::create_directories(dir.string())) {
+    throw CacheError{formatError(
+      argv_front,
+      fmt::format("{}: {}", dir.string(), ec.message()))};
+  }
+}
+
+Cache::~Cache()
+{
+  llvm::pruneCache(dir.string(), policy);
+}
+
+[[nodiscard]] std::optional<std::string>
+Cache::get(const std::string& key) const
+{
+  const auto path = getEntryPath(key).string();
+
+  auto buffer = llvm::MemoryBuffer::getFile(path,
+                                            /* IsText */ false,
+                                            /* RequiresNullTerminator */ false);
+
+  if (!buffer)
+    return std::nullopt;
+
+  // Record the access for pruning, since atime is often disabled on NFS
+  if (int fd; !llvm::sys::fs::openFileForWrite(path,
+                                               fd,
+                                               llvm::sys::fs::CD_OpenExisting,
+                                               llvm::sys::fs::OF_Append)) {
+    llvm::sys::fs::setLastAccessAndModificationTime(
+      fd,
+      std::chrono::system_clock::now());
+
+    llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+  }
+
+  return (*buffer)->getBuffer().str();
+}
+
+void Cache::put(const std::string& key, const llvm::StringRef data) const
+{
+  auto temp_file
+    = llvm::sys::fs::TempFile::create((dir / "twinkle-tmp-%%%%%%%%").string());
+
+  if (!temp_file) {
+    llvm::consumeError(temp_file.takeError());
+    return;
+  }
+
+  {
+    llvm::raw_fd_ostream os{temp_file->FD, /* shouldClose */ false};
+    os << data;
+    os.flush();
+
+    if (os.has_error()) {
+      os.clear_error();
+      llvm::consumeError(temp_file->discard());
+      return;
+    }
+  }
+
+  // If another process has written the same entry in the meantime, its
+  // contents are the same, so it is fine to overwrite it
+  if (auto err = temp_file->keep(getEntryPath(key).string())) {
+    llvm::consumeError(std::move(err));
+    llvm::consumeError(temp_file->discard());
+  }
+}
+
+[[nodiscard]] std::filesystem::path
+Cache::getEntryPath(const std::string& key) const
+{
+  return dir / ("llvmcache-" + key);
+}
+
+} // namespace twinkle::cache
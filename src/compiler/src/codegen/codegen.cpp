@@ -10,8 +10,11 @@
 #include <twinkle/codegen/type.hpp>
 #include <twinkle/codegen/exception.hpp>
 #include <twinkle/unicode/unicode.hpp>
+#include <twinkle/support/parallel.hpp>
+#include <twinkle/support/file.hpp>
+#include <twinkle/support/time_trace.hpp>
+#include <twinkle/support/stats.hpp>
 #include <cassert>
-#include <boost/filesystem.hpp>
 
 #if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
 #include <unistd.h> // isatty
@@ -20,11 +23,85 @@
 namespace
 {
 
-[[nodiscard]] std::string createTemporaryFilepath()
+// Functions that initialize a target built into LLVM
+// Targets without an assembly printer or parser have nullptr
+struct TargetInitializers {
+  void (*target_info)();
+  void (*target)();
+  void (*target_mc)();
+  void (*asm_printer)();
+  void (*asm_parser)();
+};
+
+// Keyed by the lowercase name of the target (e.g. x86, aarch64)
+[[nodiscard]] const std::unordered_map<std::string, TargetInitializers>&
+getTargetInitializers()
 {
-  return (boost::filesystem::temp_directory_path()
-          / boost::filesystem::unique_path())
-    .native();
+  static const auto initializers = [] {
+    std::unordered_map<std::string, TargetInitializers> initializers;
+
+#define LLVM_TARGET(TargetName)                                                \
+  initializers[twinkle::stringToLower(#TargetName)]                            \
+    = {LLVMInitialize##TargetName##TargetInfo,                                 \
+       LLVMInitialize##TargetName##Target,                                     \
+       LLVMInitialize##TargetName##TargetMC,                                   \
+       nullptr,                                                                \
+       nullptr};
+#include <llvm/Config/Targets.def>
+
+#define LLVM_ASM_PRINTER(TargetName)                                           \
+  initializers[twinkle::stringToLower(#TargetName)].asm_printer                \
+    = LLVMInitialize##TargetName##AsmPrinter;
+#include <llvm/Config/AsmPrinters.def>
+
+#define LLVM_ASM_PARSER(TargetName)                                            \
+  initializers[twinkle::stringToLower(#TargetName)].asm_parser                 \
+    = LLVMInitialize##TargetName##AsmParser;
+#include <llvm/Config/AsmParsers.def>
+
+    return initializers;
+  }();
+
+  return initializers;
+}
+
+[[nodiscard]] llvm::SmallVector<char, 0>
+writeBitcode(const llvm::Module& module)
+{
+  llvm::SmallVector<char, 0> buffer;
+  llvm::raw_svector_ostream  os{buffer};
+
+  llvm::WriteBitcodeToFile(module, os);
+
+  return buffer;
+}
+
+// Returns nullptr if the bitcode could not be read
+[[nodiscard]] std::unique_ptr<llvm::Module>
+readBitcode(const llvm::SmallVector<char, 0>& buffer,
+            const llvm::StringRef             name,
+            llvm::LLVMContext&                context)
+{
+  auto module_expected = llvm::parseBitcodeFile(
+    llvm::MemoryBufferRef{llvm::StringRef{buffer.data(), buffer.size()}, name},
+    context);
+
+  if (!module_expected) {
+    llvm::consumeError(module_expected.takeError());
+    return nullptr;
+  }
+
+  return std::move(*module_expected);
+}
+
+// Since modules cannot be linked across contexts, copy the module to the
+// context via bitcode
+[[nodiscard]] std::unique_ptr<llvm::Module>
+moveToContext(const llvm::Module& module, llvm::LLVMContext& context)
+{
+  return readBitcode(writeBitcode(module),
+                     module.getModuleIdentifier(),
+                     context);
 }
 
 } // namespace
@@ -94,12 +171,13 @@ template <typename R = std::vector<std::string>>
 // Code generator
 //===----------------------------------------------------------------------===//
 
-CGContext::CGContext(llvm::LLVMContext&      context,
-                     PositionCache&&         current_file_poscache,
-                     std::filesystem::path&& current_file,
-                     const std::string&      source_code,
-                     const unsigned int      opt_level,
-                     const bool              jit) noexcept
+CGContext::CGContext(llvm::LLVMContext&         context,
+                     PositionCache&&            current_file_poscache,
+                     std::filesystem::path&&    current_file,
+                     const std::string&         source_code,
+                     const OptimizationOptions& optimization_options,
+                     const bool                 debug_info,
+                     const bool                 jit) noexcept
   : context{context}
   , module{std::make_unique<llvm::Module>(current_file.filename().string(),
                                           context)}
@@ -107,20 +185,17 @@ CGContext::CGContext(llvm::LLVMContext&      context,
   , current_file{std::move(current_file)}
   , created_class_template_table{*this}
   , mangler{*this}
-  , fpm{module.get()}
+  // An explicit pipeline is run as given, without the early simplification
+  , function_simplifier{!jit && optimization_options.opt_level != 0
+                        && !optimization_options.passes}
+  , debug_info{debug_info ? std::make_unique<DebugInfo>(
+                 *module,
+                 this->current_file,
+                 source_code,
+                 optimization_options.opt_level != 0)
+                          : nullptr}
   , jit{jit}
 {
-  if (!jit) {
-    // Setup pass manager
-    llvm::PassManagerBuilder builder;
-
-    builder.OptLevel = opt_level;
-
-    builder.populateFunctionPassManager(fpm);
-  }
-
-  fpm.doInitialization();
-
   const auto current_filename = this->current_file.string();
 
   source_code_table.insert(current_filename, splitByLine(source_code));
@@ -129,6 +204,20 @@ CGContext::CGContext(llvm::LLVMContext&      context,
                               std::move(current_file_poscache));
 }
 
+void CGContext::runFunctionPasses(llvm::Function& func)
+{
+  if (!stats::enabled()) {
+    function_simplifier.run(func);
+    return;
+  }
+
+  const auto instructions_before = func.getInstructionCount();
+
+  function_simplifier.run(func);
+
+  stats::addFunctionPasses(instructions_before, func.getInstructionCount());
+}
+
 [[nodiscard]] std::string
 CGContext::formatError(const PositionRange&   pos,
                        const std::string_view message) const
@@ -159,74 +248,194 @@ CGContext::formatError(const PositionRange&   pos,
   unreachable();
 }
 
-CodeGenerator::CodeGenerator(
-  const std::string_view               argv_front,
-  std::vector<parse::Parser::Result>&& parse_results,
-  const unsigned int                   opt_level,
-  const llvm::Reloc::Model             relocation_model,
-  const std::optional<std::string>&    target_triple_arg,
-  const bool                           jit)
-  : argv_front{argv_front}
-  , context{std::make_unique<llvm::LLVMContext>()}
-  , relocation_model{relocation_model}
-  , parse_results{parse_results}
+void initializeTargets(const std::optional<std::string>& target_triple)
 {
-  results.reserve(parse_results.size());
+  // The target registry of LLVM is not thread-safe, and the jobs of a batch
+  // initialize their targets concurrently
+  static std::mutex mutex;
+
+  const std::lock_guard lock{mutex};
+
+  if (!target_triple) {
+    // Initializing every target takes a visible share of the run time of
+    // short programs with JIT, so only the host target is initialized
+    if (!llvm::InitializeNativeTarget()
+        && !llvm::InitializeNativeTargetAsmPrinter()
+        && !llvm::InitializeNativeTargetAsmParser())
+      return;
+  }
+  else {
+    const auto arch = llvm::Triple::getArchTypePrefix(
+      llvm::Triple{llvm::Triple::normalize(*target_triple)}.getArch());
+
+    const auto& initializers = getTargetInitializers();
+
+    if (const auto it = initializers.find(arch.str());
+        it != initializers.end()) {
+      const auto& [target_info, target, target_mc, asm_printer, asm_parser]
+        = it->second;
+
+      target_info();
+      target();
+      target_mc();
+
+      if (asm_printer)
+        asm_printer();
+      if (asm_parser)
+        asm_parser();
 
+      return;
+    }
+  }
+
+  // Names of some targets differ from their architecture (e.g. PowerPC and
+  // ppc), and LLVM may have been built without the host target
   llvm::InitializeAllTargetInfos();
   llvm::InitializeAllTargets();
   llvm::InitializeAllTargetMCs();
   llvm::InitializeAllAsmParsers();
   llvm::InitializeAllAsmPrinters();
+}
 
-  initTargetTripleAndMachine(target_triple_arg);
+[[nodiscard]] TargetCPU getTargetCPU(const std::optional<std::string>& mcpu,
+                                     const std::optional<std::string>& mattr,
+                                     const bool                        jit)
+{
+  TargetCPU target_cpu;
+
+  if (mcpu == "native" || (!mcpu && jit)) {
+    target_cpu.cpu = llvm::sys::getHostCPUName().str();
 
-  for (auto it = parse_results.begin(), last = parse_results.end(); it != last;
-       ++it) {
-    verifyOptLevel(opt_level);
+    // Sorted since the features are a part of the keys of the object cache
+    std::vector<std::string> features;
 
-    CGContext ctx{*context,
-                  std::move(it->positions),
-                  std::move(it->file),
-                  it->input,
-                  opt_level,
-                  jit};
+    if (llvm::StringMap<bool> host_features;
+        llvm::sys::getHostCPUFeatures(host_features)) {
+      for (const auto& feature : host_features) {
+        features.push_back((feature.getValue() ? "+" : "-")
+                           + feature.getKey().str());
+      }
+    }
 
-    ctx.module->setTargetTriple(target_triple);
-    ctx.module->setDataLayout(target_machine->createDataLayout());
+    std::sort(features.begin(), features.end());
 
-    codegen(it->ast, ctx);
+    target_cpu.features = llvm::join(features, ",");
+  }
+  else
+    target_cpu.cpu = mcpu ? *mcpu : "generic";
 
-    results.emplace_back(std::move(ctx.module), std::move(ctx.current_file));
+  if (mattr && !mattr->empty()) {
+    // Features given later override the earlier ones
+    target_cpu.features += (target_cpu.features.empty() ? "" : ",") + *mattr;
   }
+
+  return target_cpu;
 }
 
-void CodeGenerator::verifyOptLevel(const unsigned int opt_level) const
+CodeGenerator::CodeGenerator(
+  const std::string_view               argv_front,
+  std::vector<parse::Parser::Result>&& parse_results,
+  OptimizationOptions&&                optimization_options,
+  const llvm::Reloc::Model             relocation_model,
+  const std::optional<std::string>&    target_triple_arg,
+  TargetCPU&&                          target_cpu,
+  const bool                           jit,
+  const bool                           debug_info,
+  const unsigned int                   jobs,
+  const unsigned int                   codegen_partitions,
+  const std::filesystem::path&         output_dir)
+  : argv_front{argv_front}
+  , target_cpu{std::move(target_cpu)}
+  , relocation_model{relocation_model}
+  , optimization_options{std::move(optimization_options)}
+  , debug_info{debug_info}
+  , jobs{jobs}
+  , codegen_partitions{codegen_partitions}
+  , output_dir{output_dir}
+  , parse_results{std::move(parse_results)}
 {
-  switch (opt_level) {
-  case 0:
-  case 1:
-  case 2:
-  case 3:
-    return;
-  default:
+  initializeTargets(target_triple_arg);
+
+  initTarget(target_triple_arg);
+
+  verifyTargetCPU();
+
+  verifyOptimizationOptions();
+
+  if (codegen_partitions == 0) {
+    throw CodegenError{
+      formatError(argv_front, "invalid number of codegen partitions")};
+  }
+
+  results.resize(this->parse_results.size());
+
+  parallelFor(jobs, this->parse_results.size(), [&](const std::size_t idx) {
+    results[idx] = generateModule(this->parse_results[idx], jit);
+  });
+}
+
+void CodeGenerator::verifyOptimizationOptions() const
+{
+  if (3 < optimization_options.opt_level
+      || 2 < optimization_options.size_level)
     throw CodegenError{formatError(argv_front, "invalid optimization level")};
+
+  if (optimization_options.passes) {
+    if (auto err = verifyPassPipeline(*optimization_options.passes,
+                                      createTargetMachine().get())) {
+      throw CodegenError{
+        formatError(argv_front,
+                    fmt::format("invalid pass pipeline: {}",
+                                llvm::toString(std::move(err))))};
+    }
+  }
+
+  const auto profile_options
+    = optimization_options.profile_generate.has_value()
+      + optimization_options.profile_use.has_value()
+      + optimization_options.profile_sample_use.has_value();
+
+  if (1 < profile_options) {
+    throw CodegenError{
+      formatError(argv_front,
+                  "only one of --profile-generate, --profile-use and "
+                  "--profile-sample-use can be used")};
+  }
+
+  if (optimization_options.profile_use) {
+    if (auto err = verifyProfile(*optimization_options.profile_use)) {
+      throw CodegenError{
+        formatError(argv_front,
+                    fmt::format("{}: {}",
+                                *optimization_options.profile_use,
+                                llvm::toString(std::move(err))))};
+    }
+  }
+
+  if (const auto& profile = optimization_options.profile_sample_use) {
+    if (auto err = verifySampleProfile(*profile)) {
+      throw CodegenError{
+        formatError(argv_front,
+                    fmt::format("{}: {}",
+                                *profile,
+                                llvm::toString(std::move(err))))};
+    }
   }
 }
 
 [[nodiscard]] FilePaths CodeGenerator::emitLlvmIRFiles()
 {
-  FilePaths created_files;
+  FilePaths created_files(results.size());
 
-  for (auto it = results.begin(), last = results.end(); it != last; ++it) {
-    const auto& file = std::get<std::filesystem::path>(*it);
+  parallelFor(jobs, results.size(), [&](const std::size_t idx) {
+    const auto& [context, module, file, imported_files] = results[idx];
 
-    const auto output_file = file.stem().string() + ".ll";
+    const auto output_file = output_dir / (file.stem().string() + ".ll");
 
-    created_files.push_back(output_file);
+    created_files[idx] = output_file;
 
     std::error_code      ostream_ec;
-    llvm::raw_fd_ostream os{output_file,
+    llvm::raw_fd_ostream os{output_file.string(),
                             ostream_ec,
                             llvm::sys::fs::OpenFlags::OF_None};
 
@@ -236,8 +445,8 @@ void CodeGenerator::verifyOptLevel(const unsigned int opt_level) const
         fmt::format("{}: {}", file.string(), ostream_ec.message()))};
     }
 
-    std::get<std::unique_ptr<llvm::Module>>(*it)->print(os, nullptr);
-  }
+    module->print(os, nullptr);
+  });
 
   return created_files;
 }
@@ -252,7 +461,7 @@ void CodeGenerator::verifyOptLevel(const unsigned int opt_level) const
   return emitFiles(llvm::CGFT_ObjectFile);
 }
 
-[[nodiscard]] FilePaths CodeGenerator::emitTemporaryObjectFiles()
+[[nodiscard]] FilePaths CodeGenerator::emitMemoryObjectFiles()
 {
   return emitFiles(llvm::CGFT_ObjectFile, true);
 }
@@ -263,27 +472,21 @@ void CodeGenerator::verifyOptLevel(const unsigned int opt_level) const
 
   jit_compiled = true;
 
-  auto jit_expected = jit::JitCompiler::create();
+  llvm::TimeTraceScope scope{"JIT"};
+
+  auto jit_expected = jit::JitCompiler::create(optimization_options,
+                                               target_cpu.cpu,
+                                               target_cpu.features);
   if (auto err = jit_expected.takeError())
     throw CodegenError{formatError(argv_front, llvm::toString(std::move(err)))};
 
   auto jit = std::move(*jit_expected);
 
-  auto [front_module, file] = std::move(results.front());
-
-  // Link all modules
-  for (auto it = results.begin() + 1, last = results.end(); it != last; ++it) {
-    auto [module, file] = std::move(*it);
+  linkModules();
 
-    if (llvm::Linker::linkModules(*front_module, std::move(module))) {
-      throw CodegenError{
-        formatError(argv_front,
-                    fmt::format("{}: Could not link", file.string()))};
-    }
-  }
+  auto& [context, module, file, imported_files] = results.front();
 
-  if (auto err
-      = jit->addModule({std::move(front_module), std::move(context)})) {
+  if (auto err = jit->addModule({std::move(module), std::move(context)})) {
     throw CodegenError{
       formatError(file.string(), llvm::toString(std::move(err)))};
   }
@@ -303,11 +506,271 @@ void CodeGenerator::verifyOptLevel(const unsigned int opt_level) const
   return main_addr();
 }
 
-void CodeGenerator::codegen(const ast::TranslationUnit& ast, CGContext& ctx)
+void CodeGenerator::doLTO()
+{
+  llvm::TimeTraceScope scope{"LTO"};
+
+  linkModules();
+
+  auto& module = *results.front().module;
+
+  const auto target_machine = createTargetMachine();
+
+  // Only main and the functions with nomangle attribute can be referenced
+  // from outside the program
+  auto const must_preserve = [](const llvm::GlobalValue& gv) {
+    return !gv.getName().startswith(mangle::prefix);
+  };
+
+  if (auto err = optimizeLTOModule(module,
+                                   target_machine.get(),
+                                   optimization_options,
+                                   must_preserve)) {
+    throw CodegenError{formatError(argv_front, llvm::toString(std::move(err)))};
+  }
+}
+
+[[nodiscard]] FilePaths CodeGenerator::emitThinLTOObjectFiles(
+  const std::optional<std::filesystem::path>& cache_dir)
+{
+  llvm::TimeTraceScope scope{"ThinLTO"};
+
+  llvm::lto::Config config;
+
+  config.CPU           = target_cpu.cpu;
+  config.RelocModel    = relocation_model;
+  config.OptLevel      = optimization_options.opt_level;
+  config.CGOptLevel    = getCodeGenOptLevel();
+  config.DefaultTriple = target_triple;
+
+  config.MAttrs = llvm::SubtargetFeatures{target_cpu.features}.getFeatures();
+
+  // lto::Config has no size level, so the backends run -Os and -Oz as -O2
+  if (optimization_options.passes)
+    config.OptPipeline = *optimization_options.passes;
+
+  // The backends load the sample profile again after importing functions, as
+  // clang does
+  if (optimization_options.profile_sample_use)
+    config.SampleProfile = *optimization_options.profile_sample_use;
+
+  // The backend threads are created by LTO, so it enables the profiler on them
+  config.TimeTraceEnabled     = llvm::timeTraceProfilerEnabled();
+  config.TimeTraceGranularity = getTimeTraceGranularity();
+
+  llvm::lto::LTO lto{
+    std::move(config),
+    llvm::lto::createInProcessThinBackend(
+      llvm::heavyweight_hardware_concurrency(jobs))};
+
+  // Bitcode must outlive the LTO, since input files refer to it
+  std::vector<llvm::SmallVector<char, 0>> bitcodes;
+  bitcodes.reserve(results.size());
+
+  for (const auto& [context, module, file, imported_files] : results) {
+    // Write bitcode with the module summary used for the thin link
+    // The summary of calls is built with the profile summary, even if there is
+    // no profile
+    llvm::ProfileSummaryInfo psi{*module};
+
+    const auto index = llvm::buildModuleSummaryIndex(*module, nullptr, &psi);
+
+    auto& bitcode = bitcodes.emplace_back();
+
+    {
+      llvm::raw_svector_ostream os{bitcode};
+      llvm::WriteBitcodeToFile(*module, os, false, &index);
+    }
+
+    auto input = llvm::lto::InputFile::create(
+      llvm::MemoryBufferRef{llvm::StringRef{bitcode.data(), bitcode.size()},
+                            file.string()});
+
+    if (auto err = input.takeError()) {
+      throw CodegenError{formatError(
+        argv_front,
+        fmt::format("{}: {}", file.string(), llvm::toString(std::move(err))))};
+    }
+
+    std::vector<llvm::lto::SymbolResolution> resolutions;
+
+    for (const auto& symbol : (*input)->symbols()) {
+      llvm::lto::SymbolResolution resolution;
+
+      resolution.Prevailing                   = !symbol.isUndefined();
+      resolution.FinalDefinitionInLinkageUnit = !symbol.isUndefined();
+
+      // Only main and the functions with nomangle attribute can be referenced
+      // from outside the program
+      resolution.VisibleToRegularObj
+        = !symbol.getName().startswith(mangle::prefix);
+
+      resolutions.push_back(resolution);
+    }
+
+    if (auto err = lto.add(std::move(*input), resolutions)) {
+      throw CodegenError{formatError(
+        argv_front,
+        fmt::format("{}: {}", file.string(), llvm::toString(std::move(err))))};
+    }
+  }
+
+  // Objects are stored by task, since the backends run in parallel
+  FilePaths                               created_files(lto.getMaxTasks());
+  std::vector<llvm::SmallVector<char, 0>> buffers(lto.getMaxTasks());
+
+  const auto getObjectName = [](const unsigned int task) {
+    return fmt::format("thinlto.{}.o", task);
+  };
+
+  const auto add_stream = [&](const unsigned int task)
+    -> llvm::Expected<std::unique_ptr<llvm::CachedFileStream>> {
+    return std::make_unique<llvm::CachedFileStream>(
+      std::make_unique<llvm::raw_svector_ostream>(buffers[task]));
+  };
+
+  // With the cache, the objects of the modules whose backend inputs have not
+  // changed are reused
+  llvm::FileCache cache;
+
+  if (cache_dir) {
+    auto cache_expected = llvm::localCache(
+      "ThinLTO",
+      "Thin",
+      cache_dir->string(),
+      [&](const unsigned int task, std::unique_ptr<llvm::MemoryBuffer> mb) {
+        created_files[task]
+          = createMemoryFile(argv_front, getObjectName(task), mb->getBuffer());
+      });
+
+    if (auto err = cache_expected.takeError())
+      throw CodegenError{formatError(argv_front, llvm::toString(std::move(err)))};
+
+    cache = std::move(*cache_expected);
+  }
+
+  if (auto err = lto.run(add_stream, cache))
+    throw CodegenError{formatError(argv_front, llvm::toString(std::move(err)))};
+
+  for (unsigned int task = 0; task < buffers.size(); ++task) {
+    if (!buffers[task].empty()) {
+      created_files[task] = createMemoryFile(
+        argv_front,
+        getObjectName(task),
+        llvm::StringRef{buffers[task].data(), buffers[task].size()});
+    }
+  }
+
+  // Some tasks do not produce any object
+  std::erase_if(created_files, [](const auto& r) { return r.empty(); });
+
+  return created_files;
+}
+
+[[nodiscard]] llvm::CodeGenOpt::Level CodeGenerator::getCodeGenOptLevel() const
+{
+  switch (optimization_options.opt_level) {
+  case 0:
+    return llvm::CodeGenOpt::None;
+  case 1:
+    return llvm::CodeGenOpt::Less;
+  case 2:
+    return llvm::CodeGenOpt::Default;
+  case 3:
+    return llvm::CodeGenOpt::Aggressive;
+  default:
+    unreachable();
+  }
+}
+
+void CodeGenerator::linkModules()
+{
+  auto& [context, front_module, file, imported_files] = results.front();
+
+  // Each module has its own context, so move it to the context of the front
+  // module via bitcode before linking
+  for (auto it = results.begin() + 1, last = results.end(); it != last; ++it) {
+    auto module = moveToContext(*it->module, *context);
+
+    if (!module || llvm::Linker::linkModules(*front_module, std::move(module))) {
+      throw CodegenError{
+        formatError(argv_front,
+                    fmt::format("{}: Could not link", it->file.string()))};
+    }
+
+    imported_files.insert(imported_files.end(),
+                          it->imported_files.begin(),
+                          it->imported_files.end());
+  }
+
+  results.erase(results.begin() + 1, results.end());
+}
+
+[[nodiscard]] std::vector<FilePaths> CodeGenerator::getImportedFiles() const
+{
+  std::vector<FilePaths> imported_files;
+
+  for (const auto& r : results)
+    imported_files.push_back(r.imported_files);
+
+  return imported_files;
+}
+
+[[nodiscard]] CodeGenerator::Result
+CodeGenerator::generateModule(parse::Parser::Result& parse_result,
+                              const bool             jit) const
+{
+  auto context = std::make_unique<llvm::LLVMContext>();
+
+  const auto target_machine = createTargetMachine();
+
+  CGContext ctx{*context,
+                std::move(parse_result.positions),
+                std::move(parse_result.file),
+                parse_result.input,
+                optimization_options,
+                debug_info,
+                jit};
+
+  ctx.module->setTargetTriple(target_triple);
+  ctx.module->setDataLayout(target_machine->createDataLayout());
+
+  {
+    llvm::TimeTraceScope scope{"Codegen", ctx.current_file.string()};
+    codegen(parse_result.ast, ctx);
+  }
+
+  setTargetAttributes(*ctx.module);
+
+  if (stats::enabled()) {
+    for (const auto& func : *ctx.module) {
+      if (!func.isDeclaration())
+        stats::addFunction(func.size());
+    }
+  }
+
+  // In JIT mode, optimization is done by the JIT compiler's transform layer
+  if (!jit)
+    optimizeModule(*ctx.module, *target_machine);
+
+  return {std::move(context),
+          std::move(ctx.module),
+          std::move(ctx.current_file),
+          std::move(ctx.imported_files)};
+}
+
+void CodeGenerator::codegen(const ast::TranslationUnit& ast,
+                            CGContext&                  ctx) const
 {
   for (const auto& node : ast)
     createTopLevel(ctx, node);
 
+  for (const auto& clones : ctx.target_clones)
+    createTargetClones(*ctx.module, clones);
+
+  if (ctx.debug_info)
+    ctx.debug_info->finalize();
+
   {
     // Verify module
     std::string              str;
@@ -317,9 +780,43 @@ void CodeGenerator::codegen(const ast::TranslationUnit& ast, CGContext& ctx)
   }
 }
 
+void CodeGenerator::setTargetAttributes(llvm::Module& module) const
+{
+  for (auto& func : module) {
+    if (func.isDeclaration())
+      continue;
+
+    func.addFnAttr("target-cpu", target_cpu.cpu);
+
+    // The clones of target_clones have their own features, which are enabled
+    // on top of the features of the target CPU
+    auto features = target_cpu.features;
+
+    if (const auto attr = func.getFnAttribute("target-features");
+        attr.isValid()) {
+      features += (features.empty() ? "" : ",") + attr.getValueAsString().str();
+    }
+
+    if (!features.empty())
+      func.addFnAttr("target-features", features);
+  }
+}
+
+void CodeGenerator::optimizeModule(llvm::Module&        module,
+                                   llvm::TargetMachine& target_machine) const
+{
+  llvm::TimeTraceScope scope{"Optimize", module.getName()};
+
+  if (auto err = codegen::optimizeModule(module,
+                                         &target_machine,
+                                         optimization_options)) {
+    throw CodegenError{formatError(argv_front, llvm::toString(std::move(err)))};
+  }
+}
+
 [[nodiscard]] FilePaths
 CodeGenerator::emitFiles(const llvm::CodeGenFileType cgft,
-                         const bool                  create_as_tmpfile)
+                         const bool                  in_memory)
 {
   static const std::unordered_map<llvm::CodeGenFileType, std::string>
     extension_map = {
@@ -327,45 +824,147 @@ CodeGenerator::emitFiles(const llvm::CodeGenFileType cgft,
       {  llvm::CodeGenFileType::CGFT_ObjectFile, "o"}
   };
 
-  FilePaths created_files;
+  const auto createOutputFilepath
+    = [&](const std::filesystem::path& file,
+          const std::string&           suffix) -> std::filesystem::path {
+    return output_dir
+           / (file.stem().string() + suffix + "." + extension_map.at(cgft));
+  };
+
+  // Returns the path of the created file
+  const auto emit = [&](llvm::Module&                module,
+                        const std::filesystem::path& file,
+                        const std::filesystem::path& output_file) {
+    if (in_memory)
+      return emitMemoryFile(module, output_file.string(), cgft);
 
-  for (auto it = results.begin(), last = results.end(); it != last; ++it) {
-    const auto& file = std::get<std::filesystem::path>(*it);
+    emitFile(module, file, output_file, cgft);
+    return output_file;
+  };
 
-    const auto output_file
-      = (create_as_tmpfile ? createTemporaryFilepath() : file.stem().string())
-        + "." + extension_map.at(cgft);
+  if (codegen_partitions == 1) {
+    FilePaths created_files(results.size());
 
-    created_files.push_back(output_file);
+    // Each module has its own context, so they can be emitted in parallel
+    parallelFor(jobs, results.size(), [&](const std::size_t idx) {
+      const auto& [context, module, file, imported_files] = results[idx];
 
-    std::error_code      ostream_ec;
-    llvm::raw_fd_ostream ostream{output_file,
-                                 ostream_ec,
-                                 llvm::sys::fs::OpenFlags::OF_None};
+      created_files[idx] = emit(*module, file, createOutputFilepath(file, ""));
+    });
 
-    if (ostream_ec) {
+    return created_files;
+  }
+
+  // Split each module into partitions and emit each partition to its own
+  // file, so that even a single large module can use several threads
+  // Since the partitions share the context of the original module, they are
+  // serialized and then read into the context of each job
+  struct Partition {
+    llvm::SmallVector<char, 0> bitcode;
+    std::filesystem::path      file;
+  };
+
+  std::vector<Partition> partitions;
+  FilePaths              created_files;
+
+  for (const auto& [context, module, file, imported_files] : results) {
+    unsigned int partition_idx = 0;
+
+    // Local symbols are kept in the partitions of their users rather than
+    // externalized, since the names of string literals, outlined loop bodies
+    // and others are not unique among the modules linked together
+    llvm::SplitModule(
+      *module,
+      codegen_partitions,
+      [&, &file = file](std::unique_ptr<llvm::Module> part) {
+        partitions.push_back({writeBitcode(*part), file});
+
+        created_files.push_back(
+          createOutputFilepath(file, fmt::format(".{}", partition_idx++)));
+      },
+      /* PreserveLocals */ true);
+  }
+
+  parallelFor(jobs, partitions.size(), [&](const std::size_t idx) {
+    const auto& [bitcode, file] = partitions[idx];
+
+    llvm::LLVMContext context;
+
+    const auto module = readBitcode(bitcode, file.string(), context);
+
+    if (!module) {
       throw CodegenError{formatError(
         argv_front,
-        fmt::format("{}: {}\n", file.string(), ostream_ec.message()))};
+        fmt::format("{}: failed to split the module", file.string()))};
     }
 
-    llvm::legacy::PassManager p_manager;
+    created_files[idx] = emit(*module, file, created_files[idx]);
+  });
 
-    if (target_machine->addPassesToEmitFile(p_manager,
-                                            ostream,
-                                            nullptr,
-                                            cgft)) {
-      throw CodegenError{formatError(argv_front, "failed to emit a file")};
-    }
+  return created_files;
+}
 
-    p_manager.run(*std::get<std::unique_ptr<llvm::Module>>(*it));
-    ostream.flush();
+void CodeGenerator::emitFile(llvm::Module&                module,
+                             const std::filesystem::path& file,
+                             const std::filesystem::path& output_file,
+                             const llvm::CodeGenFileType  cgft) const
+{
+  llvm::TimeTraceScope scope{"Emit", output_file.string()};
+
+  std::error_code      ostream_ec;
+  llvm::raw_fd_ostream ostream{output_file.string(),
+                               ostream_ec,
+                               llvm::sys::fs::OpenFlags::OF_None};
+
+  if (ostream_ec) {
+    throw CodegenError{formatError(
+      argv_front,
+      fmt::format("{}: {}\n", file.string(), ostream_ec.message()))};
   }
 
-  return created_files;
+  emitFile(module, ostream, cgft);
 }
 
-void CodeGenerator::initTargetTripleAndMachine(
+[[nodiscard]] std::filesystem::path
+CodeGenerator::emitMemoryFile(llvm::Module&               module,
+                              const std::string&          name,
+                              const llvm::CodeGenFileType cgft) const
+{
+  llvm::TimeTraceScope scope{"Emit", name};
+
+  llvm::SmallVector<char, 0> buffer;
+
+  {
+    llvm::raw_svector_ostream ostream{buffer};
+    emitFile(module, ostream, cgft);
+  }
+
+  return createMemoryFile(argv_front,
+                          name,
+                          llvm::StringRef{buffer.data(), buffer.size()});
+}
+
+void CodeGenerator::emitFile(llvm::Module&               module,
+                             llvm::raw_pwrite_stream&    ostream,
+                             const llvm::CodeGenFileType cgft) const
+{
+  // TargetMachine is not thread-safe, so each job uses its own
+  const auto target_machine = createTargetMachine();
+
+  llvm::legacy::PassManager p_manager;
+
+  if (target_machine->addPassesToEmitFile(p_manager,
+                                          ostream,
+                                          nullptr,
+                                          cgft)) {
+    throw CodegenError{formatError(argv_front, "failed to emit a file")};
+  }
+
+  p_manager.run(module);
+  ostream.flush();
+}
+
+void CodeGenerator::initTarget(
   const std::optional<std::string>& target_triple_arg)
 {
   // Set target triple and data layout to module
@@ -373,7 +972,7 @@ void CodeGenerator::initTargetTripleAndMachine(
                                     : llvm::sys::getDefaultTargetTriple();
 
   std::string target_triple_error;
-  auto const  target
+  target
     = llvm::TargetRegistry::lookupTarget(target_triple, target_triple_error);
 
   if (!target) {
@@ -382,16 +981,39 @@ void CodeGenerator::initTargetTripleAndMachine(
                                                target_triple,
                                                target_triple_error))};
   }
+}
+
+void CodeGenerator::verifyTargetCPU() const
+{
+  assert(target);
+
+  const auto subtarget_info = std::unique_ptr<llvm::MCSubtargetInfo>{
+    target->createMCSubtargetInfo(target_triple, "", "")};
+
+  if (subtarget_info && target_cpu.cpu != "generic"
+      && !subtarget_info->isCPUStringValid(target_cpu.cpu)) {
+    throw CodegenError{
+      formatError(argv_front,
+                  fmt::format("unknown CPU '{}' for target {}",
+                              target_cpu.cpu,
+                              target_triple))};
+  }
+}
+
+[[nodiscard]] std::unique_ptr<llvm::TargetMachine>
+CodeGenerator::createTargetMachine() const
+{
+  assert(target);
 
   llvm::TargetOptions target_options;
 
-  target_machine
-    = target->createTargetMachine(target_triple,
-                                  "generic",
-                                  "",
-                                  target_options,
-                                  llvm::Optional<llvm::Reloc::Model>(
-                                    relocation_model)); // Set relocation model.
+  return std::unique_ptr<llvm::TargetMachine>{
+    target->createTargetMachine(target_triple,
+                                target_cpu.cpu,
+                                target_cpu.features,
+                                target_options,
+                                llvm::Optional<llvm::Reloc::Model>(
+                                  relocation_model))}; // Set relocation model.
 }
 
 } // namespace twinkle::codegen
@@ -65,6 +65,54 @@ findClassTemplate(CGContext&                    ctx,
     .CreateAlloca(type, nullptr, name);
 }
 
+[[nodiscard]] llvm::AllocaInst* getTaskGroup(CGContext&            ctx,
+                                             llvm::Function* const func)
+{
+  auto& group = ctx.task_groups[func];
+
+  if (!group) {
+    auto const type = ctx.builder.getInt8PtrTy();
+
+    group = createEntryAlloca(func, "task_group", type);
+
+    // Initialized before any spawn, since spawns may be in loops
+    llvm::IRBuilder<>{group->getParent(), std::next(group->getIterator())}
+      .CreateStore(llvm::ConstantPointerNull::get(type), group);
+  }
+
+  return group;
+}
+
+void createTaskGroupExit(CGContext& ctx, llvm::Function* const func)
+{
+  const auto it = ctx.task_groups.find(func);
+
+  if (it == ctx.task_groups.end())
+    return;
+
+  ctx.builder.CreateCall(
+    ctx.module->getOrInsertFunction("__twinkle_task_group_exit",
+                                    ctx.builder.getVoidTy(),
+                                    it->second->getType()),
+    {it->second});
+
+  ctx.task_groups.erase(it);
+}
+
+void createTaskGroupSync(CGContext& ctx, llvm::Function* const func)
+{
+  const auto it = ctx.task_groups.find(func);
+
+  if (it == ctx.task_groups.end())
+    return;
+
+  ctx.builder.CreateCall(
+    ctx.module->getOrInsertFunction("__twinkle_sync",
+                                    ctx.builder.getVoidTy(),
+                                    it->second->getType()),
+    {it->second});
+}
+
 [[nodiscard]] llvm::Type* getFloatNTy(CGContext& ctx, const int mantissa_width)
 {
   assert(mantissa_width == 32 || mantissa_width == 64);
@@ -97,9 +145,29 @@ resultIntegerTypeOf(CGContext&                   ctx,
   return lhs_t;
 }
 
+// Including vectors of floating point numbers
+[[nodiscard]] static bool isFPOrFPVector(const Value& value)
+{
+  return value.getLLVMType()->isFPOrFPVectorTy();
+}
+
+[[nodiscard]] std::shared_ptr<Type> boolTypeOf(CGContext&   ctx,
+                                               const Value& operand)
+{
+  auto bool_type = std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false);
+
+  if (operand.getType()->isVectorTy(ctx)) {
+    return std::make_shared<VectorType>(std::move(bool_type),
+                                        operand.getType()->getVectorSize(ctx),
+                                        false);
+  }
+
+  return bool_type;
+}
+
 [[nodiscard]] Value createAddInverse(CGContext& ctx, const Value& value)
 {
-  if (value.getValue()->getType()->isFloatingPointTy()) {
+  if (isFPOrFPVector(value)) {
     return {ctx.builder.CreateFSub(
               llvm::ConstantFP::getZeroValueForNegation(value.getLLVMType()),
               value.getValue()),
@@ -114,7 +182,7 @@ resultIntegerTypeOf(CGContext&                   ctx,
 [[nodiscard]] Value
 createAdd(CGContext& ctx, const Value& lhs, const Value& rhs)
 {
-  if (lhs.getType()->isFloatingPointTy(ctx)) {
+  if (isFPOrFPVector(lhs)) {
     return {ctx.builder.CreateFAdd(lhs.getValue(), rhs.getValue()),
             lhs.getType()};
   }
@@ -135,7 +203,7 @@ createAdd(CGContext& ctx, const Value& lhs, const Value& rhs)
 [[nodiscard]] Value
 createSub(CGContext& ctx, const Value& lhs, const Value& rhs)
 {
-  if (lhs.getType()->isFloatingPointTy(ctx)) {
+  if (isFPOrFPVector(lhs)) {
     return {ctx.builder.CreateFSub(lhs.getValue(), rhs.getValue()),
             lhs.getType()};
   }
@@ -156,7 +224,7 @@ createSub(CGContext& ctx, const Value& lhs, const Value& rhs)
 [[nodiscard]] Value
 createMul(CGContext& ctx, const Value& lhs, const Value& rhs)
 {
-  if (lhs.getType()->isFloatingPointTy(ctx)) {
+  if (isFPOrFPVector(lhs)) {
     return {ctx.builder.CreateFMul(lhs.getValue(), rhs.getValue()),
             lhs.getType()};
   }
@@ -168,7 +236,7 @@ createMul(CGContext& ctx, const Value& lhs, const Value& rhs)
 [[nodiscard]] Value
 createDiv(CGContext& ctx, const Value& lhs, const Value& rhs)
 {
-  if (lhs.getType()->isFloatingPointTy(ctx)) {
+  if (isFPOrFPVector(lhs)) {
     return {ctx.builder.CreateFDiv(lhs.getValue(), rhs.getValue()),
             lhs.getType()};
   }
@@ -189,7 +257,7 @@ createDiv(CGContext& ctx, const Value& lhs, const Value& rhs)
 [[nodiscard]] Value
 createMod(CGContext& ctx, const Value& lhs, const Value& rhs)
 {
-  if (lhs.getType()->isFloatingPointTy(ctx)) {
+  if (isFPOrFPVector(lhs)) {
     return {ctx.builder.CreateFRem(lhs.getValue(), rhs.getValue()),
             lhs.getType()};
   }
@@ -210,43 +278,43 @@ createMod(CGContext& ctx, const Value& lhs, const Value& rhs)
 [[nodiscard]] Value
 createEqual(CGContext& ctx, const Value& lhs, const Value& rhs)
 {
-  if (lhs.getType()->isFloatingPointTy(ctx)) {
+  if (isFPOrFPVector(lhs)) {
     return {ctx.builder.CreateFCmp(llvm::CmpInst::Predicate::FCMP_UEQ,
                                    lhs.getValue(),
                                    rhs.getValue()),
-            std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false)};
+            boolTypeOf(ctx, lhs)};
   }
 
   return {ctx.builder.CreateICmp(llvm::ICmpInst::ICMP_EQ,
                                  lhs.getValue(),
                                  rhs.getValue()),
-          std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false)};
+          boolTypeOf(ctx, lhs)};
 }
 
 [[nodiscard]] Value
 createNotEqual(CGContext& ctx, const Value& lhs, const Value& rhs)
 {
-  if (lhs.getType()->isFloatingPointTy(ctx)) {
+  if (isFPOrFPVector(lhs)) {
     return {ctx.builder.CreateFCmp(llvm::CmpInst::Predicate::FCMP_UNE,
                                    lhs.getValue(),
                                    rhs.getValue()),
-            std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false)};
+            boolTypeOf(ctx, lhs)};
   }
 
   return {ctx.builder.CreateICmp(llvm::ICmpInst::ICMP_NE,
                                  lhs.getValue(),
                                  rhs.getValue()),
-          std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false)};
+          boolTypeOf(ctx, lhs)};
 }
 
 [[nodiscard]] Value
 createLessThan(CGContext& ctx, const Value& lhs, const Value& rhs)
 {
-  if (lhs.getType()->isFloatingPointTy(ctx)) {
+  if (isFPOrFPVector(lhs)) {
     return {ctx.builder.CreateFCmp(llvm::ICmpInst::FCMP_ULT,
                                    lhs.getValue(),
                                    rhs.getValue()),
-            std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false)};
+            boolTypeOf(ctx, lhs)};
   }
 
   return {ctx.builder.CreateICmp(isSigned(logicalOrSign(ctx, lhs, rhs))
@@ -254,17 +322,17 @@ createLessThan(CGContext& ctx, const Value& lhs, const Value& rhs)
                                    : llvm::ICmpInst::ICMP_ULT,
                                  lhs.getValue(),
                                  rhs.getValue()),
-          std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false)};
+          boolTypeOf(ctx, lhs)};
 }
 
 [[nodiscard]] Value
 createGreaterThan(CGContext& ctx, const Value& lhs, const Value& rhs)
 {
-  if (lhs.getType()->isFloatingPointTy(ctx)) {
+  if (isFPOrFPVector(lhs)) {
     return {ctx.builder.CreateFCmp(llvm::ICmpInst::FCMP_UGT,
                                    lhs.getValue(),
                                    rhs.getValue()),
-            std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false)};
+            boolTypeOf(ctx, lhs)};
   }
 
   return {ctx.builder.CreateICmp(isSigned(logicalOrSign(ctx, lhs, rhs))
@@ -272,17 +340,17 @@ createGreaterThan(CGContext& ctx, const Value& lhs, const Value& rhs)
                                    : llvm::ICmpInst::ICMP_UGT,
                                  lhs.getValue(),
                                  rhs.getValue()),
-          std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false)};
+          boolTypeOf(ctx, lhs)};
 }
 
 [[nodiscard]] Value
 createLessOrEqual(CGContext& ctx, const Value& lhs, const Value& rhs)
 {
-  if (lhs.getType()->isFloatingPointTy(ctx)) {
+  if (isFPOrFPVector(lhs)) {
     return {ctx.builder.CreateFCmp(llvm::ICmpInst::FCMP_ULE,
                                    lhs.getValue(),
                                    rhs.getValue()),
-            std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false)};
+            boolTypeOf(ctx, lhs)};
   }
 
   return {ctx.builder.CreateICmp(isSigned(logicalOrSign(ctx, lhs, rhs))
@@ -290,17 +358,17 @@ createLessOrEqual(CGContext& ctx, const Value& lhs, const Value& rhs)
                                    : llvm::ICmpInst::ICMP_ULE,
                                  lhs.getValue(),
                                  rhs.getValue()),
-          std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false)};
+          boolTypeOf(ctx, lhs)};
 }
 
 [[nodiscard]] Value
 createGreaterOrEqual(CGContext& ctx, const Value& lhs, const Value& rhs)
 {
-  if (lhs.getType()->isFloatingPointTy(ctx)) {
+  if (isFPOrFPVector(lhs)) {
     return {ctx.builder.CreateFCmp(llvm::ICmpInst::FCMP_UGE,
                                    lhs.getValue(),
                                    rhs.getValue()),
-            std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false)};
+            boolTypeOf(ctx, lhs)};
   }
 
   return {ctx.builder.CreateICmp(isSigned(logicalOrSign(ctx, lhs, rhs))
@@ -308,21 +376,21 @@ createGreaterOrEqual(CGContext& ctx, const Value& lhs, const Value& rhs)
                                    : llvm::ICmpInst::ICMP_UGE,
                                  lhs.getValue(),
                                  rhs.getValue()),
-          std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false)};
+          boolTypeOf(ctx, lhs)};
 }
 
 [[nodiscard]] Value
 createLogicalAnd(CGContext& ctx, const Value& lhs, const Value& rhs)
 {
   return {ctx.builder.CreateLogicalAnd(lhs.getValue(), rhs.getValue()),
-          std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false)};
+          boolTypeOf(ctx, lhs)};
 }
 
 [[nodiscard]] Value
 createLogicalOr(CGContext& ctx, const Value& lhs, const Value& rhs)
 {
   return {ctx.builder.CreateLogicalOr(lhs.getValue(), rhs.getValue()),
-          std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false)};
+          boolTypeOf(ctx, lhs)};
 }
 
 [[nodiscard]] Value
@@ -0,0 +1,439 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#include <twinkle/codegen/coroutine.hpp>
+#include <twinkle/codegen/common.hpp>
+
+namespace twinkle::codegen
+{
+
+// Indices of the fields of promises
+enum class PromiseField : std::uint32_t {
+  waiter,
+  detached,
+  result,
+};
+
+// The promise of a future is found from its type, since the promise is
+// reached through the handle of the coroutine
+[[nodiscard]] static llvm::StructType*
+getPromiseType(CGContext& ctx, const std::shared_ptr<Type>& result_type)
+{
+  std::vector<llvm::Type*> fields{ctx.builder.getInt8PtrTy(),
+                                  ctx.builder.getInt1Ty()};
+
+  if (!result_type->isVoidTy(ctx))
+    fields.push_back(result_type->getLLVMType(ctx));
+
+  return llvm::StructType::get(ctx.context, fields);
+}
+
+// The alignment of the promise must be the same in the coroutine and in
+// those who reach it through the handle
+[[nodiscard]] static llvm::Align
+getPromiseAlign(CGContext& ctx, llvm::StructType* const promise_type)
+{
+  return ctx.module->getDataLayout().getABITypeAlign(promise_type);
+}
+
+[[nodiscard]] static llvm::Value*
+createPromiseFieldGEP(CGContext&              ctx,
+                      llvm::StructType* const promise_type,
+                      llvm::Value* const      promise,
+                      const PromiseField      field)
+{
+  return ctx.builder.CreateStructGEP(promise_type,
+                                     promise,
+                                     static_cast<std::uint32_t>(field));
+}
+
+[[nodiscard]] static llvm::Value* createFrameSize(CGContext& ctx)
+{
+  return ctx.builder.CreateIntrinsic(llvm::Intrinsic::coro_size,
+                                     {ctx.builder.getInt64Ty()},
+                                     {});
+}
+
+// Returns the promise of the coroutine of the future
+[[nodiscard]] static llvm::Value*
+createPromiseOf(CGContext&                   ctx,
+                llvm::Value* const           handle,
+                const std::shared_ptr<Type>& result_type)
+{
+  auto const promise_type = getPromiseType(ctx, result_type);
+
+  auto const promise = ctx.builder.CreateIntrinsic(
+    llvm::Intrinsic::coro_promise,
+    {},
+    {handle,
+     ctx.builder.getInt32(getPromiseAlign(ctx, promise_type).value()),
+     ctx.builder.getFalse()});
+
+  return ctx.builder.CreatePointerCast(promise, promise_type->getPointerTo());
+}
+
+void beginCoroutine(CGContext&                   ctx,
+                    llvm::Function* const        func,
+                    const std::shared_ptr<Type>& result_type)
+{
+  // The coroutine passes of LLVM 14 split only the functions with this
+  func->addFnAttr("coroutine.presplit", "0");
+
+  auto const i8_ptr = ctx.builder.getInt8PtrTy();
+
+  auto const promise_type = getPromiseType(ctx, result_type);
+
+  auto const promise = createEntryAlloca(func, "promise", promise_type);
+  promise->setAlignment(getPromiseAlign(ctx, promise_type));
+
+  auto const id = ctx.builder.CreateIntrinsic(
+    llvm::Intrinsic::coro_id,
+    {},
+    {ctx.builder.getInt32(0),
+     ctx.builder.CreatePointerCast(promise, i8_ptr),
+     llvm::ConstantPointerNull::get(i8_ptr),
+     llvm::ConstantPointerNull::get(i8_ptr)});
+
+  // If the coroutine is elided, the frame is an alloca of the caller
+  auto const entry_bb = ctx.builder.GetInsertBlock();
+  auto const alloc_bb = llvm::BasicBlock::Create(ctx.context, "", func);
+  auto const begin_bb = llvm::BasicBlock::Create(ctx.context, "", func);
+
+  ctx.builder.CreateCondBr(
+    ctx.builder.CreateIntrinsic(llvm::Intrinsic::coro_alloc, {}, {id}),
+    alloc_bb,
+    begin_bb);
+
+  ctx.builder.SetInsertPoint(alloc_bb);
+
+  auto const frame_alloc
+    = ctx.module->getOrInsertFunction("__twinkle_async_frame_alloc",
+                                      i8_ptr,
+                                      ctx.builder.getInt64Ty());
+
+  auto const frame
+    = ctx.builder.CreateCall(frame_alloc, {createFrameSize(ctx)});
+
+  ctx.builder.CreateBr(begin_bb);
+
+  ctx.builder.SetInsertPoint(begin_bb);
+
+  auto const phi = ctx.builder.CreatePHI(i8_ptr, 2);
+  phi->addIncoming(llvm::ConstantPointerNull::get(i8_ptr), entry_bb);
+  phi->addIncoming(frame, alloc_bb);
+
+  auto const handle
+    = ctx.builder.CreateIntrinsic(llvm::Intrinsic::coro_begin, {}, {id, phi});
+
+  ctx.builder.CreateStore(
+    llvm::ConstantPointerNull::get(i8_ptr),
+    createPromiseFieldGEP(ctx, promise_type, promise, PromiseField::waiter));
+
+  ctx.builder.CreateStore(
+    ctx.builder.getFalse(),
+    createPromiseFieldGEP(ctx, promise_type, promise, PromiseField::detached));
+
+  ctx.coroutines.insert_or_assign(
+    func,
+    Coroutine{id,
+              handle,
+              promise,
+              llvm::BasicBlock::Create(ctx.context, "coro.cleanup"),
+              llvm::BasicBlock::Create(ctx.context, "coro.suspend")});
+}
+
+void endCoroutine(CGContext&            ctx,
+                  llvm::Function* const func,
+                  llvm::Value* const    result)
+{
+  const auto it = ctx.coroutines.find(func);
+
+  assert(it != ctx.coroutines.end());
+
+  const auto coroutine = it->second;
+
+  ctx.coroutines.erase(it);
+
+  auto const promise_type
+    = llvm::cast<llvm::StructType>(coroutine.promise->getAllocatedType());
+
+  if (result) {
+    ctx.builder.CreateStore(result,
+                            createPromiseFieldGEP(ctx,
+                                                  promise_type,
+                                                  coroutine.promise,
+                                                  PromiseField::result));
+  }
+
+  auto const final_bb         = llvm::BasicBlock::Create(ctx.context, "", func);
+  auto const schedule_bb      = llvm::BasicBlock::Create(ctx.context, "", func);
+  auto const final_suspend_bb = llvm::BasicBlock::Create(ctx.context, "", func);
+
+  // Nobody takes the result of a detached coroutine
+  ctx.builder.CreateCondBr(
+    ctx.builder.CreateLoad(
+      ctx.builder.getInt1Ty(),
+      createPromiseFieldGEP(ctx,
+                            promise_type,
+                            coroutine.promise,
+                            PromiseField::detached)),
+    coroutine.cleanup_bb,
+    final_bb);
+
+  ctx.builder.SetInsertPoint(final_bb);
+
+  auto const i8_ptr = ctx.builder.getInt8PtrTy();
+
+  auto const waiter = ctx.builder.CreateLoad(
+    i8_ptr,
+    createPromiseFieldGEP(ctx,
+                          promise_type,
+                          coroutine.promise,
+                          PromiseField::waiter));
+
+  ctx.builder.CreateCondBr(ctx.builder.CreateIsNotNull(waiter),
+                           schedule_bb,
+                           final_suspend_bb);
+
+  ctx.builder.SetInsertPoint(schedule_bb);
+
+  ctx.builder.CreateCall(
+    ctx.module->getOrInsertFunction("__twinkle_async_schedule",
+                                    ctx.builder.getVoidTy(),
+                                    i8_ptr),
+    {waiter});
+
+  ctx.builder.CreateBr(final_suspend_bb);
+
+  // Final suspend point, which is resumed only to be destroyed
+  ctx.builder.SetInsertPoint(final_suspend_bb);
+
+  auto const suspend = ctx.builder.CreateSwitch(
+    ctx.builder.CreateIntrinsic(llvm::Intrinsic::coro_suspend,
+                                {},
+                                {llvm::ConstantTokenNone::get(ctx.context),
+                                 ctx.builder.getTrue()}),
+    coroutine.suspend_bb,
+    1);
+
+  suspend->addCase(ctx.builder.getInt8(1), coroutine.cleanup_bb);
+
+  // Cleanup
+  func->getBasicBlockList().push_back(coroutine.cleanup_bb);
+  ctx.builder.SetInsertPoint(coroutine.cleanup_bb);
+
+  auto const free_bb = llvm::BasicBlock::Create(ctx.context, "", func);
+
+  // Null if the frame is elided
+  auto const frame
+    = ctx.builder.CreateIntrinsic(llvm::Intrinsic::coro_free,
+                                  {},
+                                  {coroutine.id, coroutine.handle});
+
+  ctx.builder.CreateCondBr(ctx.builder.CreateIsNotNull(frame),
+                           free_bb,
+                           coroutine.suspend_bb);
+
+  ctx.builder.SetInsertPoint(free_bb);
+
+  ctx.builder.CreateCall(
+    ctx.module->getOrInsertFunction("__twinkle_async_frame_free",
+                                    ctx.builder.getVoidTy(),
+                                    i8_ptr,
+                                    ctx.builder.getInt64Ty()),
+    {frame, createFrameSize(ctx)});
+
+  ctx.builder.CreateBr(coroutine.suspend_bb);
+
+  // Return to the caller or resumer
+  func->getBasicBlockList().push_back(coroutine.suspend_bb);
+  ctx.builder.SetInsertPoint(coroutine.suspend_bb);
+
+  ctx.builder.CreateIntrinsic(llvm::Intrinsic::coro_end,
+                              {},
+                              {coroutine.handle, ctx.builder.getFalse()});
+
+  ctx.builder.CreateRet(coroutine.handle);
+}
+
+[[nodiscard]] const Coroutine* findCoroutine(CGContext&            ctx,
+                                             llvm::Function* const func)
+{
+  const auto it = ctx.coroutines.find(func);
+
+  return it == ctx.coroutines.end() ? nullptr : &it->second;
+}
+
+void createSuspend(CGContext& ctx, const Coroutine& coroutine)
+{
+  auto const func = ctx.builder.GetInsertBlock()->getParent();
+
+  auto const resume_bb = llvm::BasicBlock::Create(ctx.context, "", func);
+
+  auto const suspend = ctx.builder.CreateSwitch(
+    ctx.builder.CreateIntrinsic(llvm::Intrinsic::coro_suspend,
+                                {},
+                                {llvm::ConstantTokenNone::get(ctx.context),
+                                 ctx.builder.getFalse()}),
+    coroutine.suspend_bb,
+    2);
+
+  suspend->addCase(ctx.builder.getInt8(0), resume_bb);
+  suspend->addCase(ctx.builder.getInt8(1), coroutine.cleanup_bb);
+
+  ctx.builder.SetInsertPoint(resume_bb);
+}
+
+void verifyFutureMove(CGContext&           ctx,
+                      const ast::Expr&     node,
+                      const Value&         value,
+                      const PositionRange& pos)
+{
+  if (!value.getType()->isFutureTy(ctx))
+    return;
+
+  if (boost::get<ast::FunctionCall>(&node)
+      || boost::get<ast::FunctionTemplateCall>(&node))
+    return;
+
+  throw CodegenError{ctx.formatError(
+    pos,
+    "futures cannot be copied, and must be awaited where they are held")};
+}
+
+// Awaiting a future again would destroy its coroutine twice
+static void createAwaitedCheck(CGContext& ctx, llvm::Value* const handle)
+{
+  auto const func = ctx.builder.GetInsertBlock()->getParent();
+
+  auto const trap_bb = llvm::BasicBlock::Create(ctx.context, "", func);
+  auto const next_bb = llvm::BasicBlock::Create(ctx.context, "", func);
+
+  ctx.builder.CreateCondBr(ctx.builder.CreateIsNull(handle), trap_bb, next_bb);
+
+  ctx.builder.SetInsertPoint(trap_bb);
+  ctx.builder.CreateIntrinsic(llvm::Intrinsic::trap, {}, {});
+  ctx.builder.CreateUnreachable();
+
+  ctx.builder.SetInsertPoint(next_bb);
+}
+
+[[nodiscard]] Value createAwait(CGContext& ctx, const Value& future)
+{
+  const auto result_type = future.getType()->getFutureResultType(ctx);
+
+  auto const handle = future.getValue();
+
+  createAwaitedCheck(ctx, handle);
+
+  auto const func = ctx.builder.GetInsertBlock()->getParent();
+
+  if (const auto coroutine = findCoroutine(ctx, func)) {
+    auto const wait_bb  = llvm::BasicBlock::Create(ctx.context, "", func);
+    auto const ready_bb = llvm::BasicBlock::Create(ctx.context, "");
+
+    ctx.builder.CreateCondBr(
+      ctx.builder.CreateIntrinsic(llvm::Intrinsic::coro_done, {}, {handle}),
+      ready_bb,
+      wait_bb);
+
+    // The future schedules this coroutine when it completes
+    ctx.builder.SetInsertPoint(wait_bb);
+
+    ctx.builder.CreateStore(
+      coroutine->handle,
+      createPromiseFieldGEP(ctx,
+                            getPromiseType(ctx, result_type),
+                            createPromiseOf(ctx, handle, result_type),
+                            PromiseField::waiter));
+
+    createSuspend(ctx, *coroutine);
+
+    ctx.builder.CreateBr(ready_bb);
+
+    func->getBasicBlockList().push_back(ready_bb);
+    ctx.builder.SetInsertPoint(ready_bb);
+  }
+  else {
+    ctx.builder.CreateCall(
+      ctx.module->getOrInsertFunction("__twinkle_async_block_on",
+                                      ctx.builder.getVoidTy(),
+                                      ctx.builder.getInt8PtrTy()),
+      {handle});
+  }
+
+  llvm::Value* result = nullptr;
+
+  if (!result_type->isVoidTy(ctx)) {
+    result = ctx.builder.CreateLoad(
+      result_type->getLLVMType(ctx),
+      createPromiseFieldGEP(ctx,
+                            getPromiseType(ctx, result_type),
+                            createPromiseOf(ctx, handle, result_type),
+                            PromiseField::result));
+  }
+
+  ctx.builder.CreateIntrinsic(llvm::Intrinsic::coro_destroy, {}, {handle});
+
+  return {result, result_type};
+}
+
+void createDetach(CGContext& ctx, const Value& future)
+{
+  const auto result_type = future.getType()->getFutureResultType(ctx);
+
+  auto const handle = future.getValue();
+
+  auto const func = ctx.builder.GetInsertBlock()->getParent();
+
+  auto const destroy_bb = llvm::BasicBlock::Create(ctx.context, "", func);
+  auto const detach_bb  = llvm::BasicBlock::Create(ctx.context, "", func);
+  auto const end_bb     = llvm::BasicBlock::Create(ctx.context, "", func);
+
+  ctx.builder.CreateCondBr(
+    ctx.builder.CreateIntrinsic(llvm::Intrinsic::coro_done, {}, {handle}),
+    destroy_bb,
+    detach_bb);
+
+  ctx.builder.SetInsertPoint(destroy_bb);
+  ctx.builder.CreateIntrinsic(llvm::Intrinsic::coro_destroy, {}, {handle});
+  ctx.builder.CreateBr(end_bb);
+
+  ctx.builder.SetInsertPoint(detach_bb);
+
+  ctx.builder.CreateStore(
+    ctx.builder.getTrue(),
+    createPromiseFieldGEP(ctx,
+                          getPromiseType(ctx, result_type),
+                          createPromiseOf(ctx, handle, result_type),
+                          PromiseField::detached));
+
+  ctx.builder.CreateBr(end_bb);
+
+  ctx.builder.SetInsertPoint(end_bb);
+}
+
+void createDetachUnlessAwaited(CGContext& ctx, const Value& future)
+{
+  auto const func = ctx.builder.GetInsertBlock()->getParent();
+
+  auto const detach_bb = llvm::BasicBlock::Create(ctx.context, "", func);
+  auto const end_bb    = llvm::BasicBlock::Create(ctx.context, "");
+
+  ctx.builder.CreateCondBr(ctx.builder.CreateIsNull(future.getValue()),
+                           end_bb,
+                           detach_bb);
+
+  ctx.builder.SetInsertPoint(detach_bb);
+  createDetach(ctx, future);
+  ctx.builder.CreateBr(end_bb);
+
+  func->getBasicBlockList().push_back(end_bb);
+  ctx.builder.SetInsertPoint(end_bb);
+}
+
+} // namespace twinkle::codegen
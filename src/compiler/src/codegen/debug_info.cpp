@@ -0,0 +1,128 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#include <twinkle/codegen/debug_info.hpp>
+#include <twinkle/support/utils.hpp>
+
+namespace twinkle::codegen
+{
+
+DebugInfo::DebugInfo(llvm::Module&                module,
+                     const std::filesystem::path& file,
+                     const std::string&           source,
+                     const bool                   optimized)
+  : builder{module}
+  , file{builder.createFile(file.filename().string(),
+                            file.parent_path().string())}
+  , compile_unit{builder.createCompileUnit(
+      llvm::dwarf::DW_LANG_C,
+      this->file,
+      fmt::format("twinkle version {}", getVersion()),
+      optimized,
+      "",
+      0,
+      "",
+      llvm::DICompileUnit::LineTablesOnly,
+      0,
+      true,
+      // Linkage names are emitted even in line tables, so that profiles
+      // converted from samples refer to the mangled names
+      /* DebugInfoForProfiling */ true)}
+  , source{source}
+  , line_offsets{0}
+{
+  for (std::size_t idx = 0; idx < source.size(); ++idx) {
+    if (source[idx] == '\n')
+      line_offsets.push_back(idx + 1);
+  }
+
+  module.addModuleFlag(llvm::Module::Warning,
+                       "Debug Info Version",
+                       llvm::DEBUG_METADATA_VERSION);
+  module.addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+}
+
+void DebugInfo::createSubprogram(llvm::Function&        func,
+                                 const std::string_view name,
+                                 const PositionRange&   pos)
+{
+  const auto position = getLineAndColumn(pos);
+
+  if (!position)
+    return;
+
+  auto spflags = llvm::DISubprogram::SPFlagDefinition;
+
+  if (func.hasLocalLinkage())
+    spflags |= llvm::DISubprogram::SPFlagLocalToUnit;
+
+  if (compile_unit->isOptimized())
+    spflags |= llvm::DISubprogram::SPFlagOptimized;
+
+  // Types are not needed for line tables
+  auto const subprogram = builder.createFunction(
+    file,
+    llvm::StringRef{name.data(), name.size()},
+    func.getName(),
+    file,
+    position->line,
+    builder.createSubroutineType(builder.getOrCreateTypeArray({})),
+    position->line,
+    llvm::DINode::FlagPrototyped,
+    spflags);
+
+  func.setSubprogram(subprogram);
+}
+
+[[nodiscard]] llvm::DILocation*
+DebugInfo::getLocation(const llvm::Function& func,
+                       const PositionRange&  pos) const
+{
+  auto const subprogram = func.getSubprogram();
+
+  if (!subprogram)
+    return nullptr;
+
+  const auto position = getLineAndColumn(pos);
+
+  if (!position)
+    return nullptr;
+
+  return llvm::DILocation::get(func.getContext(),
+                               position->line,
+                               position->column,
+                               subprogram);
+}
+
+void DebugInfo::finalize()
+{
+  builder.finalize();
+}
+
+[[nodiscard]] std::optional<DebugInfo::LineAndColumn>
+DebugInfo::getLineAndColumn(const PositionRange& pos) const
+{
+  auto const first = source.data();
+  auto const last  = first + source.size();
+  auto const p     = std::to_address(pos.begin().base());
+
+  // Positions of imported files point into their own inputs
+  if (std::less<>{}(p, first) || std::less<>{}(last, p))
+    return std::nullopt;
+
+  const auto offset = static_cast<std::size_t>(p - first);
+
+  const auto line_it
+    = std::upper_bound(line_offsets.begin(), line_offsets.end(), offset);
+
+  const auto line = static_cast<std::size_t>(line_it - line_offsets.begin());
+
+  return LineAndColumn{static_cast<unsigned int>(line),
+                       static_cast<unsigned int>(offset - *(line_it - 1) + 1)};
+}
+
+} // namespace twinkle::codegen
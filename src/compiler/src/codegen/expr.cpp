@@ -10,6 +10,7 @@
 #include <twinkle/codegen/kind.hpp>
 #include <twinkle/codegen/stmt.hpp>
 #include <twinkle/codegen/top_level.hpp>
+#include <twinkle/support/stats.hpp>
 
 namespace twinkle::codegen
 {
@@ -87,6 +88,76 @@ private:
   }
 }
 
+[[nodiscard]] BuiltinFunctionKind
+matchBuiltinFunction(const std::string_view name)
+{
+  static const std::unordered_map<std::string_view, BuiltinFunctionKind>
+    builtin_map{
+      {    "__builtin_shufflevector",       BuiltinFunctionKind::shufflevector},
+      {           "__builtin_select",              BuiltinFunctionKind::select},
+      {       "__builtin_reduce_add",          BuiltinFunctionKind::reduce_add},
+      {       "__builtin_reduce_mul",          BuiltinFunctionKind::reduce_mul},
+      {       "__builtin_reduce_and",          BuiltinFunctionKind::reduce_and},
+      {        "__builtin_reduce_or",           BuiltinFunctionKind::reduce_or},
+      {       "__builtin_reduce_xor",          BuiltinFunctionKind::reduce_xor},
+      {       "__builtin_reduce_min",          BuiltinFunctionKind::reduce_min},
+      {       "__builtin_reduce_max",          BuiltinFunctionKind::reduce_max},
+      {           "__builtin_expect",              BuiltinFunctionKind::expect},
+      {         "__builtin_prefetch",            BuiltinFunctionKind::prefetch},
+      {           "__builtin_assume",              BuiltinFunctionKind::assume},
+      {      "__builtin_unreachable",         BuiltinFunctionKind::unreachable},
+      { "__builtin_readcyclecounter",    BuiltinFunctionKind::readcyclecounter},
+      {         "__builtin_popcount",            BuiltinFunctionKind::popcount},
+      {              "__builtin_clz",                 BuiltinFunctionKind::clz},
+      {              "__builtin_ctz",                 BuiltinFunctionKind::ctz},
+      {            "__builtin_bswap",               BuiltinFunctionKind::bswap},
+      {             "__builtin_rotl",                BuiltinFunctionKind::rotl},
+      {             "__builtin_rotr",                BuiltinFunctionKind::rotr},
+      {            "__atomic_load_n",         BuiltinFunctionKind::atomic_load},
+      {           "__atomic_store_n",        BuiltinFunctionKind::atomic_store},
+      {        "__atomic_exchange_n",     BuiltinFunctionKind::atomic_exchange},
+      {"__atomic_compare_exchange_n",      BuiltinFunctionKind::atomic_cmpxchg},
+      {         "__atomic_fetch_add",    BuiltinFunctionKind::atomic_fetch_add},
+      {         "__atomic_fetch_sub",    BuiltinFunctionKind::atomic_fetch_sub},
+      {         "__atomic_fetch_and",    BuiltinFunctionKind::atomic_fetch_and},
+      {          "__atomic_fetch_or",     BuiltinFunctionKind::atomic_fetch_or},
+      {         "__atomic_fetch_xor",    BuiltinFunctionKind::atomic_fetch_xor},
+      {        "__atomic_fetch_nand",   BuiltinFunctionKind::atomic_fetch_nand},
+      {         "__atomic_fetch_min",    BuiltinFunctionKind::atomic_fetch_min},
+      {         "__atomic_fetch_max",    BuiltinFunctionKind::atomic_fetch_max},
+      {      "__atomic_thread_fence", BuiltinFunctionKind::atomic_thread_fence},
+      {      "__atomic_signal_fence", BuiltinFunctionKind::atomic_signal_fence},
+      {      "__builtin_async_yield",         BuiltinFunctionKind::async_yield},
+      {    "__builtin_async_wait_fd",       BuiltinFunctionKind::async_wait_fd},
+  };
+
+  const auto it = builtin_map.find(name);
+
+  if (it == builtin_map.end())
+    return BuiltinFunctionKind::unknown;
+
+  return it->second;
+}
+
+// Returns std::nullopt if the expression is not an integer literal
+[[nodiscard]] static std::optional<std::int64_t>
+getIntegerLiteral(const ast::Expr& expr)
+{
+  if (const auto value = boost::get<std::int32_t>(&expr))
+    return *value;
+
+  if (const auto value = boost::get<std::uint32_t>(&expr))
+    return *value;
+
+  if (const auto value = boost::get<std::int64_t>(&expr))
+    return *value;
+
+  if (const auto value = boost::get<std::uint8_t>(&expr))
+    return *value;
+
+  return std::nullopt;
+}
+
 [[nodiscard]] ScopeResolutionResult
 createScopeResolutionResult(CGContext& ctx, const ast::ScopeResolution& node)
 {
@@ -253,6 +324,18 @@ struct ExprVisitor : public boost::static_visitor<Value> {
       return createAllocaInfinityFP(
         std::make_shared<BuiltinType>(BuiltinTypeKind::f64, false));
 
+    // Same values as GCC and clang
+    case BuiltinMacroKind::atomic_relaxed:
+    case BuiltinMacroKind::atomic_consume:
+    case BuiltinMacroKind::atomic_acquire:
+    case BuiltinMacroKind::atomic_release:
+    case BuiltinMacroKind::atomic_acq_rel:
+    case BuiltinMacroKind::atomic_seq_cst:
+      return {ctx.builder.getInt32(
+                static_cast<std::uint32_t>(node.kind)
+                - static_cast<std::uint32_t>(BuiltinMacroKind::atomic_relaxed)),
+              std::make_shared<BuiltinType>(BuiltinTypeKind::i32, false)};
+
     case BuiltinMacroKind::unknown:
       unreachable();
     }
@@ -329,7 +412,15 @@ struct ExprVisitor : public boost::static_visitor<Value> {
 
   [[nodiscard]] Value operator()(const ast::Subscript& node) const
   {
-    const auto value = createNoLoadSubscript(node);
+    const auto lhs = createExpr(ctx, scope, stmt_ctx, node.lhs);
+
+    if (lhs.getType()->isVectorTy(ctx) && !hasAddressableLanes(lhs)) {
+      return {ctx.builder.CreateExtractElement(lhs.getValue(),
+                                               createIndex(node).getValue()),
+              lhs.getType()->getVectorElementType(ctx)};
+    }
+
+    const auto value = createNoLoadSubscript(lhs, node);
 
     return {ctx.builder.CreateLoad(value.getLLVMType()->getPointerElementType(),
                                    value.getValue()),
@@ -341,9 +432,10 @@ struct ExprVisitor : public boost::static_visitor<Value> {
     // Function calls have no guaranteed order of argument evaluation
     // The {} call to the constructor is guaranteed to be evaluated from left to
     // right, so use it
-    const auto [lhs, rhs]
-      = implicitConv(std::pair{boost::apply_visitor(*this, node.lhs),
-                               boost::apply_visitor(*this, node.rhs)});
+    const auto [lhs, rhs] = implicitConv(
+      splatScalar(std::pair{boost::apply_visitor(*this, node.lhs),
+                            boost::apply_visitor(*this, node.rhs)},
+                  ctx.positionOf(node)));
 
     if (!isPointerArithmetic(lhs, rhs)
         && !equals(ctx, lhs.getType(), rhs.getType())) {
@@ -520,6 +612,69 @@ struct ExprVisitor : public boost::static_visitor<Value> {
             std::make_shared<BuiltinType>(BuiltinTypeKind::void_, false)};
   }
 
+  [[nodiscard]] Value operator()(const ast::Spawn& node) const
+  {
+    const auto pos = ctx.positionOf(node);
+
+    if (const auto call = boost::get<ast::FunctionCall>(&node.call)) {
+      const auto callee_name = boost::get<ast::Identifier>(&call->callee);
+
+      if (callee_name
+          && matchBuiltinFunction(callee_name->utf8())
+               == BuiltinFunctionKind::unknown) {
+        auto args = createArgVals(call->args, pos);
+
+        auto const func = findCallee(callee_name->utf8(), args, pos);
+
+        return createSpawn(func, args, pos);
+      }
+    }
+    else if (const auto call
+             = boost::get<ast::FunctionTemplateCall>(&node.call)) {
+      const auto args = createArgVals(call->args, pos);
+
+      return createSpawn(findTemplateCallee(*call, args, pos), args, pos);
+    }
+
+    throw CodegenError{
+      ctx.formatError(pos, "spawn requires a call of a function")};
+  }
+
+  [[nodiscard]] Value operator()(const ast::Join& node) const
+  {
+    const auto pos = ctx.positionOf(node);
+
+    const auto task = boost::apply_visitor(*this, node.task);
+
+    if (!task.getType()->isTaskTy(ctx))
+      throw CodegenError{ctx.formatError(pos, "join requires a task")};
+
+    return createJoin(task);
+  }
+
+  [[nodiscard]] Value operator()(const ast::Await& node) const
+  {
+    const auto pos = ctx.positionOf(node);
+
+    const auto future = boost::apply_visitor(*this, node.future);
+
+    if (!future.getType()->isFutureTy(ctx))
+      throw CodegenError{ctx.formatError(pos, "await requires a future")};
+
+    // The future of a variable is moved out, so that it is neither awaited
+    // twice nor detached at the end of the scope
+    if (!boost::get<ast::FunctionCall>(&node.future)
+        && !boost::get<ast::FunctionTemplateCall>(&node.future)) {
+      if (auto const address = llvm::getPointerOperand(future.getValue())) {
+        ctx.builder.CreateStore(
+          llvm::Constant::getNullValue(future.getLLVMType()),
+          address);
+      }
+    }
+
+    return createAwait(ctx, future);
+  }
+
   [[nodiscard]] Value operator()(const ast::Dereference& node) const
   {
     const auto value = boost::apply_visitor(*this, node.operand);
@@ -539,6 +694,10 @@ struct ExprVisitor : public boost::static_visitor<Value> {
 
     const auto callee_name = boost::get<ast::Identifier>(node.callee).utf8();
 
+    if (const auto kind = matchBuiltinFunction(callee_name);
+        kind != BuiltinFunctionKind::unknown)
+      return createBuiltinCall(kind, callee_name, node.args, pos);
+
     auto args = createArgVals(node.args, pos);
 
     return createFunctionCall(callee_name, createArgVals(node.args, pos), pos);
@@ -548,38 +707,9 @@ struct ExprVisitor : public boost::static_visitor<Value> {
   {
     const auto pos = ctx.positionOf(node);
 
-    const auto callee_name = boost::get<ast::Identifier>(node.callee).utf8();
-
     const auto args = createArgVals(node.args, pos);
 
-    // Trying to call
-    const auto mangled_names
-      = ctx.mangler.mangleFunctionTemplateCall(callee_name,
-                                               node.template_args,
-                                               args);
-
-    for (const auto& name : mangled_names) {
-      if (const auto func = ctx.module->getFunction(name))
-        return createFunctionCall(func, args, pos);
-    }
-
-    // Trying to define
-    const auto func_template
-      = findFunctionTemplate(callee_name, node.template_args);
-
-    if (!func_template) {
-      throw CodegenError{ctx.formatError(
-        pos,
-        fmt::format("unknown function template '{}' called", callee_name))};
-    }
-
-    return createFunctionCall(createFunctionTemplate(func_template->first,
-                                                     node.template_args,
-                                                     func_template->second),
-                              args,
-                              pos);
-
-    unreachable();
+    return createFunctionCall(findTemplateCallee(node, args, pos), args, pos);
   }
 
   [[nodiscard]] Value operator()(const ast::Cast& node) const
@@ -588,50 +718,7 @@ struct ExprVisitor : public boost::static_visitor<Value> {
 
     const auto as = createType(ctx, node.as, ctx.positionOf(node));
 
-    if (as->isPointerTy(ctx)) {
-      // Pointer to pointer
-      return {
-        ctx.builder.CreatePointerCast(lhs.getValue(), as->getLLVMType(ctx)),
-        as};
-    }
-
-    if (as->isFloatingPointTy(ctx)) {
-      if (lhs.getType()->isIntegerTy(ctx)) {
-        const auto cast_op = lhs.getType()->isSigned(ctx)
-                               ? llvm::CastInst::CastOps::SIToFP
-                               : llvm::CastInst::CastOps::UIToFP;
-
-        return {
-          ctx.builder.CreateCast(cast_op, lhs.getValue(), as->getLLVMType(ctx)),
-          as};
-      }
-
-      // Floating point number to floating point number
-      return {ctx.builder.CreateFPCast(lhs.getValue(), as->getLLVMType(ctx)),
-              as};
-    }
-
-    if (as->getLLVMType(ctx)->isIntegerTy()) {
-      if (lhs.getType()->isFloatingPointTy(ctx)) {
-        // Floating point number to integer
-        const auto cast_op = as->isSigned(ctx)
-                               ? llvm::CastInst::CastOps::FPToSI
-                               : llvm::CastInst::CastOps::FPToUI;
-
-        return {
-          ctx.builder.CreateCast(cast_op, lhs.getValue(), as->getLLVMType(ctx)),
-          as};
-      }
-
-      // Integer to integer
-      return {ctx.builder.CreateIntCast(lhs.getValue(),
-                                        as->getLLVMType(ctx),
-                                        as->isSigned(ctx)),
-              as};
-    }
-
-    throw CodegenError{
-      ctx.formatError(ctx.positionOf(node), "non-convertible type")};
+    return createCast(lhs, as, ctx.positionOf(node));
   }
 
   [[nodiscard]] Value operator()(const ast::Pipeline& node) const
@@ -655,6 +742,9 @@ struct ExprVisitor : public boost::static_visitor<Value> {
 
     const auto type = createType(ctx, node.type, pos);
 
+    if (type->isVectorTy(ctx))
+      return createVectorLiteral(type, node.initializer_list, pos);
+
     if (!type->getLLVMType(ctx)->isStructTy())
       throw CodegenError{ctx.formatError(pos, "no support for non-class type")};
 
@@ -734,6 +824,10 @@ struct ExprVisitor : public boost::static_visitor<Value> {
   }
 
 private:
+  friend std::pair<Value, Value> splatScalar(CGContext&,
+                                             const std::pair<Value, Value>&,
+                                             const PositionRange&);
+
   [[nodiscard]] std::vector<std::string>
   stringifyExprs(const std::deque<ast::Expr>& exprs,
                  const std::function<void()>& on_error) const
@@ -755,6 +849,8 @@ private:
                                const ast::TemplateArguments& template_args,
                                const PositionRange&          pos) const
   {
+    llvm::TimeTraceScope scope{"InstantiateUnion", union_name};
+
     const auto union_template = findUnionTemplate(union_name, template_args);
 
     if (!union_template) {
@@ -784,6 +880,9 @@ private:
       createTopLevel(ctx, tmp);
     }
 
+    if (stats::enabled())
+      stats::addTemplateInstantiation(stats::TemplateKind::union_, union_name);
+
     // Return insert point to previous location
     ctx.builder.SetInsertPoint(return_bb);
   }
@@ -932,18 +1031,19 @@ private:
 
   [[nodiscard]] llvm::Function*
   declareFunctionTemplate(const ast::FunctionDecl&      decl,
+                          const ast::Attrs&             attrs,
+                          const bool                    is_async,
                           const ast::TemplateArguments& template_args,
                           const NamespaceStack&         space) const
   {
-    const auto return_type
-      = createType(ctx, decl.return_type, ctx.positionOf(decl));
+    const auto return_type = createReturnType(ctx, decl, is_async);
 
     const auto mangled_name
       = ctx.mangler.mangleFunctionTemplate(space, decl, template_args);
 
     assert(!ctx.module->getFunction(mangled_name));
 
-    return declareFunction(ctx, decl, mangled_name, return_type);
+    return declareFunction(ctx, decl, mangled_name, return_type, attrs);
   }
 
   // Assumption not yet defined
@@ -952,6 +1052,14 @@ private:
                          const ast::TemplateArguments&     template_args,
                          const NamespaceStack&             space) const
   {
+    llvm::TimeTraceScope scope{"InstantiateFunction",
+                               [&] { return ast.decl.name.utf8(); }};
+
+    if (stats::enabled()) {
+      stats::addTemplateInstantiation(stats::TemplateKind::function,
+                                      ast.decl.name.utf8());
+    }
+
     const auto pos = ctx.positionOf(ast.decl);
 
     const TemplateArgumentsDefiner ta_definer{ctx,
@@ -961,7 +1069,11 @@ private:
 
     const auto name = ast.decl.name.utf8();
 
-    auto const func = declareFunctionTemplate(ast.decl, template_args, space);
+    auto const func = declareFunctionTemplate(ast.decl,
+                                              ast.attrs,
+                                              ast.is_async,
+                                              template_args,
+                                              space);
 
     assert(func);
 
@@ -978,9 +1090,11 @@ private:
                          name,
                          ast.decl.params,
                          createType(ctx, ast.decl.return_type, pos),
-                         ast.body);
+                         ast.body,
+                         pos,
+                         ast.is_async);
 
-      ctx.fpm.run(*func);
+      ctx.runFunctionPasses(*func);
 
       // Return insert point to previous location
       ctx.builder.SetInsertPoint(return_bb);
@@ -1148,20 +1262,65 @@ private:
     const std::string&                                   callee_name,
     std::deque<Value>&&                                  args,
     const boost::iterator_range<twinkle::InputIterator>& pos) const
+  {
+    auto const func = findCallee(callee_name, args, pos);
+
+    return createFunctionCall(func, args, pos);
+  }
+
+  // If the callee is a method, 'this' is inserted at the beginning of the
+  // arguments
+  [[nodiscard]] llvm::Function* findCallee(const std::string&   callee_name,
+                                           std::deque<Value>&   args,
+                                           const PositionRange& pos) const
   {
     if (auto const func = findCalleeMethod(callee_name, args)) {
       args.push_front((*this)(ast::Identifier{std::u32string{U"this"}}));
-      return createFunctionCall(func, args, pos);
+      return func;
     }
 
     if (auto const func = findCalleeFunc(callee_name, args))
-      return createFunctionCall(func, args, pos);
+      return func;
 
     throw CodegenError{ctx.formatError(
       pos,
       fmt::format("unknown function '{}' called", callee_name))};
   }
 
+  // The function template is instantiated if it has not been
+  [[nodiscard]] llvm::Function*
+  findTemplateCallee(const ast::FunctionTemplateCall& node,
+                     const std::deque<Value>&         args,
+                     const PositionRange&             pos) const
+  {
+    const auto callee_name = boost::get<ast::Identifier>(node.callee).utf8();
+
+    // Trying to call
+    const auto mangled_names
+      = ctx.mangler.mangleFunctionTemplateCall(callee_name,
+                                               node.template_args,
+                                               args);
+
+    for (const auto& name : mangled_names) {
+      if (const auto func = ctx.module->getFunction(name))
+        return func;
+    }
+
+    // Trying to define
+    const auto func_template
+      = findFunctionTemplate(callee_name, node.template_args);
+
+    if (!func_template) {
+      throw CodegenError{ctx.formatError(
+        pos,
+        fmt::format("unknown function template '{}' called", callee_name))};
+    }
+
+    return createFunctionTemplate(func_template->first,
+                                  node.template_args,
+                                  func_template->second);
+  }
+
   [[nodiscard]] Value createFunctionCall(
     llvm::Function* const                                callee_func,
     const std::deque<Value>&                             args,
@@ -1194,106 +1353,1241 @@ private:
     return {return_value, *return_type};
   }
 
-  [[nodiscard]] std::shared_ptr<Variable>
-  findVariable(const ast::Identifier& node) const
+  // With a single element, it is set to all lanes
+  [[nodiscard]] Value
+  createVectorLiteral(const std::shared_ptr<Type>&  vector_type,
+                      const std::vector<ast::Expr>& initializer_list,
+                      const PositionRange&          pos) const
   {
-    const auto ident = node.utf8();
+    const auto size = vector_type->getVectorSize(ctx);
 
-    if (const auto variable = scope[ident])
-      return *variable;
+    if (initializer_list.size() != 1 && initializer_list.size() != size) {
+      throw CodegenError{ctx.formatError(
+        pos,
+        fmt::format("vector literal requires 1 or {} elements", size))};
+    }
 
-    return nullptr;
-  }
+    const auto element_type = vector_type->getVectorElementType(ctx);
 
-  // Find a member of '*this'
-  // If not found, std::nullopt is returned
-  [[nodiscard]] std::optional<Value>
-  findMemberOfThis(const ast::Identifier& node) const
-  {
-    if (scope["this"]) {
-      const auto this_p
-        = findVariable(ast::Identifier{std::u32string{U"this"}});
+    std::vector<llvm::Value*> lanes;
 
-      if (!this_p)
-        return std::nullopt;
+    for (const auto& r : initializer_list) {
+      const auto element = createExpr(ctx, scope, stmt_ctx, r);
 
-      const auto this_value
-        = createDereference(ctx, ctx.positionOf(node), this_p);
+      auto const llvm_type = element.getLLVMType();
 
-      return memberVariableAccess(this_value, node, false);
+      if (!llvm_type->isIntegerTy() && !llvm_type->isFloatingPointTy()) {
+        throw CodegenError{
+          ctx.formatError(pos, "incompatible type for vector element")};
+      }
+
+      lanes.push_back(createCast(element, element_type, pos).getValue());
     }
 
-    return std::nullopt;
-  }
+    if (lanes.size() == 1)
+      return {ctx.builder.CreateVectorSplat(size, lanes.front()), vector_type};
 
-  [[nodiscard]] bool isPointerArithmetic(const Value& lhs,
-                                         const Value& rhs) const
-  {
-    return lhs.getType()->isPointerTy(ctx) && rhs.getType()->isIntegerTy(ctx);
-  }
+    llvm::Value* vector = llvm::PoisonValue::get(vector_type->getLLVMType(ctx));
 
-  [[nodiscard]] std::pair<Value, Value> implicitConv(const Value& lhs,
-                                                     const Value& rhs) const
-  {
-    // Pointer arithmetics are exceptions
-    if (isPointerArithmetic(lhs, rhs))
-      return std::make_pair(lhs, rhs);
+    for (std::uint64_t idx = 0; auto const lane : lanes)
+      vector = ctx.builder.CreateInsertElement(vector, lane, idx++);
 
-    return unifySign(unifyBitWidth(lhs, rhs));
+    return {vector, vector_type};
   }
 
-  [[nodiscard]] std::pair<Value, Value>
-  implicitConv(const std::pair<Value, Value>& operands) const
-  {
-    return implicitConv(operands.first, operands.second);
-  }
+  //===--------------------------------------------------------------------===//
+  // Tasks
+  //===--------------------------------------------------------------------===//
 
-  // For Integer
-  [[nodiscard]] std::pair<Value, Value> toLargerBitWidth(const Value& lhs,
-                                                         const Value& rhs) const
+  // The arguments are evaluated and copied to the task, and the callee is
+  // called by the body of the task on one of the threads of the runtime
+  [[nodiscard]] Value createSpawn(llvm::Function* const    callee,
+                                  const std::deque<Value>& args,
+                                  const PositionRange&     pos) const
   {
-    if (const auto lhs_bitwidth = lhs.getLLVMType()->getIntegerBitWidth(),
-        rhs_bitwidth            = rhs.getLLVMType()->getIntegerBitWidth();
-        lhs_bitwidth != rhs_bitwidth) {
-      const auto larger_bitwidth = std::max(lhs_bitwidth, rhs_bitwidth);
+    if (callee->isVarArg()) {
+      throw CodegenError{ctx.formatError(
+        pos,
+        "cannot spawn a function with variable arguments")};
+    }
 
-      const auto is_target_lhs = lhs_bitwidth == larger_bitwidth;
+    if (callee->arg_size() != args.size())
+      throw CodegenError{ctx.formatError(pos, "incorrect arguments passed")};
 
-      const auto target_type = is_target_lhs ? lhs.getType() : rhs.getType();
+    verifyArguments(args, callee, pos);
 
-      if (is_target_lhs) {
-        return std::make_pair(
-          lhs,
-          Value{ctx.builder.CreateIntCast(rhs.getValue(),
-                                          lhs.getLLVMType(),
-                                          target_type->isSigned(ctx)),
-                target_type});
-      }
-      else {
-        return std::make_pair(
-          Value{ctx.builder.CreateIntCast(lhs.getValue(),
-                                          rhs.getLLVMType(),
-                                          target_type->isSigned(ctx)),
-                target_type},
-          rhs);
-      }
+    const auto return_type = ctx.return_type_table[callee];
+
+    assert(return_type);
+
+    const auto& result_type = return_type->get();
+
+    // The executor of async functions is not shared between threads
+    if (result_type->isFutureTy(ctx)) {
+      throw CodegenError{
+        ctx.formatError(pos, "cannot spawn an async function")};
     }
 
-    return std::make_pair(lhs, rhs);
+    const auto has_result = !result_type->isVoidTy(ctx);
+
+    auto const data_type = getTaskDataType(callee, has_result);
+
+    auto const func = ctx.builder.GetInsertBlock()->getParent();
+
+    auto const data = createEntryAlloca(func, "", data_type);
+
+    for (std::uint32_t idx = has_result; const auto& arg : args) {
+      ctx.builder.CreateStore(
+        arg.getValue(),
+        ctx.builder.CreateStructGEP(data_type, data, idx++));
+    }
+
+    auto const i8_ptr = ctx.builder.getInt8PtrTy();
+
+    auto const body = getTaskBody(callee, data_type, has_result);
+
+    auto const group = getTaskGroup(ctx, func);
+
+    auto const spawn
+      = ctx.module->getOrInsertFunction("__twinkle_spawn",
+                                        i8_ptr,
+                                        group->getType(),
+                                        body->getType(),
+                                        i8_ptr,
+                                        ctx.builder.getInt64Ty());
+
+    const auto size
+      = ctx.module->getDataLayout().getTypeAllocSize(data_type).getFixedSize();
+
+    return {ctx.builder.CreateCall(
+              spawn,
+              {group,
+               body,
+               ctx.builder.CreatePointerCast(data, i8_ptr),
+               ctx.builder.getInt64(size)}),
+            std::make_shared<TaskType>(result_type, false)};
   }
 
-  // For floating point number
-  [[nodiscard]] std::pair<Value, Value>
-  toLargerMantissaWidth(const Value& lhs, const Value& rhs) const
+  // Wait for the task and take its result
+  [[nodiscard]] Value createJoin(const Value& task) const
   {
-    if (const auto lhs_mantissaw = lhs.getLLVMType()->getFPMantissaWidth(),
-        rhs_mantissaw            = rhs.getLLVMType()->getFPMantissaWidth();
-        lhs_mantissaw != rhs_mantissaw) {
-      const auto larger_mantissaw = std::max(lhs_mantissaw, rhs_mantissaw);
+    const auto result_type = task.getType()->getTaskResultType(ctx);
 
-      const auto is_target_lhs = lhs_mantissaw == larger_mantissaw;
+    auto const i8_ptr = ctx.builder.getInt8PtrTy();
+    auto const i64    = ctx.builder.getInt64Ty();
 
-      const auto target_type = is_target_lhs ? lhs.getType() : rhs.getType();
+    auto const join = ctx.module->getOrInsertFunction("__twinkle_join",
+                                                      ctx.builder.getVoidTy(),
+                                                      i8_ptr,
+                                                      i8_ptr,
+                                                      i64);
+
+    if (result_type->isVoidTy(ctx)) {
+      ctx.builder.CreateCall(join,
+                             {task.getValue(),
+                              llvm::ConstantPointerNull::get(i8_ptr),
+                              llvm::ConstantInt::get(i64, 0)});
+
+      return {nullptr, result_type};
+    }
+
+    auto const llvm_type = result_type->getLLVMType(ctx);
+
+    auto const result
+      = createEntryAlloca(ctx.builder.GetInsertBlock()->getParent(),
+                          "",
+                          llvm_type);
+
+    const auto size
+      = ctx.module->getDataLayout().getTypeStoreSize(llvm_type).getFixedSize();
+
+    ctx.builder.CreateCall(join,
+                           {task.getValue(),
+                            ctx.builder.CreatePointerCast(result, i8_ptr),
+                            llvm::ConstantInt::get(i64, size)});
+
+    return {ctx.builder.CreateLoad(llvm_type, result), result_type};
+  }
+
+  // The result comes first, so that join copies only the beginning
+  [[nodiscard]] llvm::StructType*
+  getTaskDataType(llvm::Function* const callee, const bool has_result) const
+  {
+    std::vector<llvm::Type*> fields;
+
+    if (has_result)
+      fields.push_back(callee->getReturnType());
+
+    for (const auto& param : callee->args())
+      fields.push_back(param.getType());
+
+    return llvm::StructType::get(ctx.context, fields);
+  }
+
+  // void body(data), which is shared by the spawns of the callee
+  [[nodiscard]] llvm::Function*
+  getTaskBody(llvm::Function* const   callee,
+              llvm::StructType* const data_type,
+              const bool              has_result) const
+  {
+    const auto name = callee->getName() + ".task";
+
+    if (auto const body = ctx.module->getFunction(name.str()))
+      return body;
+
+    auto const body = llvm::Function::Create(
+      llvm::FunctionType::get(ctx.builder.getVoidTy(),
+                              {ctx.builder.getInt8PtrTy()},
+                              false),
+      llvm::Function::InternalLinkage,
+      name,
+      *ctx.module);
+
+    llvm::IRBuilder<> builder{llvm::BasicBlock::Create(ctx.context, "", body)};
+
+    auto const data
+      = builder.CreatePointerCast(body->getArg(0), data_type->getPointerTo());
+
+    const auto& layout = ctx.module->getDataLayout();
+
+    // The runtime aligns the data to 16 bytes
+    const auto getAlign = [&](llvm::Type* const type) {
+      return std::min(layout.getABITypeAlign(type), llvm::Align{16});
+    };
+
+    std::vector<llvm::Value*> args;
+
+    for (std::uint32_t idx = has_result; const auto& param : callee->args()) {
+      args.push_back(builder.CreateAlignedLoad(
+        param.getType(),
+        builder.CreateStructGEP(data_type, data, idx++),
+        getAlign(param.getType())));
+    }
+
+    auto const result = builder.CreateCall(callee, args);
+
+    if (has_result) {
+      builder.CreateAlignedStore(result,
+                                 builder.CreateStructGEP(data_type, data, 0),
+                                 getAlign(result->getType()));
+    }
+
+    builder.CreateRetVoid();
+
+    return body;
+  }
+
+  //===--------------------------------------------------------------------===//
+  // Builtin functions
+  //===--------------------------------------------------------------------===//
+
+  [[nodiscard]] Value createBuiltinCall(const BuiltinFunctionKind    kind,
+                                        const std::string_view       name,
+                                        const std::deque<ast::Expr>& args,
+                                        const PositionRange&         pos) const
+  {
+    switch (kind) {
+    case BuiltinFunctionKind::shufflevector:
+      return createShuffleVector(args, pos);
+
+    case BuiltinFunctionKind::select: {
+      verifyBuiltinArgsSize(name, args, 3, pos);
+      return createSelect(createExpr(ctx, scope, stmt_ctx, args[0]),
+                          createExpr(ctx, scope, stmt_ctx, args[1]),
+                          createExpr(ctx, scope, stmt_ctx, args[2]),
+                          pos);
+    }
+
+    case BuiltinFunctionKind::reduce_add:
+    case BuiltinFunctionKind::reduce_mul:
+    case BuiltinFunctionKind::reduce_and:
+    case BuiltinFunctionKind::reduce_or:
+    case BuiltinFunctionKind::reduce_xor:
+    case BuiltinFunctionKind::reduce_min:
+    case BuiltinFunctionKind::reduce_max:
+      verifyBuiltinArgsSize(name, args, 1, pos);
+      return createReduce(kind,
+                          name,
+                          createExpr(ctx, scope, stmt_ctx, args.front()),
+                          pos);
+
+    case BuiltinFunctionKind::expect:
+      verifyBuiltinArgsSize(name, args, 2, pos);
+      return createExpect(createExpr(ctx, scope, stmt_ctx, args[0]),
+                          createExpr(ctx, scope, stmt_ctx, args[1]),
+                          pos);
+
+    case BuiltinFunctionKind::prefetch:
+      return createPrefetch(args, pos);
+
+    case BuiltinFunctionKind::assume:
+      verifyBuiltinArgsSize(name, args, 1, pos);
+      return createAssume(createExpr(ctx, scope, stmt_ctx, args.front()), pos);
+
+    case BuiltinFunctionKind::unreachable:
+      verifyBuiltinArgsSize(name, args, 0, pos);
+      return createUnreachable();
+
+    case BuiltinFunctionKind::readcyclecounter:
+      verifyBuiltinArgsSize(name, args, 0, pos);
+      return {
+        ctx.builder.CreateIntrinsic(llvm::Intrinsic::readcyclecounter, {}, {}),
+        std::make_shared<BuiltinType>(BuiltinTypeKind::u64, false)};
+
+    case BuiltinFunctionKind::popcount:
+    case BuiltinFunctionKind::clz:
+    case BuiltinFunctionKind::ctz:
+    case BuiltinFunctionKind::bswap:
+      verifyBuiltinArgsSize(name, args, 1, pos);
+      return createBitCount(kind,
+                            name,
+                            createExpr(ctx, scope, stmt_ctx, args.front()),
+                            pos);
+
+    case BuiltinFunctionKind::rotl:
+    case BuiltinFunctionKind::rotr:
+      verifyBuiltinArgsSize(name, args, 2, pos);
+      return createRotate(kind,
+                          name,
+                          createExpr(ctx, scope, stmt_ctx, args[0]),
+                          createExpr(ctx, scope, stmt_ctx, args[1]),
+                          pos);
+
+    case BuiltinFunctionKind::atomic_load:
+      verifyBuiltinArgsSize(name, args, 2, pos);
+      return createAtomicLoad(args, pos);
+
+    case BuiltinFunctionKind::atomic_store:
+      verifyBuiltinArgsSize(name, args, 3, pos);
+      return createAtomicStore(args, pos);
+
+    case BuiltinFunctionKind::atomic_exchange:
+      verifyBuiltinArgsSize(name, args, 3, pos);
+      return createAtomicExchange(args, pos);
+
+    case BuiltinFunctionKind::atomic_cmpxchg:
+      verifyBuiltinArgsSize(name, args, 6, pos);
+      return createAtomicCmpXchg(args, pos);
+
+    case BuiltinFunctionKind::atomic_fetch_add:
+    case BuiltinFunctionKind::atomic_fetch_sub:
+    case BuiltinFunctionKind::atomic_fetch_and:
+    case BuiltinFunctionKind::atomic_fetch_or:
+    case BuiltinFunctionKind::atomic_fetch_xor:
+    case BuiltinFunctionKind::atomic_fetch_nand:
+    case BuiltinFunctionKind::atomic_fetch_min:
+    case BuiltinFunctionKind::atomic_fetch_max:
+      verifyBuiltinArgsSize(name, args, 3, pos);
+      return createAtomicFetchOp(kind, name, args, pos);
+
+    case BuiltinFunctionKind::atomic_thread_fence:
+    case BuiltinFunctionKind::atomic_signal_fence: {
+      verifyBuiltinArgsSize(name, args, 1, pos);
+
+      // A relaxed fence does nothing
+      if (const auto order = getMemoryOrder(args.front(), pos);
+          order != llvm::AtomicOrdering::Monotonic) {
+        ctx.builder.CreateFence(
+          order,
+          kind == BuiltinFunctionKind::atomic_thread_fence
+            ? llvm::SyncScope::System
+            : llvm::SyncScope::SingleThread);
+      }
+
+      return {nullptr,
+              std::make_shared<BuiltinType>(BuiltinTypeKind::void_, false)};
+    }
+
+    case BuiltinFunctionKind::async_yield:
+      verifyBuiltinArgsSize(name, args, 0, pos);
+      return createAsyncYield(name, pos);
+
+    case BuiltinFunctionKind::async_wait_fd:
+      verifyBuiltinArgsSize(name, args, 2, pos);
+      return createAsyncWaitFd(name, args, pos);
+
+    case BuiltinFunctionKind::unknown:
+      unreachable();
+    }
+
+    unreachable();
+  }
+
+  void verifyBuiltinArgsSize(const std::string_view       name,
+                             const std::deque<ast::Expr>& args,
+                             const std::size_t            size,
+                             const PositionRange&         pos) const
+  {
+    if (args.size() != size) {
+      throw CodegenError{ctx.formatError(
+        pos,
+        fmt::format("'{}' requires {} arguments", name, size))};
+    }
+  }
+
+  // __builtin_shufflevector(a, b, indices...)
+  // The indices must be integer literals, and the index i selects the lane i
+  // of the concatenation of a and b
+  [[nodiscard]] Value
+  createShuffleVector(const std::deque<ast::Expr>& args,
+                      const PositionRange&         pos) const
+  {
+    if (args.size() < 3) {
+      throw CodegenError{ctx.formatError(
+        pos,
+        "'__builtin_shufflevector' requires two vectors and indices")};
+    }
+
+    const auto lhs = createExpr(ctx, scope, stmt_ctx, args[0]);
+    const auto rhs = createExpr(ctx, scope, stmt_ctx, args[1]);
+
+    if (!lhs.getType()->isVectorTy(ctx)
+        || !equals(ctx, lhs.getType(), rhs.getType())) {
+      throw CodegenError{
+        ctx.formatError(pos, "shuffled vectors must have the same type")};
+    }
+
+    const std::int64_t lanes = lhs.getType()->getVectorSize(ctx) * 2;
+
+    std::vector<int> mask;
+
+    for (auto it = args.begin() + 2; it != args.end(); ++it) {
+      const auto index = getIntegerLiteral(*it);
+
+      if (!index || *index < 0 || lanes <= *index) {
+        throw CodegenError{ctx.formatError(
+          pos,
+          fmt::format("index must be an integer literal from 0 to {}",
+                      lanes - 1))};
+      }
+
+      mask.push_back(static_cast<int>(*index));
+    }
+
+    if (!llvm::isPowerOf2_64(mask.size())) {
+      throw CodegenError{
+        ctx.formatError(pos, "the number of indices must be a power of 2")};
+    }
+
+    return {ctx.builder.CreateShuffleVector(lhs.getValue(),
+                                            rhs.getValue(),
+                                            mask),
+            std::make_shared<VectorType>(
+              lhs.getType()->getVectorElementType(ctx),
+              static_cast<std::uint32_t>(mask.size()),
+              false)};
+  }
+
+  // __builtin_select(mask, a, b)
+  // Lane-wise a if the mask is true, b otherwise
+  [[nodiscard]] Value createSelect(const Value&         mask,
+                                   const Value&         lhs,
+                                   const Value&         rhs,
+                                   const PositionRange& pos) const
+  {
+    if (!equals(ctx, lhs.getType(), rhs.getType())) {
+      throw CodegenError{
+        ctx.formatError(pos, "selected values must have the same type")};
+    }
+
+    if (!equals(ctx, mask.getType(), boolTypeOf(ctx, lhs))) {
+      throw CodegenError{ctx.formatError(
+        pos,
+        "the condition of a select must be a mask of the same size")};
+    }
+
+    return {
+      ctx.builder.CreateSelect(mask.getValue(), lhs.getValue(), rhs.getValue()),
+      lhs.getType()};
+  }
+
+  // __builtin_reduce_*(v)
+  // The order of floating point additions and multiplications is unspecified
+  [[nodiscard]] Value createReduce(const BuiltinFunctionKind kind,
+                                   const std::string_view    name,
+                                   const Value&              vector,
+                                   const PositionRange&      pos) const
+  {
+    if (!vector.getType()->isVectorTy(ctx)) {
+      throw CodegenError{
+        ctx.formatError(pos, fmt::format("'{}' requires a vector", name))};
+    }
+
+    const auto element_type = vector.getType()->getVectorElementType(ctx);
+
+    auto const llvm_element_type = element_type->getLLVMType(ctx);
+
+    auto const src = vector.getValue();
+
+    const auto is_fp     = element_type->isFloatingPointTy(ctx);
+    const auto is_signed = element_type->isSigned(ctx);
+
+    auto const reassoc = [](llvm::CallInst* const call) {
+      call->setHasAllowReassoc(true);
+      return call;
+    };
+
+    const auto bitwise_only = [&] {
+      if (is_fp) {
+        throw CodegenError{ctx.formatError(
+          pos,
+          fmt::format("'{}' requires integers or masks", name))};
+      }
+    };
+
+    llvm::Value* result;
+
+    switch (kind) {
+    case BuiltinFunctionKind::reduce_add:
+      if (is_fp) {
+        result = reassoc(ctx.builder.CreateFAddReduce(
+          llvm::ConstantFP::getNegativeZero(llvm_element_type),
+          src));
+      }
+      else
+        result = ctx.builder.CreateAddReduce(src);
+      break;
+
+    case BuiltinFunctionKind::reduce_mul:
+      if (is_fp) {
+        result = reassoc(ctx.builder.CreateFMulReduce(
+          llvm::ConstantFP::get(llvm_element_type, 1.0),
+          src));
+      }
+      else
+        result = ctx.builder.CreateMulReduce(src);
+      break;
+
+    case BuiltinFunctionKind::reduce_and:
+      bitwise_only();
+      result = ctx.builder.CreateAndReduce(src);
+      break;
+
+    case BuiltinFunctionKind::reduce_or:
+      bitwise_only();
+      result = ctx.builder.CreateOrReduce(src);
+      break;
+
+    case BuiltinFunctionKind::reduce_xor:
+      bitwise_only();
+      result = ctx.builder.CreateXorReduce(src);
+      break;
+
+    case BuiltinFunctionKind::reduce_min:
+      if (is_fp)
+        result = ctx.builder.CreateFPMinReduce(src);
+      else
+        result = ctx.builder.CreateIntMinReduce(src, is_signed);
+      break;
+
+    case BuiltinFunctionKind::reduce_max:
+      if (is_fp)
+        result = ctx.builder.CreateFPMaxReduce(src);
+      else
+        result = ctx.builder.CreateIntMaxReduce(src, is_signed);
+      break;
+
+    default:
+      unreachable();
+    }
+
+    return {result, element_type};
+  }
+
+  void verifyInteger(const std::string_view name,
+                     const Value&           value,
+                     const PositionRange&   pos) const
+  {
+    if (!value.getType()->isIntegerTy(ctx)) {
+      throw CodegenError{
+        ctx.formatError(pos, fmt::format("'{}' requires an integer", name))};
+    }
+  }
+
+  // __builtin_expect(v, expected)
+  // Returns v, telling the optimizer that v is usually the expected value
+  [[nodiscard]] Value createExpect(const Value&         value,
+                                   const Value&         expected,
+                                   const PositionRange& pos) const
+  {
+    auto const llvm_type = value.getLLVMType();
+
+    if (!llvm_type->isIntegerTy() || !expected.getLLVMType()->isIntegerTy()) {
+      throw CodegenError{ctx.formatError(
+        pos,
+        "'__builtin_expect' requires integers or bools")};
+    }
+
+    auto const expected_value
+      = ctx.builder.CreateIntCast(expected.getValue(),
+                                  llvm_type,
+                                  expected.getType()->isSigned(ctx));
+
+    return {ctx.builder.CreateIntrinsic(llvm::Intrinsic::expect,
+                                        {llvm_type},
+                                        {value.getValue(), expected_value}),
+            value.getType()};
+  }
+
+  // __builtin_prefetch(p), __builtin_prefetch(p, rw, locality)
+  // rw is 0 (read) or 1 (write), and locality is from 0 (no temporal
+  // locality) to 3 (keep in all levels of the cache), which defaults to 3
+  [[nodiscard]] Value createPrefetch(const std::deque<ast::Expr>& args,
+                                     const PositionRange&         pos) const
+  {
+    if (args.size() != 1 && args.size() != 3) {
+      throw CodegenError{ctx.formatError(
+        pos,
+        "'__builtin_prefetch' requires 1 or 3 arguments")};
+    }
+
+    const auto address = createExpr(ctx, scope, stmt_ctx, args.front());
+
+    if (!address.getLLVMType()->isPointerTy()) {
+      throw CodegenError{
+        ctx.formatError(pos, "'__builtin_prefetch' requires a pointer")};
+    }
+
+    std::int64_t rw       = 0;
+    std::int64_t locality = 3;
+
+    if (args.size() == 3) {
+      const auto rw_arg       = getIntegerLiteral(args[1]);
+      const auto locality_arg = getIntegerLiteral(args[2]);
+
+      if (!rw_arg || *rw_arg < 0 || 1 < *rw_arg) {
+        throw CodegenError{
+          ctx.formatError(pos, "rw must be an integer literal 0 or 1")};
+      }
+
+      if (!locality_arg || *locality_arg < 0 || 3 < *locality_arg) {
+        throw CodegenError{ctx.formatError(
+          pos,
+          "locality must be an integer literal from 0 to 3")};
+      }
+
+      rw       = *rw_arg;
+      locality = *locality_arg;
+    }
+
+    ctx.builder.CreateIntrinsic(
+      llvm::Intrinsic::prefetch,
+      {address.getLLVMType()},
+      {address.getValue(),
+       ctx.builder.getInt32(static_cast<std::uint32_t>(rw)),
+       ctx.builder.getInt32(static_cast<std::uint32_t>(locality)),
+       ctx.builder.getInt32(1) /* Data cache */});
+
+    return {nullptr,
+            std::make_shared<BuiltinType>(BuiltinTypeKind::void_, false)};
+  }
+
+  // __builtin_assume(cond)
+  // The behavior is undefined if cond is false
+  [[nodiscard]] Value createAssume(const Value&         cond_value,
+                                   const PositionRange& pos) const
+  {
+    if (!cond_value.getLLVMType()->isIntegerTy()
+        && !cond_value.getLLVMType()->isPointerTy()) {
+      throw CodegenError{
+        ctx.formatError(pos, "condition type is incompatible with bool")};
+    }
+
+    ctx.builder.CreateAssumption(ctx.builder.CreateICmp(
+      llvm::ICmpInst::ICMP_NE,
+      cond_value.getValue(),
+      llvm::Constant::getNullValue(cond_value.getLLVMType())));
+
+    return {nullptr,
+            std::make_shared<BuiltinType>(BuiltinTypeKind::void_, false)};
+  }
+
+  // __builtin_unreachable()
+  // The behavior is undefined if it is reached
+  [[nodiscard]] Value createUnreachable() const
+  {
+    ctx.builder.CreateUnreachable();
+
+    // The code following it is dead, but still has to be generated somewhere
+    ctx.builder.SetInsertPoint(
+      llvm::BasicBlock::Create(ctx.context,
+                               "unreachable_cont",
+                               ctx.builder.GetInsertBlock()->getParent()));
+
+    return {nullptr,
+            std::make_shared<BuiltinType>(BuiltinTypeKind::void_, false)};
+  }
+
+  // __builtin_popcount(x), __builtin_clz(x), __builtin_ctz(x),
+  // __builtin_bswap(x)
+  // Unlike C, these accept integers of any size. The counts are i32, and clz
+  // and ctz are undefined if x is 0
+  [[nodiscard]] Value createBitCount(const BuiltinFunctionKind kind,
+                                     const std::string_view    name,
+                                     const Value&              operand,
+                                     const PositionRange&      pos) const
+  {
+    verifyInteger(name, operand, pos);
+
+    auto const llvm_type = operand.getLLVMType();
+    auto const src       = operand.getValue();
+
+    llvm::Value* count;
+
+    switch (kind) {
+    case BuiltinFunctionKind::popcount:
+      count = ctx.builder.CreateUnaryIntrinsic(llvm::Intrinsic::ctpop, src);
+      break;
+
+    case BuiltinFunctionKind::clz:
+      count = ctx.builder.CreateBinaryIntrinsic(llvm::Intrinsic::ctlz,
+                                                src,
+                                                ctx.builder.getTrue());
+      break;
+
+    case BuiltinFunctionKind::ctz:
+      count = ctx.builder.CreateBinaryIntrinsic(llvm::Intrinsic::cttz,
+                                                src,
+                                                ctx.builder.getTrue());
+      break;
+
+    case BuiltinFunctionKind::bswap:
+      if (llvm_type->getIntegerBitWidth() % 16 != 0) {
+        throw CodegenError{ctx.formatError(
+          pos,
+          "'__builtin_bswap' requires an integer of 16 bits or more")};
+      }
+
+      return {ctx.builder.CreateUnaryIntrinsic(llvm::Intrinsic::bswap, src),
+              operand.getType()};
+
+    default:
+      unreachable();
+    }
+
+    return {ctx.builder.CreateIntCast(count, ctx.builder.getInt32Ty(), false),
+            std::make_shared<BuiltinType>(BuiltinTypeKind::i32, false)};
+  }
+
+  // __builtin_rotl(x, n), __builtin_rotr(x, n)
+  // n is taken modulo the bit width of x
+  [[nodiscard]] Value createRotate(const BuiltinFunctionKind kind,
+                                   const std::string_view    name,
+                                   const Value&              operand,
+                                   const Value&              amount,
+                                   const PositionRange&      pos) const
+  {
+    verifyInteger(name, operand, pos);
+    verifyInteger(name, amount, pos);
+
+    auto const src = operand.getValue();
+
+    // Rotations are funnel shifts of the same values
+    return {
+      ctx.builder.CreateIntrinsic(
+        kind == BuiltinFunctionKind::rotl ? llvm::Intrinsic::fshl
+                                          : llvm::Intrinsic::fshr,
+        {operand.getLLVMType()},
+        {src,
+         src,
+         ctx.builder.CreateIntCast(amount.getValue(),
+                                   operand.getLLVMType(),
+                                   false)}),
+      operand.getType()};
+  }
+
+  //===--------------------------------------------------------------------===//
+  // Atomic builtin functions
+  //===--------------------------------------------------------------------===//
+
+  // The memory order must be a constant such as __ATOMIC_SEQ_CST
+  [[nodiscard]] llvm::AtomicOrdering
+  getMemoryOrder(const ast::Expr& node, const PositionRange& pos) const
+  {
+    const auto order = llvm::dyn_cast<llvm::ConstantInt>(
+      createExpr(ctx, scope, stmt_ctx, node).getValue());
+
+    if (!order || 5 < order->getZExtValue()) {
+      throw CodegenError{ctx.formatError(
+        pos,
+        "memory order must be a constant from __ATOMIC_RELAXED to "
+        "__ATOMIC_SEQ_CST")};
+    }
+
+    // Consume is promoted to acquire as GCC and clang do
+    static constexpr std::array<llvm::AtomicOrdering, 6> orders{
+      llvm::AtomicOrdering::Monotonic,
+      llvm::AtomicOrdering::Acquire,
+      llvm::AtomicOrdering::Acquire,
+      llvm::AtomicOrdering::Release,
+      llvm::AtomicOrdering::AcquireRelease,
+      llvm::AtomicOrdering::SequentiallyConsistent,
+    };
+
+    return orders[order->getZExtValue()];
+  }
+
+  // Atomic operations access the pointee of the address, which must be an
+  // integer or a pointer
+  [[nodiscard]] Value createAtomicAddress(const ast::Expr&     node,
+                                          const PositionRange& pos) const
+  {
+    const auto address = createExpr(ctx, scope, stmt_ctx, node);
+
+    if (!address.getType()->isPointerTy(ctx)
+        || !address.getValue()->getType()->isPointerTy()) {
+      throw CodegenError{
+        ctx.formatError(pos, "atomic operations require a pointer")};
+    }
+
+    const auto pointee_type = address.getType()->getPointeeType(ctx);
+
+    if (!pointee_type->isIntegerTy(ctx) && !pointee_type->isPointerTy(ctx)) {
+      throw CodegenError{ctx.formatError(
+        pos,
+        "atomic operations require a pointer to an integer or a pointer")};
+    }
+
+    return address;
+  }
+
+  // Converts the operand to the pointee type of the address
+  [[nodiscard]] llvm::Value* createAtomicOperand(const Value&         address,
+                                                 const ast::Expr&     node,
+                                                 const PositionRange& pos) const
+  {
+    const auto type = address.getType()->getPointeeType(ctx);
+
+    const auto operand = createExpr(ctx, scope, stmt_ctx, node);
+
+    if (type->isIntegerTy(ctx) && operand.getType()->isIntegerTy(ctx))
+      return createCast(operand, type, pos).getValue();
+
+    if (type->isPointerTy(ctx) && operand.getType()->isPointerTy(ctx))
+      return createCast(operand, type, pos).getValue();
+
+    throw CodegenError{
+      ctx.formatError(pos, "incompatible type for the atomic operation")};
+  }
+
+  // Atomic accesses must be aligned to their size
+  [[nodiscard]] llvm::Align getAtomicAlign(llvm::Type* const type) const
+  {
+    return llvm::Align{
+      ctx.module->getDataLayout().getTypeStoreSize(type).getFixedSize()};
+  }
+
+  // __atomic_load_n(p, order)
+  [[nodiscard]] Value createAtomicLoad(const std::deque<ast::Expr>& args,
+                                       const PositionRange&         pos) const
+  {
+    const auto address = createAtomicAddress(args[0], pos);
+    const auto order   = getMemoryOrder(args[1], pos);
+
+    if (order == llvm::AtomicOrdering::Release
+        || order == llvm::AtomicOrdering::AcquireRelease) {
+      throw CodegenError{
+        ctx.formatError(pos, "invalid memory order for an atomic load")};
+    }
+
+    const auto type = address.getType()->getPointeeType(ctx);
+
+    auto const llvm_type = type->getLLVMType(ctx);
+
+    auto const load = ctx.builder.CreateAlignedLoad(llvm_type,
+                                                    address.getValue(),
+                                                    getAtomicAlign(llvm_type));
+    load->setAtomic(order);
+
+    return {load, type};
+  }
+
+  // __atomic_store_n(p, v, order)
+  [[nodiscard]] Value createAtomicStore(const std::deque<ast::Expr>& args,
+                                        const PositionRange&         pos) const
+  {
+    const auto address = createAtomicAddress(args[0], pos);
+    auto const value   = createAtomicOperand(address, args[1], pos);
+    const auto order   = getMemoryOrder(args[2], pos);
+
+    if (order == llvm::AtomicOrdering::Acquire
+        || order == llvm::AtomicOrdering::AcquireRelease) {
+      throw CodegenError{
+        ctx.formatError(pos, "invalid memory order for an atomic store")};
+    }
+
+    auto const store
+      = ctx.builder.CreateAlignedStore(value,
+                                       address.getValue(),
+                                       getAtomicAlign(value->getType()));
+    store->setAtomic(order);
+
+    return {nullptr,
+            std::make_shared<BuiltinType>(BuiltinTypeKind::void_, false)};
+  }
+
+  // __atomic_exchange_n(p, v, order)
+  // Returns the previous value
+  [[nodiscard]] Value createAtomicExchange(const std::deque<ast::Expr>& args,
+                                           const PositionRange& pos) const
+  {
+    const auto address = createAtomicAddress(args[0], pos);
+    auto const value   = createAtomicOperand(address, args[1], pos);
+    const auto order   = getMemoryOrder(args[2], pos);
+
+    const auto type = address.getType()->getPointeeType(ctx);
+
+    // atomicrmw does not take pointers, so they are exchanged as integers
+    if (type->isPointerTy(ctx)) {
+      auto const int_type
+        = ctx.builder.getIntPtrTy(ctx.module->getDataLayout());
+
+      auto const result = ctx.builder.CreateAtomicRMW(
+        llvm::AtomicRMWInst::Xchg,
+        ctx.builder.CreatePointerCast(address.getValue(),
+                                      int_type->getPointerTo()),
+        ctx.builder.CreatePtrToInt(value, int_type),
+        getAtomicAlign(int_type),
+        order);
+
+      return {ctx.builder.CreateIntToPtr(result, value->getType()), type};
+    }
+
+    return {ctx.builder.CreateAtomicRMW(llvm::AtomicRMWInst::Xchg,
+                                        address.getValue(),
+                                        value,
+                                        getAtomicAlign(value->getType()),
+                                        order),
+            type};
+  }
+
+  // __atomic_compare_exchange_n(p, expected, desired, weak, success, failure)
+  // If *p is *expected, desired is written to *p and true is returned.
+  // Otherwise, *p is written to *expected and false is returned. If weak is
+  // true, it may fail even if they are equal
+  [[nodiscard]] Value createAtomicCmpXchg(const std::deque<ast::Expr>& args,
+                                          const PositionRange& pos) const
+  {
+    const auto address  = createAtomicAddress(args[0], pos);
+    const auto expected = createAtomicAddress(args[1], pos);
+    auto const desired  = createAtomicOperand(address, args[2], pos);
+
+    // Boolean literals are loaded from allocas, so weak is read from the AST
+    const auto weak = boost::get<bool>(&args[3]);
+
+    if (!weak) {
+      throw CodegenError{
+        ctx.formatError(pos, "weak must be a boolean literal")};
+    }
+
+    const auto success = getMemoryOrder(args[4], pos);
+    const auto failure = getMemoryOrder(args[5], pos);
+
+    if (failure == llvm::AtomicOrdering::Release
+        || failure == llvm::AtomicOrdering::AcquireRelease) {
+      throw CodegenError{
+        ctx.formatError(pos, "invalid memory order for a failed exchange")};
+    }
+
+    const auto type = address.getType()->getPointeeType(ctx);
+
+    if (!equals(ctx, type, expected.getType()->getPointeeType(ctx))) {
+      throw CodegenError{ctx.formatError(
+        pos,
+        "the expected value must have the same type as the atomic value")};
+    }
+
+    auto const llvm_type = type->getLLVMType(ctx);
+
+    auto const cmpxchg = ctx.builder.CreateAtomicCmpXchg(
+      address.getValue(),
+      ctx.builder.CreateLoad(llvm_type, expected.getValue()),
+      desired,
+      getAtomicAlign(llvm_type),
+      success,
+      failure);
+    cmpxchg->setWeak(*weak);
+
+    // On success, the value is the same as the expected value
+    ctx.builder.CreateStore(ctx.builder.CreateExtractValue(cmpxchg, 0),
+                            expected.getValue());
+
+    return {ctx.builder.CreateExtractValue(cmpxchg, 1),
+            std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false)};
+  }
+
+  // __atomic_fetch_*(p, v, order)
+  // Returns the previous value
+  [[nodiscard]] Value createAtomicFetchOp(const BuiltinFunctionKind    kind,
+                                          const std::string_view       name,
+                                          const std::deque<ast::Expr>& args,
+                                          const PositionRange& pos) const
+  {
+    const auto address = createAtomicAddress(args[0], pos);
+
+    const auto type = address.getType()->getPointeeType(ctx);
+
+    if (!type->isIntegerTy(ctx)) {
+      throw CodegenError{ctx.formatError(
+        pos,
+        fmt::format("'{}' requires a pointer to an integer", name))};
+    }
+
+    auto const value = createAtomicOperand(address, args[1], pos);
+    const auto order = getMemoryOrder(args[2], pos);
+
+    const auto is_signed = type->isSigned(ctx);
+
+    llvm::AtomicRMWInst::BinOp op;
+
+    switch (kind) {
+    case BuiltinFunctionKind::atomic_fetch_add:
+      op = llvm::AtomicRMWInst::Add;
+      break;
+    case BuiltinFunctionKind::atomic_fetch_sub:
+      op = llvm::AtomicRMWInst::Sub;
+      break;
+    case BuiltinFunctionKind::atomic_fetch_and:
+      op = llvm::AtomicRMWInst::And;
+      break;
+    case BuiltinFunctionKind::atomic_fetch_or:
+      op = llvm::AtomicRMWInst::Or;
+      break;
+    case BuiltinFunctionKind::atomic_fetch_xor:
+      op = llvm::AtomicRMWInst::Xor;
+      break;
+    case BuiltinFunctionKind::atomic_fetch_nand:
+      op = llvm::AtomicRMWInst::Nand;
+      break;
+    case BuiltinFunctionKind::atomic_fetch_min:
+      op = is_signed ? llvm::AtomicRMWInst::Min : llvm::AtomicRMWInst::UMin;
+      break;
+    case BuiltinFunctionKind::atomic_fetch_max:
+      op = is_signed ? llvm::AtomicRMWInst::Max : llvm::AtomicRMWInst::UMax;
+      break;
+    default:
+      unreachable();
+    }
+
+    return {ctx.builder.CreateAtomicRMW(op,
+                                        address.getValue(),
+                                        value,
+                                        getAtomicAlign(value->getType()),
+                                        order),
+            type};
+  }
+
+  // Returns the coroutine of the async function being generated
+  [[nodiscard]] const Coroutine&
+  getCurrentCoroutine(const std::string_view name,
+                      const PositionRange&   pos) const
+  {
+    const auto coroutine
+      = findCoroutine(ctx, ctx.builder.GetInsertBlock()->getParent());
+
+    if (!coroutine) {
+      throw CodegenError{ctx.formatError(
+        pos,
+        fmt::format("'{}' can only be used in async functions", name))};
+    }
+
+    return *coroutine;
+  }
+
+  // __builtin_async_yield()
+  // The coroutine is scheduled after the others already scheduled
+  [[nodiscard]] Value createAsyncYield(const std::string_view name,
+                                       const PositionRange&   pos) const
+  {
+    const auto& coroutine = getCurrentCoroutine(name, pos);
+
+    ctx.builder.CreateCall(
+      ctx.module->getOrInsertFunction("__twinkle_async_schedule",
+                                      ctx.builder.getVoidTy(),
+                                      ctx.builder.getInt8PtrTy()),
+      {coroutine.handle});
+
+    createSuspend(ctx, coroutine);
+
+    return {nullptr,
+            std::make_shared<BuiltinType>(BuiltinTypeKind::void_, false)};
+  }
+
+  // __builtin_async_wait_fd(fd, events)
+  // The coroutine is resumed when one of the events of poll(2) occurs on the
+  // file descriptor
+  [[nodiscard]] Value
+  createAsyncWaitFd(const std::string_view       name,
+                    const std::deque<ast::Expr>& args,
+                    const PositionRange&         pos) const
+  {
+    const auto& coroutine = getCurrentCoroutine(name, pos);
+
+    const auto createIntegerArg = [&](const ast::Expr&      arg,
+                                      const BuiltinTypeKind kind) {
+      const auto value = createExpr(ctx, scope, stmt_ctx, arg);
+
+      if (!value.getType()->isIntegerTy(ctx)) {
+        throw CodegenError{ctx.formatError(
+          pos,
+          fmt::format("'{}' requires integer arguments", name))};
+      }
+
+      return createCast(value, std::make_shared<BuiltinType>(kind, false), pos)
+        .getValue();
+    };
+
+    auto const fd     = createIntegerArg(args[0], BuiltinTypeKind::i32);
+    auto const events = createIntegerArg(args[1], BuiltinTypeKind::i16);
+
+    ctx.builder.CreateCall(
+      ctx.module->getOrInsertFunction("__twinkle_async_wait_fd",
+                                      ctx.builder.getVoidTy(),
+                                      ctx.builder.getInt8PtrTy(),
+                                      ctx.builder.getInt32Ty(),
+                                      ctx.builder.getInt16Ty()),
+      {coroutine.handle, fd, events});
+
+    createSuspend(ctx, coroutine);
+
+    return {nullptr,
+            std::make_shared<BuiltinType>(BuiltinTypeKind::void_, false)};
+  }
+
+  [[nodiscard]] std::shared_ptr<Variable>
+  findVariable(const ast::Identifier& node) const
+  {
+    const auto ident = node.utf8();
+
+    if (const auto variable = scope[ident])
+      return *variable;
+
+    return nullptr;
+  }
+
+  // Find a member of '*this'
+  // If not found, std::nullopt is returned
+  [[nodiscard]] std::optional<Value>
+  findMemberOfThis(const ast::Identifier& node) const
+  {
+    if (scope["this"]) {
+      const auto this_p
+        = findVariable(ast::Identifier{std::u32string{U"this"}});
+
+      if (!this_p)
+        return std::nullopt;
+
+      const auto this_value
+        = createDereference(ctx, ctx.positionOf(node), this_p);
+
+      return memberVariableAccess(this_value, node, false);
+    }
+
+    return std::nullopt;
+  }
+
+  [[nodiscard]] bool isPointerArithmetic(const Value& lhs,
+                                         const Value& rhs) const
+  {
+    return lhs.getType()->isPointerTy(ctx) && rhs.getType()->isIntegerTy(ctx);
+  }
+
+  [[nodiscard]] std::pair<Value, Value> implicitConv(const Value& lhs,
+                                                     const Value& rhs) const
+  {
+    // Pointer arithmetics are exceptions
+    if (isPointerArithmetic(lhs, rhs))
+      return std::make_pair(lhs, rhs);
+
+    return unifySign(unifyBitWidth(lhs, rhs));
+  }
+
+  [[nodiscard]] std::pair<Value, Value>
+  implicitConv(const std::pair<Value, Value>& operands) const
+  {
+    return implicitConv(operands.first, operands.second);
+  }
+
+  // If one of the operands is a vector and the other is a scalar, broadcast
+  // the scalar to all lanes
+  [[nodiscard]] std::pair<Value, Value>
+  splatScalar(const std::pair<Value, Value>& operands,
+              const PositionRange&           pos) const
+  {
+    const auto& [lhs, rhs] = operands;
+
+    const auto splat = [&](const Value& scalar, const Value& vector) {
+      auto const scalar_type = scalar.getLLVMType();
+
+      // Leave it to the type check
+      if (!scalar_type->isIntegerTy() && !scalar_type->isFloatingPointTy())
+        return scalar;
+
+      const auto lane = createCast(scalar,
+                                   vector.getType()->getVectorElementType(ctx),
+                                   pos);
+
+      return Value{
+        ctx.builder.CreateVectorSplat(vector.getType()->getVectorSize(ctx),
+                                      lane.getValue()),
+        vector.getType()};
+    };
+
+    if (lhs.getType()->isVectorTy(ctx) && !rhs.getType()->isVectorTy(ctx))
+      return std::make_pair(lhs, splat(rhs, lhs));
+
+    if (!lhs.getType()->isVectorTy(ctx) && rhs.getType()->isVectorTy(ctx))
+      return std::make_pair(splat(lhs, rhs), rhs);
+
+    return operands;
+  }
+
+  // For Integer
+  [[nodiscard]] std::pair<Value, Value> toLargerBitWidth(const Value& lhs,
+                                                         const Value& rhs) const
+  {
+    if (const auto lhs_bitwidth = lhs.getLLVMType()->getIntegerBitWidth(),
+        rhs_bitwidth            = rhs.getLLVMType()->getIntegerBitWidth();
+        lhs_bitwidth != rhs_bitwidth) {
+      const auto larger_bitwidth = std::max(lhs_bitwidth, rhs_bitwidth);
+
+      const auto is_target_lhs = lhs_bitwidth == larger_bitwidth;
+
+      const auto target_type = is_target_lhs ? lhs.getType() : rhs.getType();
+
+      if (is_target_lhs) {
+        return std::make_pair(
+          lhs,
+          Value{ctx.builder.CreateIntCast(rhs.getValue(),
+                                          lhs.getLLVMType(),
+                                          target_type->isSigned(ctx)),
+                target_type});
+      }
+      else {
+        return std::make_pair(
+          Value{ctx.builder.CreateIntCast(lhs.getValue(),
+                                          rhs.getLLVMType(),
+                                          target_type->isSigned(ctx)),
+                target_type},
+          rhs);
+      }
+    }
+
+    return std::make_pair(lhs, rhs);
+  }
+
+  // For floating point number
+  [[nodiscard]] std::pair<Value, Value>
+  toLargerMantissaWidth(const Value& lhs, const Value& rhs) const
+  {
+    if (const auto lhs_mantissaw = lhs.getLLVMType()->getFPMantissaWidth(),
+        rhs_mantissaw            = rhs.getLLVMType()->getFPMantissaWidth();
+        lhs_mantissaw != rhs_mantissaw) {
+      const auto larger_mantissaw = std::max(lhs_mantissaw, rhs_mantissaw);
+
+      const auto is_target_lhs = lhs_mantissaw == larger_mantissaw;
+
+      const auto target_type = is_target_lhs ? lhs.getType() : rhs.getType();
 
       if (is_target_lhs) {
         return std::make_pair(
@@ -1395,20 +2689,39 @@ private:
     return {gep, ptr.getType()->getPointeeType(ctx)};
   }
 
-  // Normally a subscript operation calls createLoad at the end, but this
-  // function does not.
-  [[nodiscard]] Value createNoLoadSubscript(const ast::Subscript& node) const
+  // Lanes of vectors in memory are laid out like arrays, except for masks
+  // whose lanes are bits
+  [[nodiscard]] bool hasAddressableLanes(const Value& vector) const
   {
-    auto lhs = createExpr(ctx, scope, stmt_ctx, node.lhs);
+    return llvm::getPointerOperand(vector.getValue())
+           && !vector.getType()
+                 ->getVectorElementType(ctx)
+                 ->getLLVMType(ctx)
+                 ->isIntegerTy(1);
+  }
 
-    const auto is_array = lhs.getType()->isArrayTy(ctx);
+  [[nodiscard]] Value createVectorSubscript(const Value& vector,
+                                            const Value& index) const
+  {
+    assert(hasAddressableLanes(vector));
 
-    if (!is_array && !lhs.getType()->isPointerTy(ctx)) {
-      throw CodegenError{
-        ctx.formatError(ctx.positionOf(node),
-                        "the type incompatible with the subscript operator")};
-    }
+    const auto element_type = vector.getType()->getVectorElementType(ctx);
 
+    auto const p_to_element = ctx.builder.CreateBitCast(
+      llvm::getPointerOperand(vector.getValue()),
+      llvm::PointerType::getUnqual(element_type->getLLVMType(ctx)));
+
+    // Calculate the address of the index-th lane
+    auto const gep
+      = ctx.builder.CreateInBoundsGEP(element_type->getLLVMType(ctx),
+                                      p_to_element,
+                                      index.getValue());
+
+    return {gep, element_type};
+  }
+
+  [[nodiscard]] Value createIndex(const ast::Subscript& node) const
+  {
     const auto index = createExpr(ctx, scope, stmt_ctx, node.subscript);
 
     if (!index.getValue()->getType()->isIntegerTy()) {
@@ -1417,25 +2730,141 @@ private:
                         "subscripts need to be evaluated to numbers")};
     }
 
+    return index;
+  }
+
+  // Normally a subscript operation calls createLoad at the end, but this
+  // function does not.
+  [[nodiscard]] Value createNoLoadSubscript(const Value&          lhs,
+                                            const ast::Subscript& node) const
+  {
+    const auto is_array  = lhs.getType()->isArrayTy(ctx);
+    const auto is_vector = lhs.getType()->isVectorTy(ctx);
+
+    if (!is_array && !is_vector && !lhs.getType()->isPointerTy(ctx)) {
+      throw CodegenError{
+        ctx.formatError(ctx.positionOf(node),
+                        "the type incompatible with the subscript operator")};
+    }
+
+    const auto index = createIndex(node);
+
+    if (is_vector)
+      return createVectorSubscript(lhs, index);
+
     return is_array ? createArraySubscript(lhs, index)
                     : createPointerSubscript(lhs, index);
   }
 
+  [[nodiscard]] Value createCast(const Value&                 lhs,
+                                 const std::shared_ptr<Type>& as,
+                                 const PositionRange&         pos) const
+  {
+    if (as->isVectorTy(ctx) || lhs.getType()->isVectorTy(ctx))
+      return createVectorCast(lhs, as, pos);
+
+    if (as->isPointerTy(ctx)) {
+      // Pointer to pointer
+      return {
+        ctx.builder.CreatePointerCast(lhs.getValue(), as->getLLVMType(ctx)),
+        as};
+    }
+
+    if (as->isFloatingPointTy(ctx)) {
+      if (lhs.getType()->isIntegerTy(ctx)) {
+        const auto cast_op = lhs.getType()->isSigned(ctx)
+                               ? llvm::CastInst::CastOps::SIToFP
+                               : llvm::CastInst::CastOps::UIToFP;
+
+        return {
+          ctx.builder.CreateCast(cast_op, lhs.getValue(), as->getLLVMType(ctx)),
+          as};
+      }
+
+      // Floating point number to floating point number
+      return {ctx.builder.CreateFPCast(lhs.getValue(), as->getLLVMType(ctx)),
+              as};
+    }
+
+    if (as->getLLVMType(ctx)->isIntegerTy()) {
+      if (lhs.getType()->isFloatingPointTy(ctx)) {
+        // Floating point number to integer
+        const auto cast_op = as->isSigned(ctx)
+                               ? llvm::CastInst::CastOps::FPToSI
+                               : llvm::CastInst::CastOps::FPToUI;
+
+        return {
+          ctx.builder.CreateCast(cast_op, lhs.getValue(), as->getLLVMType(ctx)),
+          as};
+      }
+
+      // Integer to integer
+      return {ctx.builder.CreateIntCast(lhs.getValue(),
+                                        as->getLLVMType(ctx),
+                                        as->isSigned(ctx)),
+              as};
+    }
+
+    throw CodegenError{ctx.formatError(pos, "non-convertible type")};
+  }
+
+  // Element-wise conversion
+  [[nodiscard]] Value createVectorCast(const Value&                 lhs,
+                                       const std::shared_ptr<Type>& as,
+                                       const PositionRange&         pos) const
+  {
+    if (!as->isVectorTy(ctx) || !lhs.getType()->isVectorTy(ctx)
+        || as->getVectorSize(ctx) != lhs.getType()->getVectorSize(ctx)) {
+      throw CodegenError{ctx.formatError(
+        pos,
+        "vectors can only be converted to vectors of the same size")};
+    }
+
+    const auto from = lhs.getType()->getVectorElementType(ctx);
+    const auto to   = as->getVectorElementType(ctx);
+
+    auto const dest_type = as->getLLVMType(ctx);
+
+    if (to->isFloatingPointTy(ctx)) {
+      if (from->isFloatingPointTy(ctx))
+        return {ctx.builder.CreateFPCast(lhs.getValue(), dest_type), as};
+
+      const auto cast_op = from->isSigned(ctx)
+                             ? llvm::CastInst::CastOps::SIToFP
+                             : llvm::CastInst::CastOps::UIToFP;
+
+      return {ctx.builder.CreateCast(cast_op, lhs.getValue(), dest_type), as};
+    }
+
+    if (from->isFloatingPointTy(ctx)) {
+      const auto cast_op = to->isSigned(ctx) ? llvm::CastInst::CastOps::FPToSI
+                                             : llvm::CastInst::CastOps::FPToUI;
+
+      return {ctx.builder.CreateCast(cast_op, lhs.getValue(), dest_type), as};
+    }
+
+    return {ctx.builder.CreateIntCast(lhs.getValue(),
+                                      dest_type,
+                                      from->isSigned(ctx)),
+            as};
+  }
+
   [[nodiscard]] Value createLogicalNot(const Value& value) const
   {
-    if (value.getType()->isFloatingPointTy(ctx)) {
+    // Element-wise for vectors
+    if (value.getLLVMType()->isFPOrFPVectorTy()) {
       return {
         ctx.builder.CreateFCmp(llvm::ICmpInst::FCMP_OEQ,
                                value.getValue(),
                                llvm::ConstantFP::get(value.getLLVMType(), 0)),
-        std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false)};
+        boolTypeOf(ctx, value)};
     }
 
     return {
       ctx.builder.CreateICmp(llvm::ICmpInst::ICMP_EQ,
                              value.getValue(),
                              llvm::ConstantInt::get(value.getLLVMType(), 0)),
-      std::make_shared<BuiltinType>(BuiltinTypeKind::bool_, false)};
+      boolTypeOf(ctx, value)};
   }
 
   [[nodiscard]] Value createSizeOf(llvm::Type* const type) const
@@ -1496,8 +2925,10 @@ private:
   {
     std::deque<Value> args;
 
-    for (const auto& r : exprs)
+    for (const auto& r : exprs) {
       args.push_back(boost::apply_visitor(*this, r));
+      verifyFutureMove(ctx, r, args.back(), pos);
+    }
 
     return args;
   }
@@ -1508,8 +2939,10 @@ private:
   {
     std::deque<Value> args;
 
-    for (const auto& r : exprs)
+    for (const auto& r : exprs) {
       args.push_back(boost::apply_visitor(*this, r));
+      verifyFutureMove(ctx, r, args.back(), pos);
+    }
 
     return args;
   }
@@ -1721,4 +3154,16 @@ private:
   return boost::apply_visitor(ExprVisitor{ctx, scope, stmt_ctx}, expr);
 }
 
+[[nodiscard]] std::pair<Value, Value>
+splatScalar(CGContext&                     ctx,
+            const std::pair<Value, Value>& operands,
+            const PositionRange&           pos)
+{
+  // Casts of scalars do not refer to the symbols and the statement
+  const SymbolTable scope;
+  const StmtContext stmt_ctx{nullptr, nullptr, nullptr, nullptr, nullptr};
+
+  return ExprVisitor{ctx, scope, stmt_ctx}.splatScalar(operands, pos);
+}
+
 } // namespace twinkle::codegen
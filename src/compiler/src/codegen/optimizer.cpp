@@ -0,0 +1,299 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#include <twinkle/codegen/optimizer.hpp>
+#include <twinkle/support/utils.hpp>
+
+namespace
+{
+
+[[nodiscard]] llvm::PipelineTuningOptions
+createTuningOptions(const twinkle::codegen::OptimizationOptions& options)
+{
+  llvm::PipelineTuningOptions pto;
+
+  // Same as clang, loops are vectorized at -O2, -O3 and -Os, and SLP
+  // vectorization is also done at -Oz
+  pto.LoopVectorization = 1 < options.opt_level && options.size_level < 2;
+  pto.SLPVectorization  = 1 < options.opt_level;
+
+  return pto;
+}
+
+[[nodiscard]] llvm::Optional<llvm::PGOOptions>
+getPGOOptions(const twinkle::codegen::OptimizationOptions& options)
+{
+  if (options.profile_generate) {
+    return llvm::PGOOptions{*options.profile_generate,
+                            "",
+                            "",
+                            llvm::PGOOptions::IRInstr};
+  }
+
+  if (options.profile_use) {
+    return llvm::PGOOptions{*options.profile_use,
+                            "",
+                            "",
+                            llvm::PGOOptions::IRUse};
+  }
+
+  if (options.profile_sample_use) {
+    return llvm::PGOOptions{*options.profile_sample_use,
+                            "",
+                            "",
+                            llvm::PGOOptions::SampleUse,
+                            llvm::PGOOptions::NoCSAction,
+                            /* DebugInfoForProfiling */ true};
+  }
+
+  return llvm::None;
+}
+
+// Async functions must be split before code generation, but only the default
+// pipelines contain the coroutine passes, so they are added after the
+// pipelines given by --passes
+// They do nothing for the modules without coroutines, or whose coroutines
+// have been split
+void addCoroutinePasses(llvm::ModulePassManager& mpm)
+{
+  mpm.addPass(llvm::createModuleToFunctionPassAdaptor(llvm::CoroEarlyPass{}));
+  mpm.addPass(
+    llvm::createModuleToPostOrderCGSCCPassAdaptor(llvm::CoroSplitPass{}));
+  mpm.addPass(llvm::createModuleToFunctionPassAdaptor(llvm::CoroCleanupPass{}));
+}
+
+// Returns true if a loop of the module has the unroll_and_jam attribute
+[[nodiscard]] bool hasUnrollAndJamHint(const llvm::Module& module)
+{
+  for (const auto& func : module) {
+    for (const auto& bb : func) {
+      auto const terminator = bb.getTerminator();
+
+      auto const loop_id
+        = terminator ? terminator->getMetadata(llvm::LLVMContext::MD_loop)
+                     : nullptr;
+
+      if (!loop_id)
+        continue;
+
+      if (llvm::findOptionMDForLoopID(loop_id,
+                                      "llvm.loop.unroll_and_jam.enable")
+          || llvm::findOptionMDForLoopID(loop_id,
+                                         "llvm.loop.unroll_and_jam.count"))
+        return true;
+    }
+  }
+
+  return false;
+}
+
+// Analysis managers registered with a pass builder
+// The pass builder must outlive this
+struct AnalysisManagers {
+  explicit AnalysisManagers(llvm::PassBuilder& pb)
+  {
+    pb.registerModuleAnalyses(mam);
+    pb.registerCGSCCAnalyses(cgam);
+    pb.registerFunctionAnalyses(fam);
+    pb.registerLoopAnalyses(lam);
+    pb.crossRegisterProxies(lam, fam, cgam, mam);
+  }
+
+  // Destroyed in reverse order, since they refer to each other
+  llvm::LoopAnalysisManager     lam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::CGSCCAnalysisManager    cgam;
+  llvm::ModuleAnalysisManager   mam;
+};
+
+} // namespace
+
+namespace twinkle::codegen
+{
+
+[[nodiscard]] llvm::OptimizationLevel
+getOptimizationLevel(const OptimizationOptions& options)
+{
+  switch (options.size_level) {
+  case 1:
+    return llvm::OptimizationLevel::Os;
+  case 2:
+    return llvm::OptimizationLevel::Oz;
+  }
+
+  switch (options.opt_level) {
+  case 0:
+    return llvm::OptimizationLevel::O0;
+  case 1:
+    return llvm::OptimizationLevel::O1;
+  case 2:
+    return llvm::OptimizationLevel::O2;
+  case 3:
+    return llvm::OptimizationLevel::O3;
+  default:
+    unreachable();
+  }
+}
+
+[[nodiscard]] llvm::Error
+verifyPassPipeline(const std::string&   passes,
+                   llvm::TargetMachine* target_machine)
+{
+  llvm::PassBuilder pb{target_machine};
+
+  llvm::ModulePassManager mpm;
+
+  return pb.parsePassPipeline(mpm, passes);
+}
+
+[[nodiscard]] llvm::Error verifyProfile(const std::string& profile)
+{
+  return llvm::IndexedInstrProfReader::create(profile).takeError();
+}
+
+[[nodiscard]] llvm::Error verifySampleProfile(const std::string& profile)
+{
+  llvm::LLVMContext context;
+
+  auto reader = llvm::sampleprof::SampleProfileReader::create(profile, context);
+
+  if (!reader)
+    return llvm::errorCodeToError(reader.getError());
+
+  return llvm::errorCodeToError((*reader)->read());
+}
+
+[[nodiscard]] llvm::Error
+optimizeModule(llvm::Module&              module,
+               llvm::TargetMachine*       target_machine,
+               const OptimizationOptions& options)
+{
+  llvm::PassBuilder pb{target_machine,
+                       createTuningOptions(options),
+                       getPGOOptions(options)};
+
+  // The sample profile loader only reads the profiles of the functions with
+  // this attribute
+  if (options.profile_sample_use) {
+    for (auto& func : module) {
+      if (!func.isDeclaration())
+        func.addFnAttr("use-sample-profile");
+    }
+  }
+
+  // With a profile, the cold regions of functions are outlined, so that the
+  // hot code is packed together
+  if (options.profile_use || options.profile_sample_use) {
+    pb.registerOptimizerLastEPCallback(
+      [](llvm::ModulePassManager& mpm, const llvm::OptimizationLevel level) {
+        if (level != llvm::OptimizationLevel::O0)
+          mpm.addPass(llvm::HotColdSplittingPass{});
+      });
+  }
+
+  // Unroll and jam is not a part of the default pipelines, so it is added if
+  // the module has loops with unroll_and_jam attribute
+  // The pass also transforms the other loops of the module if the target
+  // enables it by default
+  if (hasUnrollAndJamHint(module)) {
+    pb.registerVectorizerStartEPCallback(
+      [](llvm::FunctionPassManager& fpm, const llvm::OptimizationLevel level) {
+        fpm.addPass(
+          llvm::createFunctionToLoopPassAdaptor(llvm::LoopUnrollAndJamPass{
+            static_cast<int>(level.getSpeedupLevel())}));
+      });
+  }
+
+  AnalysisManagers analyses{pb};
+
+  llvm::ModulePassManager mpm;
+
+  if (options.passes) {
+    if (auto err = pb.parsePassPipeline(mpm, *options.passes))
+      return err;
+
+    addCoroutinePasses(mpm);
+  }
+  else if (const auto level = getOptimizationLevel(options);
+           level == llvm::OptimizationLevel::O0) {
+    // Functions marked always_inline are inlined even at -O0
+    mpm = pb.buildO0DefaultPipeline(level);
+  }
+  else
+    mpm = pb.buildPerModuleDefaultPipeline(level);
+
+  mpm.run(module, analyses.mam);
+
+  return llvm::Error::success();
+}
+
+[[nodiscard]] llvm::Error
+optimizeLTOModule(llvm::Module&              module,
+                  llvm::TargetMachine*       target_machine,
+                  const OptimizationOptions& options,
+                  MustPreserveGlobal&&       must_preserve)
+{
+  // Profiles have been used or instrumented before linking
+  llvm::PassBuilder pb{target_machine, createTuningOptions(options)};
+
+  AnalysisManagers analyses{pb};
+
+  llvm::ModulePassManager mpm;
+
+  mpm.addPass(llvm::InternalizePass{std::move(must_preserve)});
+
+  // Each module has been optimized and its coroutines split before linking
+  // The LTO pipeline has no coroutine passes, so they are run again in case
+  // any coroutine is left
+  addCoroutinePasses(mpm);
+
+  if (options.passes) {
+    if (auto err = pb.parsePassPipeline(mpm, *options.passes))
+      return err;
+  }
+  else
+    mpm.addPass(pb.buildLTODefaultPipeline(getOptimizationLevel(options),
+                                           nullptr));
+
+  mpm.run(module, analyses.mam);
+
+  return llvm::Error::success();
+}
+
+FunctionSimplifier::FunctionSimplifier(const bool enabled)
+  : enabled{enabled}
+{
+  if (!enabled)
+    return;
+
+  pass_builder.registerModuleAnalyses(mam);
+  pass_builder.registerCGSCCAnalyses(cgam);
+  pass_builder.registerFunctionAnalyses(fam);
+  pass_builder.registerLoopAnalyses(lam);
+  pass_builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+  // Same passes as the function pass manager of the legacy
+  // PassManagerBuilder
+  fpm.addPass(llvm::SimplifyCFGPass{});
+  fpm.addPass(llvm::SROAPass{});
+  fpm.addPass(llvm::EarlyCSEPass{});
+  fpm.addPass(llvm::LowerExpectIntrinsicPass{});
+}
+
+void FunctionSimplifier::run(llvm::Function& func)
+{
+  if (!enabled)
+    return;
+
+  fpm.run(func, fam);
+
+  // Code generation goes on after this, so the analyses of the function must
+  // not be reused
+  fam.clear(func, func.getName());
+}
+
+} // namespace twinkle::codegen
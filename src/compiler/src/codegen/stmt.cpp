@@ -25,6 +25,382 @@ namespace twinkle::codegen
   return merged_table;
 }
 
+//===----------------------------------------------------------------------===//
+// Loop attributes
+//===----------------------------------------------------------------------===//
+
+enum class LoopAttrKind {
+  unknown,
+  unroll,         // [[unroll]], [[unroll(8)]]
+  no_unroll,      // [[no_unroll]]
+  unroll_and_jam, // [[unroll_and_jam]], [[unroll_and_jam(4)]]
+  vectorize,      // [[vectorize]], [[vectorize(width: 8, interleave: 2)]]
+  no_vectorize,   // [[no_vectorize]]
+  distribute,     // [[distribute]]
+};
+
+[[nodiscard]] static LoopAttrKind matchLoopAttr(const std::u32string_view attr)
+{
+  static const std::unordered_map<std::u32string_view, LoopAttrKind> attr_map{
+    {        U"unroll",         LoopAttrKind::unroll},
+    {     U"no_unroll",      LoopAttrKind::no_unroll},
+    {U"unroll_and_jam", LoopAttrKind::unroll_and_jam},
+    {     U"vectorize",      LoopAttrKind::vectorize},
+    {  U"no_vectorize",   LoopAttrKind::no_vectorize},
+    {    U"distribute",     LoopAttrKind::distribute},
+  };
+
+  const auto it = attr_map.find(attr);
+
+  if (it == attr_map.end())
+    return LoopAttrKind::unknown;
+
+  return it->second;
+}
+
+// Returns the arguments by name, where the unnamed argument has an empty name
+// Every argument must be a positive integer with one of the names
+[[nodiscard]] static std::unordered_map<std::string, std::uint32_t>
+getLoopAttrArgs(const CGContext&                       ctx,
+                const ast::Attr&                       attr,
+                const std::unordered_set<std::string>& names)
+{
+  std::unordered_map<std::string, std::uint32_t> args;
+
+  for (const auto& arg : attr.args) {
+    const auto name  = unicode::utf32toUtf8(arg.name);
+    const auto value = boost::get<std::uint32_t>(&arg.value);
+
+    if (!names.contains(name) || !value || *value == 0) {
+      throw CodegenError{ctx.formatError(
+        ctx.positionOf(arg),
+        fmt::format("invalid argument for '{}'",
+                    unicode::utf32toUtf8(attr.name)))};
+    }
+
+    if (!args.emplace(name, *value).second) {
+      throw CodegenError{ctx.formatError(
+        ctx.positionOf(arg),
+        fmt::format("duplicate argument for '{}'",
+                    unicode::utf32toUtf8(attr.name)))};
+    }
+  }
+
+  return args;
+}
+
+// Loop IDs are distinct nodes whose first operand refers to themselves
+[[nodiscard]] static llvm::MDNode*
+createLoopID(llvm::LLVMContext& context, llvm::ArrayRef<llvm::Metadata*> hints)
+{
+  llvm::SmallVector<llvm::Metadata*, 4> operands{nullptr};
+  operands.append(hints.begin(), hints.end());
+
+  auto const loop_id = llvm::MDNode::getDistinct(context, operands);
+  loop_id->replaceOperandWith(0, loop_id);
+
+  return loop_id;
+}
+
+// Returns the loop ID with the hints of the attributes for the optimizer
+// (llvm.loop metadata), or nullptr if there are no attributes
+[[nodiscard]] static llvm::MDNode* createLoopID(CGContext&        ctx,
+                                                const ast::Attrs& attrs)
+{
+  if (attrs.empty())
+    return nullptr;
+
+  auto& context = ctx.context;
+
+  std::vector<llvm::Metadata*> hints;
+
+  const auto addHint = [&](const llvm::StringRef           name,
+                           llvm::ArrayRef<llvm::Metadata*> values = {}) {
+    std::vector<llvm::Metadata*> operands{llvm::MDString::get(context, name)};
+    operands.insert(operands.end(), values.begin(), values.end());
+
+    hints.push_back(llvm::MDNode::get(context, operands));
+  };
+
+  const auto getInt = [&](const std::uint32_t value) {
+    return llvm::ConstantAsMetadata::get(ctx.builder.getInt32(value));
+  };
+
+  const auto getBool = [&](const bool value) {
+    return llvm::ConstantAsMetadata::get(ctx.builder.getInt1(value));
+  };
+
+  std::unordered_set<LoopAttrKind> kinds;
+
+  for (const auto& attr : attrs) {
+    const auto kind = matchLoopAttr(attr.name);
+    const auto name = unicode::utf32toUtf8(attr.name);
+    const auto pos  = ctx.positionOf(attr);
+
+    if (!kinds.insert(kind).second) {
+      throw CodegenError{
+        ctx.formatError(pos,
+                        fmt::format("duplicate loop attribute '{}'", name))};
+    }
+
+    switch (kind) {
+    case LoopAttrKind::unroll: {
+      const auto args = getLoopAttrArgs(ctx, attr, {""});
+
+      if (const auto it = args.find(""); it != args.end())
+        addHint("llvm.loop.unroll.count", {getInt(it->second)});
+      else
+        addHint("llvm.loop.unroll.enable");
+
+      break;
+    }
+    case LoopAttrKind::no_unroll:
+      static_cast<void>(getLoopAttrArgs(ctx, attr, {}));
+      addHint("llvm.loop.unroll.disable");
+      break;
+    case LoopAttrKind::unroll_and_jam: {
+      const auto args = getLoopAttrArgs(ctx, attr, {""});
+
+      if (const auto it = args.find(""); it != args.end())
+        addHint("llvm.loop.unroll_and_jam.count", {getInt(it->second)});
+      else
+        addHint("llvm.loop.unroll_and_jam.enable");
+
+      // Without a followup, the hints are left on the transformed loop and
+      // reported as not performed
+      addHint("llvm.loop.unroll_and_jam.followup_all",
+              {createLoopID(context, {})});
+
+      break;
+    }
+    case LoopAttrKind::vectorize: {
+      const auto args = getLoopAttrArgs(ctx, attr, {"width", "interleave"});
+
+      addHint("llvm.loop.vectorize.enable", {getBool(true)});
+
+      if (const auto it = args.find("width"); it != args.end())
+        addHint("llvm.loop.vectorize.width", {getInt(it->second)});
+
+      if (const auto it = args.find("interleave"); it != args.end())
+        addHint("llvm.loop.interleave.count", {getInt(it->second)});
+
+      break;
+    }
+    case LoopAttrKind::no_vectorize:
+      static_cast<void>(getLoopAttrArgs(ctx, attr, {}));
+      addHint("llvm.loop.vectorize.enable", {getBool(false)});
+      break;
+    case LoopAttrKind::distribute:
+      static_cast<void>(getLoopAttrArgs(ctx, attr, {}));
+      addHint("llvm.loop.distribute.enable", {getBool(true)});
+      break;
+    case LoopAttrKind::unknown:
+      throw CodegenError{
+        ctx.formatError(pos, fmt::format("unknown loop attribute '{}'", name))};
+    }
+  }
+
+  if ((kinds.contains(LoopAttrKind::unroll)
+       && kinds.contains(LoopAttrKind::no_unroll))
+      || (kinds.contains(LoopAttrKind::vectorize)
+          && kinds.contains(LoopAttrKind::no_vectorize))) {
+    throw CodegenError{ctx.formatError(ctx.positionOf(attrs.front()),
+                                       "conflicting loop attributes")};
+  }
+
+  return createLoopID(context, hints);
+}
+
+// Attach the loop ID to the back edges of the loop, which are the branches to
+// the header other than the one from the preheader
+static void setLoopID(llvm::BasicBlock* header,
+                      llvm::BasicBlock* preheader,
+                      llvm::MDNode*     loop_id)
+{
+  if (!loop_id)
+    return;
+
+  for (auto const pred : llvm::predecessors(header)) {
+    if (pred != preheader)
+      pred->getTerminator()->setMetadata(llvm::LLVMContext::MD_loop, loop_id);
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Parallel loops
+//===----------------------------------------------------------------------===//
+
+// [[parallel]], [[parallel(chunk: N)]]
+// Returns the attribute, and the other attributes, which are the hints for the
+// loop in the outlined body
+[[nodiscard]] static std::pair<std::optional<ast::Attr>, ast::Attrs>
+splitParallelAttr(const ast::Attrs& attrs)
+{
+  std::optional<ast::Attr> parallel;
+  ast::Attrs               others;
+
+  for (const auto& attr : attrs) {
+    if (attr.name == U"parallel" && !parallel)
+      parallel = attr;
+    else
+      others.push_back(attr);
+  }
+
+  return {parallel, others};
+}
+
+// The bodies of parallel loops are outlined into functions without return
+// types
+[[nodiscard]] static bool isParallelLoopBody(const CGContext& ctx)
+{
+  return !ctx.return_type_table.exists(
+    ctx.builder.GetInsertBlock()->getParent());
+}
+
+// The induction variable and the end of a parallel loop, which must be
+// for (let mut i = begin; i < end; i += 1) or with '<=' and '++i'
+struct ParallelInduction {
+  const ast::VariableDef& variable;
+  const ast::Expr&        end;
+  const bool              inclusive;
+};
+
+// The runtime runs the iterations of parallel loops as signed 64-bit indices
+// Unsigned 64-bit values are mapped to them by flipping the sign bit, which
+// keeps their order
+[[nodiscard]] static bool isUnsigned64(CGContext&                   ctx,
+                                       const std::shared_ptr<Type>& type)
+{
+  return type->isUnsigned(ctx)
+         && type->getLLVMType(ctx)->getIntegerBitWidth() == 64;
+}
+
+[[nodiscard]] static llvm::Value*
+toParallelIndex(CGContext&                   ctx,
+                const std::shared_ptr<Type>& type,
+                llvm::Value* const           value)
+{
+  if (isUnsigned64(ctx, type))
+    return ctx.builder.CreateXor(
+      value,
+      ctx.builder.getInt(llvm::APInt::getSignMask(64)));
+
+  return ctx.builder.CreateIntCast(value,
+                                   ctx.builder.getInt64Ty(),
+                                   type->isSigned(ctx));
+}
+
+[[nodiscard]] static llvm::Value*
+fromParallelIndex(CGContext&                   ctx,
+                  const std::shared_ptr<Type>& type,
+                  llvm::Value* const           index)
+{
+  if (isUnsigned64(ctx, type))
+    return ctx.builder.CreateXor(
+      index,
+      ctx.builder.getInt(llvm::APInt::getSignMask(64)));
+
+  return ctx.builder.CreateIntCast(index,
+                                   type->getLLVMType(ctx),
+                                   type->isSigned(ctx));
+}
+
+// The variables of the enclosing function, passed to the body by their
+// addresses
+using ParallelCaptures
+  = std::vector<std::pair<std::string, std::shared_ptr<Variable>>>;
+
+[[nodiscard]] static std::optional<ParallelInduction>
+getParallelInduction(const ast::For& node)
+{
+  if (!node.init_stmt || !node.cond_expr || !node.loop_stmt)
+    return std::nullopt;
+
+  auto const variable = boost::get<ast::VariableDef>(&*node.init_stmt);
+
+  if (!variable || !variable->initializer)
+    return std::nullopt;
+
+  const auto isInduction = [&](const ast::Expr& expr) {
+    auto const ident = boost::get<ast::Identifier>(&expr);
+    return ident && ident->utf32() == variable->name.utf32();
+  };
+
+  auto const cond = boost::get<ast::BinOp>(&*node.cond_expr);
+
+  if (!cond || !isInduction(cond->lhs)
+      || (cond->op != U"<" && cond->op != U"<="))
+    return std::nullopt;
+
+  if (auto const increment
+      = boost::get<ast::PrefixIncrementDecrement>(&*node.loop_stmt)) {
+    if (increment->op != U"++" || !isInduction(increment->operand))
+      return std::nullopt;
+  }
+  else if (auto const assign = boost::get<ast::Assignment>(&*node.loop_stmt)) {
+    const auto isOne = [](const ast::Expr& expr) {
+      auto const i32 = boost::get<std::int32_t>(&expr);
+      auto const u32 = boost::get<std::uint32_t>(&expr);
+      return (i32 && *i32 == 1) || (u32 && *u32 == 1);
+    };
+
+    if (assign->op != U"+=" || !isInduction(assign->lhs)
+        || !isOne(assign->rhs))
+      return std::nullopt;
+  }
+  else
+    return std::nullopt;
+
+  return ParallelInduction{*variable, cond->rhs, cond->op == U"<="};
+}
+
+//===----------------------------------------------------------------------===//
+// Branch attributes
+//===----------------------------------------------------------------------===//
+
+// Returns the branch weights of the attributes of an if statement
+// (prof metadata), or nullptr if there are no attributes
+// The weights are the ones that llvm.expect is lowered to
+[[nodiscard]] static llvm::MDNode* createBranchWeights(CGContext&        ctx,
+                                                       const ast::Attrs& attrs)
+{
+  if (attrs.empty())
+    return nullptr;
+
+  if (attrs.size() != 1) {
+    throw CodegenError{ctx.formatError(ctx.positionOf(attrs.front()),
+                                       "conflicting branch attributes")};
+  }
+
+  const auto& attr = attrs.front();
+  const auto  pos  = ctx.positionOf(attr);
+
+  const auto is_likely = attr.name == U"likely";
+
+  if (!is_likely && attr.name != U"unlikely") {
+    throw CodegenError{ctx.formatError(
+      pos,
+      fmt::format("unknown branch attribute '{}'",
+                  unicode::utf32toUtf8(attr.name)))};
+  }
+
+  if (!attr.args.empty()) {
+    throw CodegenError{ctx.formatError(
+      pos,
+      fmt::format("'{}' takes no arguments",
+                  unicode::utf32toUtf8(attr.name)))};
+  }
+
+  constexpr std::uint32_t likely_weight   = 2000;
+  constexpr std::uint32_t unlikely_weight = 1;
+
+  llvm::MDBuilder md_builder{ctx.context};
+
+  return is_likely
+           ? md_builder.createBranchWeights(likely_weight, unlikely_weight)
+           : md_builder.createBranchWeights(unlikely_weight, likely_weight);
+}
+
 //===----------------------------------------------------------------------===//
 // Statement visitor
 //===----------------------------------------------------------------------===//
@@ -53,20 +429,48 @@ struct StmtVisitor : public boost::static_visitor<void> {
 
   void operator()(const ast::Expr& node) const
   {
-    static_cast<void>(createExpr(ctx, getAllSymbols(), stmt_ctx, node));
+    const auto value = createExpr(ctx, getAllSymbols(), stmt_ctx, node);
+
+    // The future of a discarded call of an async function is not awaited, so
+    // its coroutine runs detached
+    if ((boost::get<ast::FunctionCall>(&node)
+         || boost::get<ast::FunctionTemplateCall>(&node))
+        && value.getType()->isFutureTy(ctx))
+      createDetach(ctx, value);
   }
 
   void operator()(const ast::Return& node) const
   {
+    if (isParallelLoopBody(ctx)) {
+      throw CodegenError{
+        ctx.formatError(ctx.positionOf(node),
+                        "cannot return from the body of a parallel loop")};
+    }
+
     if (node.rhs) {
       auto const retval = createExpr(ctx, getAllSymbols(), stmt_ctx, *node.rhs);
 
-      auto const return_type
-        = ctx.return_type_table[ctx.builder.GetInsertBlock()->getParent()];
+      auto const func = ctx.builder.GetInsertBlock()->getParent();
+
+      auto const return_type = ctx.return_type_table[func];
 
       assert(return_type);
 
-      if (!equals(ctx, *return_type, retval.getType())) {
+      // Async functions return the result of their futures
+      const auto result_type = findCoroutine(ctx, func)
+                                 ? return_type->get()->getFutureResultType(ctx)
+                                 : return_type->get();
+
+      // Tasks are waited for and freed when the function returns
+      if (retval.getType()->isTaskTy(ctx)) {
+        throw CodegenError{ctx.formatError(
+          ctx.positionOf(node),
+          "cannot return a task from the function spawning it")};
+      }
+
+      verifyFutureMove(ctx, *node.rhs, retval, ctx.positionOf(node));
+
+      if (!equals(ctx, result_type, retval.getType())) {
         throw CodegenError{
           ctx.formatError(ctx.positionOf(node),
                           "incompatible type for result type")};
@@ -136,9 +540,14 @@ struct StmtVisitor : public boost::static_visitor<void> {
 
     const auto derefed_operand = createDereference(ctx, pos, operand);
 
+    // The one has the same type as integer operands, so that operands wider
+    // than i32 can be incremented
     const auto one
-      = Value{llvm::ConstantInt::get(ctx.builder.getInt32Ty(), 1),
-              std::make_shared<BuiltinType>(BuiltinTypeKind::i32, false)};
+      = derefed_operand.getType()->isIntegerTy(ctx)
+        ? Value{llvm::ConstantInt::get(derefed_operand.getLLVMType(), 1),
+                derefed_operand.getType()}
+        : Value{llvm::ConstantInt::get(ctx.builder.getInt32Ty(), 1),
+                std::make_shared<BuiltinType>(BuiltinTypeKind::i32, false)};
 
     switch (node.kind()) {
     case ast::PrefixIncrementDecrement::Kind::unknown:
@@ -184,7 +593,10 @@ struct StmtVisitor : public boost::static_visitor<void> {
       cond_value.getValue(),
       llvm::Constant::getNullValue(cond_value.getLLVMType()));
 
-    ctx.builder.CreateCondBr(cond, then_bb, else_bb);
+    ctx.builder.CreateCondBr(cond,
+                             then_bb,
+                             else_bb,
+                             createBranchWeights(ctx, node.attrs));
 
     // Then statement codegen
     ctx.builder.SetInsertPoint(then_bb);
@@ -218,6 +630,8 @@ struct StmtVisitor : public boost::static_visitor<void> {
 
     auto const loop_end_bb = llvm::BasicBlock::Create(ctx.context, "loop_end");
 
+    auto const preheader = ctx.builder.GetInsertBlock();
+
     ctx.builder.CreateBr(body_bb);
     ctx.builder.SetInsertPoint(body_bb);
 
@@ -233,6 +647,8 @@ struct StmtVisitor : public boost::static_visitor<void> {
     if (!ctx.builder.GetInsertBlock()->getTerminator())
       ctx.builder.CreateBr(body_bb);
 
+    setLoopID(body_bb, preheader, createLoopID(ctx, node.attrs));
+
     func->getBasicBlockList().push_back(loop_end_bb);
     ctx.builder.SetInsertPoint(loop_end_bb);
   }
@@ -247,6 +663,8 @@ struct StmtVisitor : public boost::static_visitor<void> {
 
     auto const loop_end_bb = llvm::BasicBlock::Create(ctx.context, "while_end");
 
+    auto const preheader = ctx.builder.GetInsertBlock();
+
     ctx.builder.CreateBr(cond_bb);
     ctx.builder.SetInsertPoint(cond_bb);
 
@@ -274,12 +692,20 @@ struct StmtVisitor : public boost::static_visitor<void> {
     if (!ctx.builder.GetInsertBlock()->getTerminator())
       ctx.builder.CreateBr(cond_bb);
 
+    setLoopID(cond_bb, preheader, createLoopID(ctx, node.attrs));
+
     func->getBasicBlockList().push_back(loop_end_bb);
     ctx.builder.SetInsertPoint(loop_end_bb);
   }
 
   void operator()(const ast::For& node) const
   {
+    if (const auto [parallel, loop_attrs] = splitParallelAttr(node.attrs);
+        parallel) {
+      createParallelFor(node, *parallel, loop_attrs);
+      return;
+    }
+
     if (node.init_stmt)
       boost::apply_visitor(*this, *node.init_stmt);
 
@@ -298,6 +724,8 @@ struct StmtVisitor : public boost::static_visitor<void> {
                                    loop_end_bb,
                                    loop_bb};
 
+    auto const preheader = ctx.builder.GetInsertBlock();
+
     ctx.builder.CreateBr(cond_bb);
     ctx.builder.SetInsertPoint(cond_bb);
 
@@ -337,14 +765,21 @@ struct StmtVisitor : public boost::static_visitor<void> {
 
     ctx.builder.CreateBr(cond_bb);
 
+    setLoopID(cond_bb, preheader, createLoopID(ctx, node.attrs));
+
     func->getBasicBlockList().push_back(loop_end_bb);
     ctx.builder.SetInsertPoint(loop_end_bb);
   }
 
-  void operator()(ast::Break) const
+  void operator()(const ast::Break& node) const
   {
     if (stmt_ctx.break_bb) // If in a loop
       ctx.builder.CreateBr(stmt_ctx.break_bb);
+    else if (isParallelLoopBody(ctx)) {
+      throw CodegenError{
+        ctx.formatError(ctx.positionOf(node),
+                        "cannot break out of the body of a parallel loop")};
+    }
   }
 
   void operator()(ast::Continue) const
@@ -353,6 +788,18 @@ struct StmtVisitor : public boost::static_visitor<void> {
       ctx.builder.CreateBr(stmt_ctx.continue_bb);
   }
 
+  // Wait for the tasks spawned by the function
+  // The group is created even if no task has been spawned yet, since sync may
+  // be followed by spawns in a loop
+  void operator()(ast::Sync) const
+  {
+    auto const func = ctx.builder.GetInsertBlock()->getParent();
+
+    static_cast<void>(getTaskGroup(ctx, func));
+
+    createTaskGroupSync(ctx, func);
+  }
+
   void operator()(const ast::Match& node) const
   {
     const auto target_val
@@ -554,6 +1001,278 @@ private:
       std::make_shared<BuiltinType>(BuiltinTypeKind::u8, false)};
   }
 
+  // The body is outlined into a function that runs the iterations of a chunk,
+  // and the runtime runs the chunks in parallel
+  void createParallelFor(const ast::For&   node,
+                         const ast::Attr&  parallel,
+                         const ast::Attrs& loop_attrs) const
+  {
+    const auto pos = ctx.positionOf(node);
+
+    const auto induction = getParallelInduction(node);
+
+    if (!induction) {
+      throw CodegenError{ctx.formatError(
+        pos,
+        "parallel loops must be 'for (let mut i = begin; i < end; i += 1)'")};
+    }
+
+    const auto chunk_arg = getLoopAttrArgs(ctx, parallel, {"chunk"});
+
+    const auto chunk = chunk_arg.contains("chunk") ? chunk_arg.at("chunk") : 0;
+
+    const auto symbols = getAllSymbols();
+
+    // The range is evaluated once before the loop
+    const auto begin
+      = createExpr(ctx, symbols, stmt_ctx, *induction->variable.initializer);
+
+    const auto type
+      = induction->variable.type
+          ? createType(ctx, *induction->variable.type, pos)
+          : begin.getType();
+
+    if (!type->isIntegerTy(ctx)) {
+      throw CodegenError{ctx.formatError(
+        pos,
+        "the variable of a parallel loop must be an integer")};
+    }
+
+    if (!equals(ctx, type, begin.getType()))
+      throw CodegenError{ctx.formatError(pos, "invalid initializer type")};
+
+    const auto end = createExpr(ctx, symbols, stmt_ctx, induction->end);
+
+    if (!end.getType()->isIntegerTy(ctx)) {
+      throw CodegenError{
+        ctx.formatError(pos, "the end of a parallel loop must be an integer")};
+    }
+
+    auto const i64 = ctx.builder.getInt64Ty();
+
+    // The end is compared with the variable as a value of its type
+    auto const end_value = toParallelIndex(
+      ctx,
+      type,
+      ctx.builder.CreateIntCast(end.getValue(),
+                                type->getLLVMType(ctx),
+                                end.getType()->isSigned(ctx)));
+
+    auto const begin_value = toParallelIndex(ctx, type, begin.getValue());
+
+    const ParallelCaptures captures{symbols.begin(), symbols.end()};
+
+    std::vector<llvm::Type*> capture_types;
+
+    for (const auto& [name, variable] : captures)
+      capture_types.push_back(variable->getAddress()->getType());
+
+    auto const captures_type
+      = llvm::StructType::get(ctx.context, capture_types);
+
+    auto const func = ctx.builder.GetInsertBlock()->getParent();
+
+    auto const captures_alloca = createEntryAlloca(func, "", captures_type);
+
+    for (std::uint32_t idx = 0; const auto& [name, variable] : captures) {
+      ctx.builder.CreateStore(
+        variable->getAddress(),
+        ctx.builder.CreateStructGEP(captures_type, captures_alloca, idx++));
+    }
+
+    auto const i8_ptr = ctx.builder.getInt8PtrTy();
+
+    auto const body_type
+      = llvm::FunctionType::get(ctx.builder.getVoidTy(),
+                                {i8_ptr, i64, i64},
+                                false);
+
+    auto const body = llvm::Function::Create(body_type,
+                                             llvm::Function::InternalLinkage,
+                                             func->getName() + ".parallel_for",
+                                             *ctx.module);
+
+    createParallelForBody(node,
+                          *induction,
+                          type,
+                          captures,
+                          captures_type,
+                          body,
+                          loop_attrs);
+
+    auto const runtime = ctx.module->getOrInsertFunction(
+      "__twinkle_parallel_for",
+      ctx.builder.getVoidTy(),
+      i64,
+      i64,
+      i64,
+      body_type->getPointerTo(),
+      i8_ptr);
+
+    auto const captures_ptr
+      = ctx.builder.CreatePointerCast(captures_alloca, i8_ptr);
+
+    ctx.builder.CreateCall(runtime,
+                           {begin_value,
+                            end_value,
+                            ctx.builder.getInt64(chunk),
+                            body,
+                            captures_ptr});
+
+    if (!induction->inclusive)
+      return;
+
+    // The last iteration of 'i <= end' runs here, since end + 1 may not be
+    // representable (e.g. the maximum of i64)
+    // The body stops when the index wraps around to end + 1
+    auto const last_bb
+      = llvm::BasicBlock::Create(ctx.context, "parallel_for_last", func);
+    auto const end_bb
+      = llvm::BasicBlock::Create(ctx.context, "parallel_for_end", func);
+
+    ctx.builder.CreateCondBr(ctx.builder.CreateICmpSLE(begin_value, end_value),
+                             last_bb,
+                             end_bb);
+
+    ctx.builder.SetInsertPoint(last_bb);
+
+    ctx.builder.CreateCall(
+      body,
+      {captures_ptr,
+       end_value,
+       ctx.builder.CreateAdd(end_value, ctx.builder.getInt64(1))});
+
+    ctx.builder.CreateBr(end_bb);
+    ctx.builder.SetInsertPoint(end_bb);
+  }
+
+  // void body(captures, begin, end)
+  void createParallelForBody(const ast::For&              node,
+                             const ParallelInduction&     induction,
+                             const std::shared_ptr<Type>& type,
+                             const ParallelCaptures&      captures,
+                             llvm::StructType* const      captures_type,
+                             llvm::Function* const        body,
+                             const ast::Attrs&            loop_attrs) const
+  {
+    const auto pos = ctx.positionOf(node);
+
+    const auto return_bb = ctx.builder.GetInsertBlock();
+
+    const auto outer_debug_location = ctx.builder.getCurrentDebugLocation();
+
+    ctx.builder.SetCurrentDebugLocation(llvm::DebugLoc{});
+
+    if (ctx.debug_info) {
+      ctx.debug_info->createSubprogram(*body, body->getName(), pos);
+
+      ctx.builder.SetCurrentDebugLocation(
+        ctx.debug_info->getLocation(*body, pos));
+    }
+
+    auto const entry_bb = llvm::BasicBlock::Create(ctx.context, "", body);
+    ctx.builder.SetInsertPoint(entry_bb);
+
+    auto const args = body->arg_begin();
+
+    auto const captures_ptr
+      = ctx.builder.CreatePointerCast(args,
+                                      captures_type->getPointerTo());
+
+    SymbolTable scope;
+
+    for (std::uint32_t idx = 0; const auto& [name, variable] : captures) {
+      auto const address = ctx.builder.CreateLoad(
+        captures_type->getElementType(idx),
+        ctx.builder.CreateStructGEP(captures_type, captures_ptr, idx));
+
+      ++idx;
+
+      scope.insertOrAssign(
+        name,
+        std::make_shared<CapturedVariable>(address,
+                                           variable->getType(),
+                                           variable->isMutable()));
+    }
+
+    const auto& variable = induction.variable;
+
+    auto const llvm_type = type->getLLVMType(ctx);
+
+    auto const induction_alloca
+      = createEntryAlloca(body, variable.name.utf8(), llvm_type);
+
+    scope.insertOrAssign(
+      variable.name.utf8(),
+      std::make_shared<AllocaVariable>(
+        ctx,
+        Value{induction_alloca, type->clone()},
+        variable.qualifier
+          && *variable.qualifier == VariableQual::mutable_));
+
+    auto const counter = createEntryAlloca(body, "", ctx.builder.getInt64Ty());
+    ctx.builder.CreateStore(args + 1, counter);
+
+    auto const cond_bb
+      = llvm::BasicBlock::Create(ctx.context, "for_cond", body);
+    auto const body_bb = llvm::BasicBlock::Create(ctx.context, "for_body");
+    auto const loop_bb = llvm::BasicBlock::Create(ctx.context, "for_loop");
+    auto const end_bb  = llvm::BasicBlock::Create(ctx.context, "for_end");
+
+    ctx.builder.CreateBr(cond_bb);
+    ctx.builder.SetInsertPoint(cond_bb);
+
+    auto const index
+      = ctx.builder.CreateLoad(ctx.builder.getInt64Ty(), counter);
+
+    // Not '<', since the end of the last iteration of 'i <= end' may wrap
+    // around
+    ctx.builder.CreateCondBr(ctx.builder.CreateICmpNE(index, args + 2),
+                             body_bb,
+                             end_bb);
+
+    body->getBasicBlockList().push_back(body_bb);
+    ctx.builder.SetInsertPoint(body_bb);
+
+    ctx.builder.CreateStore(fromParallelIndex(ctx, type, index),
+                            induction_alloca);
+
+    // Break and return are rejected, since the body is not in a function
+    // returning a value
+    createStatement(ctx,
+                    scope,
+                    {nullptr, nullptr, end_bb, nullptr, loop_bb},
+                    node.body);
+
+    if (!ctx.builder.GetInsertBlock()->getTerminator())
+      ctx.builder.CreateBr(loop_bb);
+
+    body->getBasicBlockList().push_back(loop_bb);
+    ctx.builder.SetInsertPoint(loop_bb);
+
+    ctx.builder.CreateStore(
+      ctx.builder.CreateAdd(
+        ctx.builder.CreateLoad(ctx.builder.getInt64Ty(), counter),
+        ctx.builder.getInt64(1)),
+      counter);
+
+    ctx.builder.CreateBr(cond_bb);
+
+    setLoopID(cond_bb, entry_bb, createLoopID(ctx, loop_attrs));
+
+    body->getBasicBlockList().push_back(end_bb);
+    ctx.builder.SetInsertPoint(end_bb);
+
+    createTaskGroupExit(ctx, body);
+
+    ctx.builder.CreateRetVoid();
+
+    ctx.runFunctionPasses(*body);
+
+    ctx.builder.SetInsertPoint(return_bb);
+    ctx.builder.SetCurrentDebugLocation(outer_debug_location);
+  }
+
   [[nodiscard]] SymbolTable getAllSymbols() const
   {
     return mergeSymbolTables(parent_scope, scope);
@@ -565,15 +1284,26 @@ private:
     const auto lhs
       = createAssignableValue(node.lhs, ctx.positionOf(node), const_check);
 
-    const auto rhs = createExpr(ctx, getAllSymbols(), stmt_ctx, node.rhs);
+    // The future held by the variable would be lost
+    if (lhs.getType()->getPointeeType(ctx)->isFutureTy(ctx)) {
+      throw CodegenError{
+        ctx.formatError(ctx.positionOf(node), "cannot assign to a future")};
+    }
+
+    const auto rhs_value
+      = createExpr(ctx, getAllSymbols(), stmt_ctx, node.rhs);
 
-    verifyVariableType(ctx.positionOf(node), rhs.getType());
+    verifyVariableType(ctx.positionOf(node), rhs_value.getType());
 
     auto const lhs_value
       = Value{ctx.builder.CreateLoad(lhs.getLLVMType()->getPointerElementType(),
                                      lhs.getValue()),
               lhs.getType()->getPointeeType(ctx)};
 
+    // A scalar assigned to a vector is set to all lanes
+    const auto rhs
+      = splatScalar(ctx, {lhs_value, rhs_value}, ctx.positionOf(node)).second;
+
     switch (node.kind()) {
     case ast::Assignment::Kind::unknown:
       throw CodegenError{ctx.formatError(
@@ -627,7 +1357,13 @@ private:
       return value;
     }
 
-    return {llvm::getPointerOperand(value.getValue()),
+    auto const address = llvm::getPointerOperand(value.getValue());
+
+    // e.g. Lanes of masks, which are bits
+    if (!address)
+      throw CodegenError{ctx.formatError(pos, "operand has no address")};
+
+    return {address,
             std::make_shared<PointerType>(value.getType(), value.isMutable())};
   }
 
@@ -653,6 +1389,12 @@ private:
     auto const alloca = createEntryAlloca(func, name, type->getLLVMType(ctx));
 
     if (!initializer) {
+      // Empty until a future is moved in, and it cannot be moved in later
+      if (type->isFutureTy(ctx)) {
+        throw CodegenError{
+          ctx.formatError(pos, "future variables require an initializer")};
+      }
+
       return {
         ctx,
         {alloca, type->clone()},
@@ -666,6 +1408,8 @@ private:
     if (!equals(ctx, type, init_value.getType()))
       throw CodegenError{ctx.formatError(pos, "invalid initializer type")};
 
+    verifyFutureMove(ctx, *initializer, init_value, pos);
+
     ctx.builder.CreateStore(init_value.getValue(), alloca);
 
     return {
@@ -686,6 +1430,7 @@ private:
       = createExpr(ctx, getAllSymbols(), stmt_ctx, *initializer);
 
     verifyVariableType(pos, init_value.getType());
+    verifyFutureMove(ctx, *initializer, init_value, pos);
 
     auto const alloca = createEntryAlloca(func, name, init_value.getLLVMType());
 
@@ -743,7 +1488,7 @@ void invokeDestructor(CGContext& ctx, const std::shared_ptr<Variable>& this_)
     = findDestructor(ctx, this_->getType()->getClassName(ctx));
 
   if (destructor)
-    ctx.builder.CreateCall(destructor, {this_->getAllocaInst()});
+    ctx.builder.CreateCall(destructor, {this_->getAddress()});
 }
 
 static void createDestructBB(CGContext&         ctx,
@@ -755,15 +1500,79 @@ static void createDestructBB(CGContext&         ctx,
     stmt_ctx.destruct_bb);
   ctx.builder.SetInsertPoint(stmt_ctx.destruct_bb);
 
+  // Tasks spawned in the scope may still use its variables, so they are
+  // waited for before the variables are destroyed
+  const auto has_destructor
+    = std::any_of(symbols.begin(), symbols.end(), [&](const auto& symbol) {
+        const auto type = symbol.second->getType();
+
+        return type->isClassTy(ctx)
+               && findDestructor(ctx, type->getClassName(ctx));
+      });
+
+  if (has_destructor)
+    createTaskGroupSync(ctx, ctx.builder.GetInsertBlock()->getParent());
+
   for (const auto& symbol : symbols) {
     if (symbol.second->getType()->isClassTy(ctx))
       invokeDestructor(ctx, symbol.second);
+    else if (symbol.second->getType()->isFutureTy(ctx))
+      createDetachUnlessAwaited(ctx, symbol.second->getValue(ctx));
   }
 
   if (return_)
     ctx.builder.CreateBr(stmt_ctx.end_bb);
 }
 
+//===----------------------------------------------------------------------===//
+// Debug location
+//===----------------------------------------------------------------------===//
+
+// Returns the position of the statement if it has one
+struct StmtPositionVisitor
+  : public boost::static_visitor<std::optional<PositionRange>> {
+  explicit StmtPositionVisitor(const CGContext& ctx) noexcept
+    : ctx{ctx}
+  {
+  }
+
+  template <typename T>
+  std::optional<PositionRange> operator()(const T& node) const
+  {
+    if constexpr (std::is_same_v<T, ast::Expr>)
+      return boost::apply_visitor(*this, node);
+    else if constexpr (PositionTaggedClass<T>) {
+      // Nodes created by the compiler have no position
+      if (node.id_first < 0)
+        return std::nullopt;
+
+      return ctx.positionOf(node);
+    }
+    else
+      return std::nullopt;
+  }
+
+private:
+  const CGContext& ctx;
+};
+
+// Attribute the instructions of the statement to its line
+static void setDebugLocation(CGContext& ctx, const ast::Stmt& statement)
+{
+  if (!ctx.debug_info)
+    return;
+
+  const auto pos = boost::apply_visitor(StmtPositionVisitor{ctx}, statement);
+
+  if (!pos)
+    return;
+
+  if (auto const location = ctx.debug_info->getLocation(
+        *ctx.builder.GetInsertBlock()->getParent(),
+        *pos))
+    ctx.builder.SetCurrentDebugLocation(location);
+}
+
 void createStatement(CGContext&         ctx,
                      const SymbolTable& scope_arg,
                      const StmtContext& stmt_ctx_arg,
@@ -778,6 +1587,8 @@ void createStatement(CGContext&         ctx,
     auto& statements = boost::get<ast::CompoundStatement>(statement);
 
     for (const auto& r : statements) {
+      setDebugLocation(ctx, r);
+
       boost::apply_visitor(StmtVisitor{ctx, scope_arg, new_scope, new_stmt_ctx},
                            r);
 
@@ -789,6 +1600,8 @@ void createStatement(CGContext&         ctx,
     }
   }
   else {
+    setDebugLocation(ctx, statement);
+
     boost::apply_visitor(StmtVisitor{ctx, scope_arg, new_scope, new_stmt_ctx},
                          statement);
   }
@@ -0,0 +1,181 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#include <twinkle/codegen/target_clones.hpp>
+
+namespace
+{
+
+// Returns std::nullopt if the CPU support of the feature cannot be tested at
+// run time
+[[nodiscard]] std::optional<llvm::X86::ProcessorFeatures>
+getX86Feature(const std::string_view name)
+{
+  // Features tested by __builtin_cpu_supports of GCC and clang
+  static const std::unordered_map<std::string_view,
+                                  llvm::X86::ProcessorFeatures>
+    features{
+#define X86_FEATURE_COMPAT(ENUM, STR, PRIORITY)                                \
+  {STR, llvm::X86::FEATURE_##ENUM},
+#include <llvm/Support/X86TargetParser.def>
+    };
+
+  const auto it = features.find(name);
+
+  if (it == features.end())
+    return std::nullopt;
+
+  return it->second;
+}
+
+// Same as __builtin_cpu_supports, which reads the features detected by
+// __cpu_indicator_init of libgcc or compiler-rt
+[[nodiscard]] llvm::Value*
+createCpuSupports(llvm::Module&                      module,
+                  llvm::IRBuilder<>&                 builder,
+                  const llvm::X86::ProcessorFeatures feature)
+{
+  auto const i32 = builder.getInt32Ty();
+
+  llvm::Value* features;
+
+  if (feature < 32) {
+    // struct { vendor, type, subtype, features[1] }
+    auto const cpu_model_type
+      = llvm::StructType::get(i32, i32, i32, llvm::ArrayType::get(i32, 1));
+
+    auto const cpu_features = builder.CreateInBoundsGEP(
+      cpu_model_type,
+      module.getOrInsertGlobal("__cpu_model", cpu_model_type),
+      {builder.getInt32(0), builder.getInt32(3), builder.getInt32(0)});
+
+    features = builder.CreateAlignedLoad(i32, cpu_features, llvm::Align{4});
+  }
+  else {
+    features
+      = builder.CreateAlignedLoad(i32,
+                                  module.getOrInsertGlobal("__cpu_features2",
+                                                           i32),
+                                  llvm::Align{4});
+  }
+
+  auto const mask = builder.getInt32(1u << (feature % 32));
+
+  return builder.CreateICmpEQ(builder.CreateAnd(features, mask), mask);
+}
+
+} // namespace
+
+namespace twinkle::codegen
+{
+
+[[nodiscard]] std::optional<std::string>
+verifyTargetClones(const llvm::Triple&             triple,
+                   const std::vector<std::string>& targets)
+{
+  if (!triple.isX86() || !triple.isOSBinFormatELF())
+    return "target_clones is only supported on x86 ELF targets";
+
+  if (std::find(targets.begin(), targets.end(), "default") == targets.end())
+    return "target_clones requires 'default'";
+
+  std::unordered_set<std::string_view> seen;
+
+  for (const auto& target : targets) {
+    if (!seen.insert(target).second)
+      return fmt::format("duplicate target '{}' in target_clones", target);
+
+    if (target != "default" && !getX86Feature(target))
+      return fmt::format("unknown target '{}' in target_clones", target);
+  }
+
+  return std::nullopt;
+}
+
+void createTargetClones(llvm::Module& module, const TargetClones& clones)
+{
+  auto const func = clones.func;
+
+  const auto name = func->getName().str();
+
+  std::vector<std::pair<llvm::X86::ProcessorFeatures, llvm::Function*>>
+    versions;
+
+  for (const auto& target : clones.targets) {
+    if (target == "default")
+      continue;
+
+    llvm::ValueToValueMapTy vmap;
+
+    auto const clone = llvm::CloneFunction(func, vmap);
+
+    clone->setName(name + "." + target);
+    clone->setLinkage(llvm::Function::InternalLinkage);
+
+    // The features of the target CPU are prepended when the module is
+    // finished
+    clone->addFnAttr("target-features", "+" + target);
+
+    versions.emplace_back(*getX86Feature(target), clone);
+  }
+
+  // Test the features in the same order as GCC and clang
+  std::stable_sort(versions.begin(),
+                   versions.end(),
+                   [](const auto& lhs, const auto& rhs) {
+                     return llvm::X86::getFeaturePriority(rhs.first)
+                            < llvm::X86::getFeaturePriority(lhs.first);
+                   });
+
+  const auto linkage = func->getLinkage();
+
+  func->setName(name + ".default");
+  func->setLinkage(llvm::Function::InternalLinkage);
+
+  auto const resolver = llvm::Function::Create(
+    llvm::FunctionType::get(func->getFunctionType()->getPointerTo(), false),
+    llvm::Function::InternalLinkage,
+    name + ".resolver",
+    module);
+
+  auto const ifunc = llvm::GlobalIFunc::create(func->getFunctionType(),
+                                               func->getAddressSpace(),
+                                               linkage,
+                                               name,
+                                               resolver,
+                                               &module);
+
+  // Including the recursive calls of the clones
+  func->replaceAllUsesWith(ifunc);
+
+  auto& context = module.getContext();
+
+  llvm::IRBuilder<> builder{llvm::BasicBlock::Create(context, "", resolver)};
+
+  // Resolvers run before constructors, so the features may not have been
+  // detected yet
+  builder.CreateCall(
+    module.getOrInsertFunction("__cpu_indicator_init", builder.getVoidTy()));
+
+  for (const auto& [feature, clone] : versions) {
+    auto const then_bb = llvm::BasicBlock::Create(context, "", resolver);
+    auto const else_bb = llvm::BasicBlock::Create(context, "", resolver);
+
+    builder.CreateCondBr(createCpuSupports(module, builder, feature),
+                         then_bb,
+                         else_bb);
+
+    builder.SetInsertPoint(then_bb);
+    builder.CreateRet(clone);
+
+    builder.SetInsertPoint(else_bb);
+  }
+
+  builder.CreateRet(func);
+}
+
+} // namespace twinkle::codegen
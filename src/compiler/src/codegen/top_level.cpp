@@ -16,14 +16,30 @@ namespace twinkle::codegen
 enum class AttrKind {
   unknown,
   nomangle,
+  target_clones,
+  inline_,
+  always_inline,
+  noinline,
+  hot,
+  cold,
+  pure,
+  const_,
+};
+
+static const std::unordered_map<std::u32string_view, AttrKind> attr_map{
+  {     U"nomangle",      AttrKind::nomangle},
+  {U"target_clones", AttrKind::target_clones},
+  {       U"inline",       AttrKind::inline_},
+  {U"always_inline", AttrKind::always_inline},
+  {     U"noinline",      AttrKind::noinline},
+  {          U"hot",           AttrKind::hot},
+  {         U"cold",          AttrKind::cold},
+  {         U"pure",          AttrKind::pure},
+  {        U"const",        AttrKind::const_},
 };
 
 [[nodiscard]] AttrKind matchAttr(const std::u32string_view attr)
 {
-  static const std::unordered_map<std::u32string_view, AttrKind> attr_map{
-    {U"nomangle", AttrKind::nomangle}
-  };
-
   const auto it = attr_map.find(attr);
 
   if (it == attr_map.end())
@@ -32,17 +48,43 @@ enum class AttrKind {
   return it->second;
 }
 
+[[nodiscard]] std::string attrName(const AttrKind kind)
+{
+  for (const auto& [name, r] : attr_map) {
+    if (r == kind)
+      return unicode::utf32toUtf8(name);
+  }
+
+  unreachable();
+}
+
 [[nodiscard]] std::unordered_set<AttrKind>
 createAttrKindsFrom(const ast::Attrs& attrs)
 {
   std::unordered_set<AttrKind> attr_kinds;
 
-  for (const auto& attr_str : attrs)
-    attr_kinds.emplace(matchAttr(attr_str));
+  for (const auto& attr : attrs)
+    attr_kinds.emplace(matchAttr(attr.name));
 
   return attr_kinds;
 }
 
+// A top level function can have two lists of attributes (e.g. '[[a]] [[b]]
+// func'), since functions also parse one for methods, so they are merged
+[[nodiscard]] ast::Attrs mergeAttrs(const ast::TopLevelWithAttr& node)
+{
+  const auto func_def = boost::get<ast::FunctionDef>(&node.top_level);
+
+  if (!func_def)
+    return node.attrs;
+
+  auto attrs = node.attrs;
+
+  attrs.insert(attrs.end(), func_def->attrs.begin(), func_def->attrs.end());
+
+  return attrs;
+}
+
 // Returns std::nullopt if there are multiple variadic arguments
 [[nodiscard]] std::optional<bool>
 isVariadicArgs(const ast::ParameterList& params)
@@ -77,6 +119,10 @@ createParamTypes(CGContext&                ctx,
   for (std::size_t i = 0; i != named_params_len; ++i) {
     const auto& param_type = params->at(i).type;
     types.at(i)            = createType(ctx, param_type, pos);
+
+    // Parameters are not detached when the function returns
+    if (types.at(i)->isFutureTy(ctx))
+      throw CodegenError{ctx.formatError(pos, "parameters cannot be futures")};
   }
 
   return types;
@@ -134,11 +180,30 @@ void createFunctionBody(CGContext&                  ctx,
                         const std::string_view      name,
                         const ast::ParameterList&   params,
                         const std::shared_ptr<Type> return_type,
-                        const ast::Stmt&            body)
+                        const ast::Stmt&            body,
+                        const PositionRange&        pos,
+                        const bool                  is_async)
 {
+  llvm::TimeTraceScope scope{"FunctionBody", name};
+
+  // Function templates are instantiated in the middle of another function
+  const auto outer_debug_location = ctx.builder.getCurrentDebugLocation();
+
+  if (ctx.debug_info) {
+    ctx.debug_info->createSubprogram(*func, name, pos);
+
+    // Until the first statement, instructions belong to the declaration
+    ctx.builder.SetCurrentDebugLocation(
+      ctx.debug_info->getLocation(*func, pos));
+  }
+
   auto const entry_bb = llvm::BasicBlock::Create(ctx.context, "", func);
   ctx.builder.SetInsertPoint(entry_bb);
 
+  // Arguments are copied to the frame
+  if (is_async)
+    beginCoroutine(ctx, func, return_type);
+
   auto argument_table = createArgumentTable(ctx, func, params, func->args());
 
   // Used to combine returns into one
@@ -166,8 +231,9 @@ void createFunctionBody(CGContext&                  ctx,
       ctx.builder.CreateBr(end_bb);
     }
     else {
-      ctx.builder.CreateStore(llvm::UndefValue::get(func->getReturnType()),
-                              return_variable);
+      ctx.builder.CreateStore(
+        llvm::UndefValue::get(return_variable->getAllocatedType()),
+        return_variable);
       ctx.builder.CreateBr(end_bb);
     }
   }
@@ -183,7 +249,17 @@ void createFunctionBody(CGContext&                  ctx,
   func->getBasicBlockList().push_back(end_bb);
   ctx.builder.SetInsertPoint(end_bb);
 
-  if (return_variable) {
+  createTaskGroupExit(ctx, func);
+
+  if (is_async) {
+    endCoroutine(ctx,
+                 func,
+                 return_variable
+                   ? ctx.builder.CreateLoad(return_variable->getAllocatedType(),
+                                            return_variable)
+                   : nullptr);
+  }
+  else if (return_variable) {
     auto const retval
       = ctx.builder.CreateLoad(return_variable->getAllocatedType(),
                                return_variable);
@@ -193,13 +269,137 @@ void createFunctionBody(CGContext&                  ctx,
     // Function that returns void
     ctx.builder.CreateRet(nullptr);
   }
+
+  ctx.builder.SetCurrentDebugLocation(outer_debug_location);
+}
+
+//===----------------------------------------------------------------------===//
+// Function attributes
+//===----------------------------------------------------------------------===//
+
+// Returns the LLVM attributes the attribute is lowered to, the first of which
+// identifies it
+// Empty if the attribute is not a function attribute
+[[nodiscard]] static std::vector<llvm::Attribute::AttrKind>
+getLLVMFnAttrs(const AttrKind kind)
+{
+  switch (kind) {
+  case AttrKind::inline_:
+    return {llvm::Attribute::InlineHint};
+  case AttrKind::always_inline:
+    return {llvm::Attribute::AlwaysInline};
+  case AttrKind::noinline:
+    return {llvm::Attribute::NoInline};
+  case AttrKind::hot:
+    return {llvm::Attribute::Hot};
+  case AttrKind::cold:
+    // Same as clang, cold functions are optimized for size
+    return {llvm::Attribute::Cold, llvm::Attribute::OptimizeForSize};
+  case AttrKind::pure:
+    return {llvm::Attribute::ReadOnly, llvm::Attribute::NoUnwind};
+  case AttrKind::const_:
+    return {llvm::Attribute::ReadNone, llvm::Attribute::NoUnwind};
+  default:
+    return {};
+  }
+}
+
+[[nodiscard]] static std::vector<AttrKind>
+getConflictingAttrs(const AttrKind kind)
+{
+  switch (kind) {
+  case AttrKind::inline_:
+  case AttrKind::always_inline:
+    return {AttrKind::noinline};
+  case AttrKind::noinline:
+    return {AttrKind::inline_, AttrKind::always_inline};
+  case AttrKind::hot:
+    return {AttrKind::cold};
+  case AttrKind::cold:
+    return {AttrKind::hot};
+  case AttrKind::pure:
+    return {AttrKind::const_};
+  case AttrKind::const_:
+    return {AttrKind::pure};
+  default:
+    return {};
+  }
+}
+
+// The attributes are checked against those already added, so this can also
+// be used for the definition of a declared function
+static void
+addFunctionAttrs(CGContext& ctx, llvm::Function* func, const ast::Attrs& attrs)
+{
+  for (const auto& attr : attrs) {
+    const auto kind = matchAttr(attr.name);
+
+    const auto llvm_attrs = getLLVMFnAttrs(kind);
+
+    if (llvm_attrs.empty())
+      continue;
+
+    const auto pos = ctx.positionOf(attr);
+
+    if (!attr.args.empty()) {
+      throw CodegenError{ctx.formatError(
+        pos,
+        fmt::format("'{}' does not take arguments", attrName(kind)))};
+    }
+
+    for (const auto conflict : getConflictingAttrs(kind)) {
+      if (func->hasFnAttribute(getLLVMFnAttrs(conflict).front())) {
+        throw CodegenError{
+          ctx.formatError(pos,
+                          fmt::format("'{}' conflicts with '{}'",
+                                      attrName(kind),
+                                      attrName(conflict)))};
+      }
+    }
+
+    for (const auto r : llvm_attrs)
+      func->addFnAttr(r);
+  }
+}
+
+[[nodiscard]] std::shared_ptr<Type>
+createReturnType(CGContext&               ctx,
+                 const ast::FunctionDecl& decl,
+                 const bool               is_async)
+{
+  const auto pos = ctx.positionOf(decl);
+
+  const auto return_type = createType(ctx, decl.return_type, pos);
+
+  if (!is_async)
+    return return_type;
+
+  if (decl.name.utf8() == "main")
+    throw CodegenError{ctx.formatError(pos, "main cannot be async")};
+
+  // The arguments of variadic functions cannot be read after a suspension
+  if (const auto is_vararg = isVariadicArgs(decl.params);
+      is_vararg && *is_vararg) {
+    throw CodegenError{ctx.formatError(
+      pos,
+      "async functions cannot have variable arguments")};
+  }
+
+  if (return_type->isRefTy(ctx)) {
+    throw CodegenError{ctx.formatError(
+      pos,
+      "the result of an async function cannot be a reference")};
+  }
+
+  return std::make_shared<FutureType>(return_type, false);
 }
 
 [[nodiscard]] llvm::Function*
 declareFunction(CGContext&                   ctx,
                 const ast::FunctionDecl&     node,
                 const std::string_view       mangled_name,
-                const std::shared_ptr<Type>& return_type)
+                const std::shared_ptr<Type>& return_type,
+                const ast::Attrs&            attrs)
 {
   if (node.params->size() && node.params->at(0).is_vararg) {
     throw CodegenError{
@@ -237,6 +437,8 @@ declareFunction(CGContext&                   ctx,
   for (std::size_t idx = 0; auto&& arg : func->args())
     arg.setName(node.params->at(idx++).name.utf8());
 
+  addFunctionAttrs(ctx, func, attrs);
+
   return func;
 }
 
@@ -289,7 +491,7 @@ void defineMethods(CGContext&          ctx,
   ctx.ns_hierarchy.push({class_name, NamespaceKind::class_});
 
   for (const auto& r : methods)
-    createTopLevel(ctx, ast::TopLevel{r});
+    createTopLevel(ctx, ast::TopLevelWithAttr{{}, {}, r});
 
   ctx.ns_hierarchy.pop();
 }
@@ -301,7 +503,7 @@ void declareMethods(CGContext&          ctx,
   ctx.ns_hierarchy.push({class_name, NamespaceKind::class_});
 
   for (const auto& r : methods)
-    createTopLevel(ctx, ast::TopLevel{r.decl});
+    createTopLevel(ctx, ast::TopLevelWithAttr{{}, r.attrs, r.decl});
 
   ctx.ns_hierarchy.pop();
 }
@@ -460,11 +662,23 @@ void createClass(CGContext&                        ctx,
       const auto type
         = createType(ctx, variable->type, ctx.positionOf(*variable));
 
+      // Members are not detached when the object is destroyed
+      if (type->isFutureTy(ctx)) {
+        throw CodegenError{
+          ctx.formatError(ctx.positionOf(*variable),
+                          "member variables cannot be futures")};
+      }
+
       type->setMutable(ctx, is_mutable);
 
       member_variables.push_back({variable->name.utf8(), type, accessibility});
     }
     else if (const auto function = boost::get<ast::FunctionDef>(&member)) {
+      if (function->is_async) {
+        throw CodegenError{ctx.formatError(ctx.positionOf(function->decl),
+                                           "methods cannot be async")};
+      }
+
       auto function_clone = *function;
 
       push_this_ptr(function_clone.decl);
@@ -576,6 +790,7 @@ void createUnion(CGContext& ctx, const ast::UnionDef& node)
 struct TopLevelVisitor : public boost::static_visitor<llvm::Function*> {
   TopLevelVisitor(CGContext& ctx, const ast::Attrs& attrs) noexcept
     : ctx{ctx}
+    , attrs{attrs}
     , attr_kinds{createAttrKindsFrom(attrs)}
   {
   }
@@ -591,7 +806,8 @@ struct TopLevelVisitor : public boost::static_visitor<llvm::Function*> {
       ctx,
       node,
       mangleFunction(node),
-      createType(ctx, node.return_type, ctx.positionOf(node)));
+      createType(ctx, node.return_type, ctx.positionOf(node)),
+      attrs);
   }
 
   llvm::Function* operator()(const ast::FunctionDef& node) const
@@ -611,7 +827,13 @@ struct TopLevelVisitor : public boost::static_visitor<llvm::Function*> {
                           fmt::format("redefinition of '{}'", name))};
       }
 
-      ctx.func_template_table.insert(std::move(key), node);
+      // Keep the attributes for the instantiation
+      auto template_node = node;
+
+      template_node.attrs = attrs;
+
+      ctx.func_template_table.insert(std::move(key),
+                                     std::move(template_node));
 
       return nullptr;
     }
@@ -627,22 +849,30 @@ struct TopLevelVisitor : public boost::static_visitor<llvm::Function*> {
     }
 
     if (!func)
-      func = (*this)(node.decl);
+      func = declareFunctionDef(node);
+    else
+      addFunctionAttrs(ctx, func, attrs);
 
     assert(func);
 
     if (!node.is_public && name != "main")
       func->setLinkage(llvm::Function::LinkageTypes::InternalLinkage);
 
-    createFunctionBody(
-      ctx,
-      func,
-      name,
-      node.decl.params,
-      createType(ctx, node.decl.return_type, ctx.positionOf(node.decl)),
-      node.body);
+    const auto pos = ctx.positionOf(node.decl);
 
-    ctx.fpm.run(*func);
+    createFunctionBody(ctx,
+                       func,
+                       name,
+                       node.decl.params,
+                       createType(ctx, node.decl.return_type, pos),
+                       node.body,
+                       pos,
+                       node.is_async);
+
+    ctx.runFunctionPasses(*func);
+
+    if (const auto attr = findAttr(AttrKind::target_clones))
+      addTargetClones(func, *attr);
 
     return func;
   }
@@ -711,21 +941,33 @@ struct TopLevelVisitor : public boost::static_visitor<llvm::Function*> {
   {
     namespace fs = std::filesystem;
 
+    ctx.imported_files.emplace_back(node.path.utf32());
+
     auto path = ctx.current_file.parent_path() / fs::path{node.path.utf32()};
 
-    const auto result
-      = parse::Parser{loadFile(path, ctx.positionOf(node)), path}.getResult();
+    auto result = parse::import_cache::find(path);
+
+    if (!result) {
+      result = std::make_shared<const parse::Parser::Result>(
+        parse::Parser{loadFile(path, ctx.positionOf(node)), path}.getResult());
+
+      parse::import_cache::insert(path, result);
+    }
+
+    // Positions refer to the input of the result
+    ctx.imported_parse_results.push_back(result);
 
-    ctx.position_cache_table.insert(path.string(), std::move(result.positions));
+    ctx.position_cache_table.insert(path.string(), result->positions);
     const auto file_backup = std::move(ctx.current_file);
-    ctx.current_file       = std::move(result.file);
+    ctx.current_file       = result->file;
 
-    for (const auto& node_with_attr : result.ast) {
+    for (const auto& node_with_attr : result->ast) {
       const auto node = node_with_attr.top_level;
 
       if (const auto func_def = boost::get<ast::FunctionDef>(&node);
           func_def && func_def->is_public) {
-        (*this)(func_def->decl);
+        TopLevelVisitor{ctx, mergeAttrs(node_with_attr)}.declareFunctionDef(
+          *func_def);
         continue;
       }
 
@@ -758,6 +1000,16 @@ struct TopLevelVisitor : public boost::static_visitor<llvm::Function*> {
   }
 
 private:
+  llvm::Function* declareFunctionDef(const ast::FunctionDef& node) const
+  {
+    return declareFunction(
+      ctx,
+      node.decl,
+      mangleFunction(node.decl),
+      createReturnType(ctx, node.decl, node.is_async),
+      attrs);
+  }
+
   void insertTemplateClassToTable(const ast::ClassDef& node) const
   {
     assert(node.isTemplate());
@@ -832,8 +1084,56 @@ private:
     return ctx.mangler.mangleFunction(node);
   }
 
+  // Returns nullptr if there is no such attribute
+  [[nodiscard]] const ast::Attr* findAttr(const AttrKind kind) const
+  {
+    for (const auto& attr : attrs) {
+      if (matchAttr(attr.name) == kind)
+        return &attr;
+    }
+
+    return nullptr;
+  }
+
+  void addTargetClones(llvm::Function* func, const ast::Attr& attr) const
+  {
+    const auto pos = ctx.positionOf(attr);
+
+    if (func->getName() == "main") {
+      throw CodegenError{
+        ctx.formatError(pos, "target_clones cannot be applied to main")};
+    }
+
+    std::vector<std::string> targets;
+
+    for (const auto& arg : attr.args) {
+      const auto target = boost::get<ast::StringLiteral>(&arg.value);
+
+      if (!arg.name.empty() || !target) {
+        throw CodegenError{
+          ctx.formatError(ctx.positionOf(arg),
+                          "target_clones takes string literals")};
+      }
+
+      targets.push_back(unicode::utf32toUtf8(target->str));
+    }
+
+    if (const auto error
+        = verifyTargetClones(llvm::Triple{ctx.module->getTargetTriple()},
+                             targets))
+      throw CodegenError{ctx.formatError(pos, *error)};
+
+    // In JIT compilation, the function is compiled for the host CPU, so it
+    // is not cloned
+    if (!ctx.jit)
+      ctx.target_clones.push_back({func, std::move(targets)});
+  }
+
   CGContext& ctx;
 
+  // Alive while visiting the node
+  const ast::Attrs& attrs;
+
   std::unordered_set<AttrKind> attr_kinds;
 };
 
@@ -845,7 +1145,9 @@ llvm::Function* createTopLevel(CGContext& ctx, const ast::TopLevel& node)
 llvm::Function* createTopLevel(CGContext&                   ctx,
                                const ast::TopLevelWithAttr& node)
 {
-  return boost::apply_visitor(TopLevelVisitor{ctx, node.attrs}, node.top_level);
+  const auto attrs = mergeAttrs(node);
+
+  return boost::apply_visitor(TopLevelVisitor{ctx, attrs}, node.top_level);
 }
 
 } // namespace twinkle::codegen
@@ -10,6 +10,7 @@
 #include <twinkle/codegen/common.hpp>
 #include <twinkle/codegen/exception.hpp>
 #include <twinkle/codegen/top_level.hpp>
+#include <twinkle/support/stats.hpp>
 
 namespace twinkle::codegen
 {
@@ -366,6 +367,22 @@ UnionType::getUnionVariantType(const std::string& tag) const
          + element_type->getMangledName(ctx);
 }
 
+[[nodiscard]] std::string VectorType::getMangledName(CGContext& ctx) const
+{
+  return "V" + boost::lexical_cast<std::string>(size) + "_"
+         + element_type->getMangledName(ctx);
+}
+
+[[nodiscard]] llvm::Type* TaskType::getLLVMType(CGContext& ctx) const
+{
+  return ctx.builder.getInt8PtrTy();
+}
+
+[[nodiscard]] llvm::Type* FutureType::getLLVMType(CGContext& ctx) const
+{
+  return ctx.builder.getInt8PtrTy();
+}
+
 void verifyType(CGContext&                   ctx,
                 const std::shared_ptr<Type>& type,
                 const PositionRange&         pos)
@@ -403,6 +420,63 @@ struct TypeVisitor : public boost::static_visitor<std::shared_ptr<Type>> {
     return std::make_shared<ArrayType>(type, node.size, false);
   }
 
+  [[nodiscard]] std::shared_ptr<Type>
+  operator()(const ast::VectorType& node) const
+  {
+    const auto type = createType(ctx, node.element_type, pos);
+
+    verifyType(ctx, type, ctx.positionOf(node));
+
+    auto const element_type = type->getLLVMType(ctx);
+
+    if (!element_type->isIntegerTy() && !element_type->isFloatingPointTy()) {
+      throw CodegenError{ctx.formatError(
+        ctx.positionOf(node),
+        "vector elements must be integers, floating point numbers or bools")};
+    }
+
+    // Same as vector_size of GCC and clang, so that the layout is the same
+    if (!llvm::isPowerOf2_32(node.size)) {
+      throw CodegenError{
+        ctx.formatError(ctx.positionOf(node),
+                        "the number of vector elements must be a power of 2")};
+    }
+
+    return std::make_shared<VectorType>(type, node.size, false);
+  }
+
+  [[nodiscard]] std::shared_ptr<Type>
+  operator()(const ast::TaskType& node) const
+  {
+    const auto type = createType(ctx, node.result_type, pos);
+
+    verifyType(ctx, type, ctx.positionOf(node));
+
+    if (type->isRefTy(ctx)) {
+      throw CodegenError{
+        ctx.formatError(ctx.positionOf(node),
+                        "the result of a task cannot be a reference")};
+    }
+
+    return std::make_shared<TaskType>(type, false);
+  }
+
+  [[nodiscard]] std::shared_ptr<Type>
+  operator()(const ast::FutureType& node) const
+  {
+    const auto type = createType(ctx, node.result_type, pos);
+
+    verifyType(ctx, type, ctx.positionOf(node));
+
+    if (type->isRefTy(ctx)) {
+      throw CodegenError{
+        ctx.formatError(ctx.positionOf(node),
+                        "the result of a future cannot be a reference")};
+    }
+
+    return std::make_shared<FutureType>(type, false);
+  }
+
   [[nodiscard]] std::shared_ptr<Type>
   operator()(const ast::PointerType& node) const
   {
@@ -483,6 +557,13 @@ private:
     const NamespaceStack&          space, // FIXME: Use this argument
     const PositionRange&           pos) const
   {
+    llvm::TimeTraceScope scope{"InstantiateClass", mangled_class_name};
+
+    if (stats::enabled()) {
+      stats::addTemplateInstantiation(stats::TemplateKind::class_,
+                                      ast.name.utf8());
+    }
+
     const TemplateArgumentsDefiner ta_definer{ctx,
                                               template_args,
                                               ast.template_params,
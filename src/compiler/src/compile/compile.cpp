@@ -9,9 +9,14 @@
 #include <twinkle/codegen/codegen.hpp>
 #include <twinkle/jit/jit.hpp>
 #include <twinkle/parse/parser.hpp>
+#include <twinkle/cache/cache.hpp>
+#include <twinkle/link/link.hpp>
 #include <twinkle/support/file.hpp>
 #include <twinkle/support/utils.hpp>
 #include <twinkle/support/exception.hpp>
+#include <twinkle/support/parallel.hpp>
+#include <twinkle/support/time_trace.hpp>
+#include <twinkle/support/stats.hpp>
 
 namespace twinkle
 {
@@ -22,7 +27,7 @@ static FilePaths emitFile(codegen::CodeGenerator& generator,
                           const std::string&      target)
 {
   if (target == EMIT_EXE_ARG)
-    return generator.emitTemporaryObjectFiles();
+    return generator.emitMemoryObjectFiles();
 
   if (target == EMIT_OBJ_ARG)
     return generator.emitObjectFiles();
@@ -52,36 +57,560 @@ getRelocationModel(const std::string_view reloc_model,
   }
 }
 
-std::optional<CompileResult> compile(const Context&         ctx,
-                                     const std::string_view argv_front)
-try {
-  std::vector<parse::Parser::Result> parse_results;
+// Parse the files in parallel
+// The results are in the same order as the files
+[[nodiscard]] static std::vector<parse::Parser::Result>
+parseFiles(const std::vector<std::string>& files,
+           const unsigned int              jobs,
+           const std::string_view          argv_front)
+{
+  std::vector<std::optional<parse::Parser::Result>> parsed(files.size());
+
+  parallelFor(jobs, files.size(), [&](const std::size_t idx) {
+    const auto& path = files[idx];
 
-  for (const auto& path : ctx.input_files) {
-    parse_results.emplace_back(
+    llvm::TimeTraceScope scope{"Parse", path};
+
+    parsed[idx].emplace(
       parse::Parser{loadFile(argv_front, path), path}.getResult());
+
+    if (stats::enabled())
+      stats::addAstNodes(parse::countAstNodes(parsed[idx]->ast));
+  });
+
+  std::vector<parse::Parser::Result> parse_results;
+  parse_results.reserve(parsed.size());
+
+  for (auto& r : parsed) {
+    stats::addFile(r->file, r->input);
+    parse_results.push_back(std::move(*r));
+  }
+
+  return parse_results;
+}
+
+// Path of the raw profile written by the instrumented program
+// %m is replaced with the signature of the program by the profile runtime, so
+// that different programs do not overwrite each other's profiles
+[[nodiscard]] static std::optional<std::string>
+getRawProfilePath(const Context& ctx)
+{
+  if (!ctx.profile_generate)
+    return std::nullopt;
+
+  return (std::filesystem::path{*ctx.profile_generate} / "default_%m.profraw")
+    .string();
+}
+
+// Returns the archive of the profile runtime (compiler-rt), which writes the
+// profile of an instrumented executable at exit
+[[nodiscard]] static std::filesystem::path
+getProfileRuntime(const std::string_view argv_front)
+{
+#ifdef TWINKLE_PROFILE_RUNTIME
+  static_cast<void>(argv_front);
+  return TWINKLE_PROFILE_RUNTIME;
+#else
+  throw ErrorBase{
+    formatError(argv_front,
+                "the compiler was built without the profile runtime "
+                "(libclang_rt.profile), so --profile-generate can only be "
+                "used for object files")};
+#endif
+}
+
+// Returns the archive of the runtime of parallel loops, tasks and async
+// functions
+// Only the parts used by the program are linked from the archive, so it is
+// linked into every executable
+// Unless --runtime is specified, the archive installed with the compiler is
+// used, and then the one in the build tree of the compiler
+[[nodiscard]] static std::filesystem::path
+getRuntime(const Context& ctx, const std::string_view argv_front)
+{
+  if (ctx.runtime) {
+    if (!std::filesystem::exists(*ctx.runtime)) {
+      throw ErrorBase{formatError(
+        argv_front,
+        fmt::format("runtime '{}' does not exist", *ctx.runtime))};
+    }
+
+    return *ctx.runtime;
+  }
+
+  // The address of any function in the executable
+  const std::filesystem::path executable = llvm::sys::fs::getMainExecutable(
+    std::string{argv_front}.c_str(),
+    reinterpret_cast<void*>(&cleanupTemporaryFiles));
+
+  if (!executable.empty()) {
+    const auto installed
+      = executable.parent_path() / TWINKLE_INSTALLED_RUNTIME;
+
+    if (std::filesystem::exists(installed))
+      return installed.lexically_normal();
   }
 
-  codegen::CodeGenerator code_generator{
+  if (std::filesystem::exists(TWINKLE_RUNTIME))
+    return TWINKLE_RUNTIME;
+
+  throw ErrorBase{formatError(
+    argv_front,
+    "the runtime (libtwinkle_rt.a) was not found next to the compiler, "
+    "specify it with --runtime")};
+}
+
+[[nodiscard]] static codegen::CodeGenerator
+createCodeGenerator(const Context&                       ctx,
+                    const std::string_view               argv_front,
+                    std::vector<parse::Parser::Result>&& parse_results)
+{
+  return codegen::CodeGenerator{
     argv_front,
     std::move(parse_results),
-    ctx.opt_level,
+    {ctx.opt_level,
+     ctx.size_level,
+     ctx.passes,
+     getRawProfilePath(ctx),
+     ctx.profile_use,
+     ctx.profile_sample_use},
     getRelocationModel(ctx.relocation_model, argv_front),
     ctx.target_triple,
-    ctx.jit};
+    codegen::getTargetCPU(ctx.mcpu, ctx.mattr, ctx.jit),
+    ctx.jit,
+    ctx.debug_line_tables || ctx.profile_sample_use,
+    ctx.jobs,
+    ctx.codegen_partitions,
+    ctx.output_dir};
+}
+
+//===----------------------------------------------------------------------===//
+// Object cache
+//===----------------------------------------------------------------------===//
+
+[[nodiscard]] static bool isCacheable(const Context& ctx)
+{
+  // A partitioned module results in multiple objects, so it is not cached
+  return ctx.cache_dir && !ctx.jit && !ctx.lto
+         && (ctx.emit_target == EMIT_EXE_ARG || ctx.emit_target == EMIT_OBJ_ARG)
+         && ctx.codegen_partitions == 1;
+}
+
+// Hash of everything other than the source files that affects the objects
+[[nodiscard]] static std::string getOptionsKey(const Context& ctx)
+{
+  // If a profile cannot be read, the code generator reports it
+  const auto hashProfile = [](const std::optional<std::string>& profile) {
+    if (!profile)
+      return std::string{};
+
+    const auto buffer
+      = llvm::MemoryBuffer::getFile(*profile,
+                                    /* IsText */ false,
+                                    /* RequiresNullTerminator */ false);
+
+    return buffer ? cache::hash({(*buffer)->getBuffer()}) : std::string{};
+  };
+
+  // 'native' depends on the host
+  const auto target_cpu = codegen::getTargetCPU(ctx.mcpu, ctx.mattr, ctx.jit);
+
+  return cache::hash({getVersion(),
+                      std::to_string(ctx.opt_level),
+                      std::to_string(ctx.size_level),
+                      ctx.passes ? "passes=" + *ctx.passes : "",
+                      ctx.profile_generate
+                        ? "profile_generate=" + *ctx.profile_generate
+                        : "",
+                      "profile_use=" + hashProfile(ctx.profile_use),
+                      "profile_sample_use="
+                        + hashProfile(ctx.profile_sample_use),
+                      ctx.debug_line_tables ? "debug_line_tables" : "",
+                      ctx.target_triple ? *ctx.target_triple
+                                        : llvm::sys::getDefaultTargetTriple(),
+                      "cpu=" + target_cpu.cpu,
+                      "features=" + target_cpu.features,
+                      ctx.relocation_model});
+}
+
+// Imported files are only known after code generation, so they are recorded
+// in a manifest stored with this key
+[[nodiscard]] static std::string
+getSourceKey(const std::string&           options_key,
+             const std::filesystem::path& path,
+             const std::string&           source)
+{
+  return cache::hash(
+    {"source", options_key, path.filename().string(), source});
+}
+
+// The key of the object also covers the contents of the files listed in the
+// manifest
+// Returns std::nullopt if some imported file could not be read
+[[nodiscard]] static std::optional<std::string>
+getObjectKey(const std::string&           source_key,
+             const std::filesystem::path& path,
+             const std::string&           manifest)
+{
+  std::string imports;
+
+  std::istringstream ss{manifest};
+
+  for (std::string line; std::getline(ss, line);) {
+    const auto buffer
+      = llvm::MemoryBuffer::getFile((path.parent_path() / line).string(),
+                                    /* IsText */ false,
+                                    /* RequiresNullTerminator */ false);
+
+    if (!buffer)
+      return std::nullopt;
+
+    imports += cache::hash({line, (*buffer)->getBuffer()});
+  }
+
+  return cache::hash({"object", source_key, imports});
+}
+
+// Only the translation units whose objects are not cached are compiled
+// Returns the created file paths
+[[nodiscard]] static FilePaths
+compileWithCache(const Context& ctx, const std::string_view argv_front)
+{
+  const cache::Cache cache{argv_front, *ctx.cache_dir, ctx.cache_policy};
+
+  const auto options_key = getOptionsKey(ctx);
+  const auto file_count  = ctx.input_files.size();
+
+  std::vector<std::string> source_keys(file_count);
+  FilePaths                created_files(file_count);
+
+  parallelFor(ctx.jobs, file_count, [&](const std::size_t idx) {
+    const std::filesystem::path path = ctx.input_files[idx];
+
+    source_keys[idx]
+      = getSourceKey(options_key, path, loadFile(argv_front, path));
+
+    const auto manifest = cache.get(source_keys[idx]);
+    if (!manifest)
+      return;
+
+    const auto object_key = getObjectKey(source_keys[idx], path, *manifest);
+    if (!object_key)
+      return;
+
+    const auto object = cache.get(*object_key);
+    if (!object)
+      return;
+
+    const auto output_file
+      = std::filesystem::path{ctx.output_dir} / (path.stem().string() + ".o");
+
+    if (ctx.emit_target == EMIT_EXE_ARG) {
+      created_files[idx]
+        = createMemoryFile(argv_front, output_file.string(), *object);
+    }
+    else {
+      writeFile(argv_front, output_file, *object);
+      created_files[idx] = output_file;
+    }
+  });
+
+  std::vector<std::size_t> missed;
+  std::vector<std::string> missed_files;
+
+  for (std::size_t idx = 0; idx < file_count; ++idx) {
+    if (created_files[idx].empty()) {
+      missed.push_back(idx);
+      missed_files.push_back(ctx.input_files[idx]);
+    }
+  }
+
+  if (missed.empty())
+    return created_files;
+
+  auto code_generator
+    = createCodeGenerator(ctx,
+                          argv_front,
+                          parseFiles(missed_files, ctx.jobs, argv_front));
+
+  const auto emitted_files  = emitFile(code_generator, ctx.emit_target);
+  const auto imported_files = code_generator.getImportedFiles();
+
+  parallelFor(ctx.jobs, missed.size(), [&](const std::size_t idx) {
+    const auto  file_idx = missed[idx];
+    const auto& path     = missed_files[idx];
+
+    created_files[file_idx] = emitted_files[idx];
+
+    std::string manifest;
+
+    for (const auto& r : imported_files[idx])
+      manifest += r.generic_string() + '\n';
+
+    cache.put(source_keys[file_idx], manifest);
+
+    const auto object_key
+      = getObjectKey(source_keys[file_idx], path, manifest);
+    if (!object_key)
+      return;
+
+    const auto object
+      = llvm::MemoryBuffer::getFile(emitted_files[idx].string(),
+                                    /* IsText */ false,
+                                    /* RequiresNullTerminator */ false);
+    if (!object)
+      return;
+
+    cache.put(*object_key, (*object)->getBuffer());
+  });
+
+  return created_files;
+}
+
+[[nodiscard]] static CompileResult
+compileModules(const Context& ctx, const std::string_view argv_front)
+{
+  if (isCacheable(ctx))
+    return AOTResult{compileWithCache(ctx, argv_front)};
+
+  auto code_generator
+    = createCodeGenerator(ctx,
+                          argv_front,
+                          parseFiles(ctx.input_files, ctx.jobs, argv_front));
 
   if (ctx.jit)
     return JITResult{code_generator.doJIT()};
-  else
-    return AOTResult{emitFile(code_generator, ctx.emit_target)};
 
-  unreachable();
+  if (ctx.lto) {
+    if (ctx.emit_target != EMIT_EXE_ARG) {
+      throw ErrorBase{formatError(
+        argv_front,
+        "link time optimization can only be used for executables")};
+    }
+
+    if (*ctx.lto == LTO_THIN_ARG) {
+      // Only used to evict entries
+      const auto cache
+        = ctx.cache_dir ? std::make_unique<cache::Cache>(argv_front,
+                                                         *ctx.cache_dir,
+                                                         ctx.cache_policy)
+                        : nullptr;
+
+      return AOTResult{code_generator.emitThinLTOObjectFiles(
+        cache ? std::make_optional(cache->getDirectory()) : std::nullopt)};
+    }
+
+    if (*ctx.lto != LTO_FULL_ARG) {
+      throw ErrorBase{formatError(
+        argv_front,
+        fmt::format("the value '{}' for --lto-mode is invalid!", *ctx.lto))};
+    }
+
+    code_generator.doLTO();
+  }
+
+  return AOTResult{emitFile(code_generator, ctx.emit_target)};
+}
+
+[[nodiscard]] static CompileResult
+compileImpl(const Context& ctx, const std::string_view argv_front)
+{
+  // The profile is written by the runtime linked into the program
+  if (ctx.profile_generate && ctx.jit) {
+    throw ErrorBase{formatError(
+      argv_front,
+      "--profile-generate cannot be used in JIT compilation")};
+  }
+
+  if (ctx.jit || ctx.emit_target != EMIT_EXE_ARG)
+    return compileModules(ctx, argv_front);
+
+  const auto profile_runtime
+    = ctx.profile_generate ? std::make_optional(getProfileRuntime(argv_front))
+                           : std::nullopt;
+
+  const auto runtime = getRuntime(ctx, argv_front);
+
+  auto created_files
+    = std::get<AOTResult>(compileModules(ctx, argv_front)).created_files;
+
+  if (profile_runtime)
+    created_files.push_back(*profile_runtime);
+
+  created_files.push_back(runtime);
+
+  return AOTResult{std::move(created_files)};
+}
+
+[[nodiscard]] static CompileResult
+compileWithTimeTrace(const Context& ctx, const std::string_view argv_front)
+{
+  if (!ctx.time_trace)
+    return compileImpl(ctx, argv_front);
+
+  const TimeTraceProfiler profiler{ctx.time_trace_granularity, argv_front};
+
+  auto result = [&] {
+    llvm::TimeTraceScope scope{"Compile"};
+    return compileImpl(ctx, argv_front);
+  }();
+
+  const auto stem = ctx.input_files.empty()
+                      ? std::filesystem::path{"twinkle"}
+                      : std::filesystem::path{ctx.input_files.front()}.stem();
+
+  profiler.write(*ctx.time_trace,
+                 (std::filesystem::path{ctx.output_dir} / stem).string());
+
+  return result;
+}
+
+std::optional<CompileResult> compile(const Context&         ctx,
+                                     const std::string_view argv_front)
+{
+  return compile(ctx, argv_front, std::cerr);
+}
+
+std::optional<CompileResult> compile(const Context&         ctx,
+                                     const std::string_view argv_front,
+                                     std::ostream&          diagnostics)
+try {
+  if (!ctx.stats && !ctx.stats_file)
+    return compileWithTimeTrace(ctx, argv_front);
+
+  const stats::Collector collector{argv_front};
+
+  auto result = compileWithTimeTrace(ctx, argv_front);
+
+  if (ctx.stats)
+    collector.print(diagnostics);
+
+  if (ctx.stats_file)
+    collector.writeJSON(*ctx.stats_file);
+
+  return result;
+}
+catch (const ErrorBase& err) {
+  diagnostics << err.what() << (isBackNewline(err.what()) ? "" : "\n")
+              << std::flush;
+
+  return std::nullopt;
+}
+
+[[nodiscard]] std::vector<BatchResult>
+compileBatch(const std::vector<Context>& contexts,
+             const std::string_view      argv_front,
+             const unsigned int          threads)
+{
+  // The host target is initialized before the jobs start, and the imported
+  // files are parsed once while the cache is enabled
+  codegen::initializeTargets(std::nullopt);
+
+  // The cache is disabled again after the batch, unless it was enabled by the
+  // caller (e.g. the compile server)
+  const auto import_cache_enabled = parse::import_cache::isEnabled();
+
+  parse::import_cache::enable();
+
+  const auto import_cache_guard = llvm::make_scope_exit([&] {
+    if (!import_cache_enabled)
+      parse::import_cache::disable();
+  });
+
+  std::vector<std::optional<CompileResult>> results(contexts.size());
+  std::vector<std::string>                  diagnostics(contexts.size());
+
+  parallelFor(threads, contexts.size(), [&](const std::size_t idx) {
+    const auto& ctx = contexts[idx];
+
+    std::ostringstream stream;
+
+    // The profiler and the statistics are per process
+    if (ctx.time_trace || ctx.stats || ctx.stats_file) {
+      stream << formatError(argv_front,
+                            "--time-trace and --stats cannot be used in "
+                            "batch compilation\n");
+    }
+    else if (auto result = compile(ctx, argv_front, stream))
+      results[idx].emplace(std::move(*result));
+
+    diagnostics[idx] = stream.str();
+  });
+
+  std::vector<BatchResult> batch_results;
+  batch_results.reserve(contexts.size());
+
+  for (std::size_t idx = 0; idx < contexts.size(); ++idx) {
+    batch_results.push_back(
+      {std::move(results[idx]), std::move(diagnostics[idx])});
+  }
+
+  return batch_results;
+}
+
+void cleanupTemporaryFiles() noexcept
+{
+  removeTemporaryFiles();
+}
+
+void initializeServer()
+{
+  codegen::initializeTargets(std::nullopt);
+  parse::import_cache::enable();
+}
+
+[[nodiscard]] std::vector<std::string> getImportCacheMisses()
+{
+  std::vector<std::string> files;
+
+  for (const auto& r : parse::import_cache::getMisses())
+    files.push_back(r.string());
+
+  return files;
+}
+
+void warmImportCache(const std::vector<std::string>& files,
+                     const std::string_view          argv_front) noexcept
+{
+  for (const auto& r : files) {
+    try {
+      parse::import_cache::insert(argv_front, r);
+    }
+    catch (const ErrorBase&) {
+    }
+    catch (const std::filesystem::filesystem_error&) {
+    }
+  }
+}
+
+[[nodiscard]] std::filesystem::path getExecutablePath(const Context& ctx)
+{
+  return std::filesystem::path{ctx.output_dir} / "a.out";
+}
+
+[[nodiscard]] bool hasInternalLinker() noexcept
+{
+  return link::hasInternalLinker();
+}
+
+[[nodiscard]] int linkInProcess(const Context&                            ctx,
+                                const std::vector<std::filesystem::path>& files,
+                                const std::string_view argv_front)
+try {
+  return link::linkInProcess(argv_front,
+                             getExecutablePath(ctx),
+                             files,
+                             ctx.linked_libs,
+                             ctx.target_triple,
+                             ctx.relocation_model == "pic")
+           ? EXIT_SUCCESS
+           : EXIT_FAILURE;
 }
 catch (const ErrorBase& err) {
   std::cerr << err.what() << (isBackNewline(err.what()) ? "" : "\n")
             << std::flush;
 
-  return std::nullopt;
+  return EXIT_FAILURE;
 }
 
 } // namespace twinkle
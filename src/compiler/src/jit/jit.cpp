@@ -7,6 +7,9 @@
 
 #include <twinkle/jit/jit.hpp>
 #include <twinkle/support/utils.hpp>
+#include <parallel.h>
+#include <task.h>
+#include <async.h>
 
 namespace twinkle::jit
 {
@@ -15,11 +18,14 @@ JitCompiler::JitCompiler(
   std::unique_ptr<llvm::orc::ExecutionSession>    exec_session,
   std::unique_ptr<llvm::orc::EPCIndirectionUtils> epciu,
   llvm::orc::JITTargetMachineBuilder              jit_tmb,
-  llvm::DataLayout                                data_layout)
+  llvm::DataLayout                                data_layout,
+  const codegen::OptimizationOptions&             options)
   : exec_session{std::move(exec_session)}
   , epciu{std::move(epciu)}
   , data_layout{std::move(data_layout)}
   , mangle{*this->exec_session, this->data_layout}
+  , jit_tmb{jit_tmb}
+  , optimization_options{options}
   , object_layer{*this->exec_session,
                  []() {
                    return std::make_unique<llvm::SectionMemoryManager>();
@@ -28,7 +34,12 @@ JitCompiler::JitCompiler(
                   object_layer,
                   std::make_unique<llvm::orc::ConcurrentIRCompiler>(
                     std::move(jit_tmb))}
-  , optimize_layer(*this->exec_session, compile_layer, optimizeModule)
+  , optimize_layer(*this->exec_session,
+                   compile_layer,
+                   [this](llvm::orc::ThreadSafeModule                     tsm,
+                          const llvm::orc::MaterializationResponsibility& mr) {
+                     return optimizeModule(std::move(tsm), mr);
+                   })
   , cod_layer{*this->exec_session,
               optimize_layer,
               this->epciu->getLazyCallThroughManager(),
@@ -40,6 +51,38 @@ JitCompiler::JitCompiler(
   main_jd.addGenerator(llvm::cantFail(
     llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
       data_layout.getGlobalPrefix())));
+
+  // The runtime is linked into the compiler, whose symbols cannot be searched
+  // for
+  // It is searched after the program, so that the program can replace the
+  // allocator of the frames of async functions
+  auto& runtime_jd = this->exec_session->createBareJITDylib("<runtime>");
+
+  main_jd.addToLinkOrder(runtime_jd);
+
+  llvm::cantFail(runtime_jd.define(llvm::orc::absoluteSymbols(
+    {{mangle("__twinkle_parallel_for"),
+      llvm::JITEvaluatedSymbol::fromPointer(&__twinkle_parallel_for)},
+     {mangle("__twinkle_spawn"),
+      llvm::JITEvaluatedSymbol::fromPointer(&__twinkle_spawn)},
+     {mangle("__twinkle_join"),
+      llvm::JITEvaluatedSymbol::fromPointer(&__twinkle_join)},
+     {mangle("__twinkle_sync"),
+      llvm::JITEvaluatedSymbol::fromPointer(&__twinkle_sync)},
+     {mangle("__twinkle_task_group_exit"),
+      llvm::JITEvaluatedSymbol::fromPointer(&__twinkle_task_group_exit)},
+     {mangle("__twinkle_async_schedule"),
+      llvm::JITEvaluatedSymbol::fromPointer(&__twinkle_async_schedule)},
+     {mangle("__twinkle_async_wait_fd"),
+      llvm::JITEvaluatedSymbol::fromPointer(&__twinkle_async_wait_fd)},
+     {mangle("__twinkle_async_block_on"),
+      llvm::JITEvaluatedSymbol::fromPointer(&__twinkle_async_block_on)},
+     {mangle("__twinkle_async_run"),
+      llvm::JITEvaluatedSymbol::fromPointer(&__twinkle_async_run)},
+     {mangle("__twinkle_async_frame_alloc"),
+      llvm::JITEvaluatedSymbol::fromPointer(&__twinkle_async_frame_alloc)},
+     {mangle("__twinkle_async_frame_free"),
+      llvm::JITEvaluatedSymbol::fromPointer(&__twinkle_async_frame_free)}})));
 }
 
 JitCompiler::~JitCompiler()
@@ -50,7 +93,10 @@ JitCompiler::~JitCompiler()
     exec_session->reportError(std::move(err));
 }
 
-[[nodiscard]] llvm::Expected<std::unique_ptr<JitCompiler>> JitCompiler::create()
+[[nodiscard]] llvm::Expected<std::unique_ptr<JitCompiler>>
+JitCompiler::create(const codegen::OptimizationOptions& options,
+                    const std::string&                  cpu,
+                    const std::string&                  features)
 {
   auto epc = llvm::orc::SelfExecutorProcessControl::Create();
   if (!epc)
@@ -74,6 +120,9 @@ JitCompiler::~JitCompiler()
   llvm::orc::JITTargetMachineBuilder jtmb(
     exec_session->getExecutorProcessControl().getTargetTriple());
 
+  jtmb.setCPU(cpu);
+  jtmb.addFeatures(llvm::SubtargetFeatures{features}.getFeatures());
+
   auto dl = jtmb.getDefaultDataLayoutForTarget();
   if (!dl)
     return dl.takeError();
@@ -81,7 +130,8 @@ JitCompiler::~JitCompiler()
   return std::make_unique<JitCompiler>(std::move(exec_session),
                                        std::move(*epciu),
                                        std::move(jtmb),
-                                       std::move(*dl));
+                                       std::move(*dl),
+                                       options);
 }
 
 [[nodiscard]] llvm::Error
@@ -95,29 +145,23 @@ JitCompiler::addModule(llvm::orc::ThreadSafeModule  thread_safe_module,
 }
 
 [[nodiscard]] llvm::Expected<llvm::orc::ThreadSafeModule>
-JitCompiler::optimizeModule(llvm::orc::ThreadSafeModule tsm,
-                            const llvm::orc::MaterializationResponsibility&)
+JitCompiler::optimizeModule(
+  llvm::orc::ThreadSafeModule tsm,
+  const llvm::orc::MaterializationResponsibility&) const
 {
-  tsm.withModuleDo([](llvm::Module& m) {
-    // Create a function pass manager
-    auto fpm = std::make_unique<llvm::legacy::FunctionPassManager>(&m);
-
-    // Add some optimizations
-    {
-      llvm::PassManagerBuilder builder;
-
-      builder.OptLevel = 2;
-
-      builder.populateFunctionPassManager(*fpm);
-
-      fpm->doInitialization();
-    }
-
-    // Run the optimizations over all functions in the module being added to
-    // the JIT
-    for (auto& f : m)
-      fpm->run(f);
-  });
+  // Modules are compiled concurrently, so each needs its own target machine
+  auto target_machine
+    = llvm::orc::JITTargetMachineBuilder{jit_tmb}.createTargetMachine();
+  if (!target_machine)
+    return target_machine.takeError();
+
+  if (auto err = tsm.withModuleDo([&](llvm::Module& m) {
+        return codegen::optimizeModule(m,
+                                       target_machine->get(),
+                                       optimization_options);
+      })) {
+    return std::move(err);
+  }
 
   return std::move(tsm);
 }
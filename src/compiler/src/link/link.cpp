@@ -0,0 +1,208 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#include <twinkle/link/link.hpp>
+#include <twinkle/support/utils.hpp>
+
+#ifdef TWINKLE_HAS_LLD
+#include <lld/Common/Driver.h>
+#endif
+
+namespace twinkle::link
+{
+
+#ifdef TWINKLE_HAS_LLD
+
+namespace fs = std::filesystem;
+
+// Target dependent parameters of the linker
+struct LinuxTarget {
+  std::string_view multiarch;      // e.g. x86_64-linux-gnu
+  std::string_view emulation;      // -m
+  std::string_view dynamic_linker; // -dynamic-linker
+};
+
+[[nodiscard]] static std::optional<LinuxTarget>
+getLinuxTarget(const llvm::Triple& triple)
+{
+  if (!triple.isOSLinux())
+    return std::nullopt;
+
+  switch (triple.getArch()) {
+  case llvm::Triple::x86_64:
+    return LinuxTarget{"x86_64-linux-gnu",
+                       "elf_x86_64",
+                       "/lib64/ld-linux-x86-64.so.2"};
+  case llvm::Triple::aarch64:
+    return LinuxTarget{"aarch64-linux-gnu",
+                       "aarch64linux",
+                       "/lib/ld-linux-aarch64.so.1"};
+  default:
+    return std::nullopt;
+  }
+}
+
+// Returns the directory containing crt1.o
+[[nodiscard]] static std::optional<fs::path>
+findLibcDirectory(const LinuxTarget& target)
+{
+  for (const auto& r :
+       {fs::path{"/usr/lib"} / target.multiarch, fs::path{"/usr/lib64"},
+        fs::path{"/usr/lib"}}) {
+    if (fs::exists(r / "crt1.o"))
+      return r;
+  }
+
+  return std::nullopt;
+}
+
+// Returns the directory of the newest gcc runtime containing crtbegin.o
+[[nodiscard]] static std::optional<fs::path>
+findGccRuntimeDirectory(const LinuxTarget& target)
+{
+  const auto arch
+    = target.multiarch.substr(0, target.multiarch.find('-'));
+
+  std::optional<fs::path>           found;
+  std::optional<llvm::VersionTuple> found_version;
+
+  std::error_code ec;
+
+  for (const auto& triple_dir : fs::directory_iterator{"/usr/lib/gcc", ec}) {
+    // e.g. x86_64-linux-gnu, x86_64-redhat-linux
+    if (!triple_dir.path().filename().string().starts_with(arch))
+      continue;
+
+    for (const auto& version_dir :
+         fs::directory_iterator{triple_dir.path(), ec}) {
+      llvm::VersionTuple version;
+
+      if (version.tryParse(version_dir.path().filename().string())
+          || !fs::exists(version_dir.path() / "crtbegin.o"))
+        continue;
+
+      if (!found_version || *found_version < version) {
+        found         = version_dir.path();
+        found_version = version;
+      }
+    }
+  }
+
+  return found;
+}
+
+#endif // TWINKLE_HAS_LLD
+
+[[nodiscard]] bool hasInternalLinker() noexcept
+{
+#ifdef TWINKLE_HAS_LLD
+  return true;
+#else
+  return false;
+#endif
+}
+
+[[nodiscard]] bool
+linkInProcess(const std::string_view                    argv_front,
+              const std::filesystem::path&              output_file,
+              const std::vector<std::filesystem::path>& files,
+              const std::vector<std::string>&           linked_libs,
+              const std::optional<std::string>&         target_triple,
+              const bool                                pie)
+{
+#ifdef TWINKLE_HAS_LLD
+  const llvm::Triple triple{target_triple ? *target_triple
+                                          : llvm::sys::getDefaultTargetTriple()};
+
+  const auto target = getLinuxTarget(triple);
+
+  if (!target) {
+    throw LinkError{formatError(
+      argv_front,
+      fmt::format("the internal linker does not support target {}, use "
+                  "--linker to specify an external linker",
+                  triple.str()))};
+  }
+
+  const auto libc_dir = findLibcDirectory(*target);
+  const auto gcc_dir  = findGccRuntimeDirectory(*target);
+
+  if (!libc_dir || !gcc_dir) {
+    throw LinkError{
+      formatError(argv_front,
+                  "could not find the C runtime files, use --linker to "
+                  "specify an external linker")};
+  }
+
+  // Keep the strings alive until lld returns
+  std::vector<std::string> args{
+    "ld.lld",
+    "-o",
+    output_file.string(),
+    pie ? "-pie" : "-no-pie",
+    "--eh-frame-hdr",
+    "-m",
+    std::string{target->emulation},
+    "-dynamic-linker",
+    std::string{target->dynamic_linker},
+    (*libc_dir / (pie ? "Scrt1.o" : "crt1.o")).string(),
+    (*libc_dir / "crti.o").string(),
+    (*gcc_dir / (pie ? "crtbeginS.o" : "crtbegin.o")).string(),
+    "-L" + gcc_dir->string(),
+    "-L" + libc_dir->string(),
+  };
+
+  for (const auto& r : files)
+    args.push_back(r.string());
+
+  for (const auto& r : linked_libs)
+    args.push_back("-l" + r);
+
+  // libpthread is used by the runtime of parallel loops, and is a part of libc
+  // since glibc 2.34
+  for (const auto& r : {"--as-needed",
+                        "-lpthread",
+                        "--no-as-needed",
+                        "-lgcc",
+                        "--as-needed",
+                        "-lgcc_s",
+                        "--no-as-needed",
+                        "-lc",
+                        "-lgcc",
+                        "--as-needed",
+                        "-lgcc_s",
+                        "--no-as-needed"})
+    args.emplace_back(r);
+
+  args.push_back((*gcc_dir / (pie ? "crtendS.o" : "crtend.o")).string());
+  args.push_back((*libc_dir / "crtn.o").string());
+
+  std::vector<const char*> argv;
+
+  for (const auto& r : args)
+    argv.push_back(r.c_str());
+
+  return lld::elf::link(argv,
+                        llvm::outs(),
+                        llvm::errs(),
+                        /* exitEarly */ false,
+                        /* disableOutput */ false);
+#else
+  static_cast<void>(output_file);
+  static_cast<void>(files);
+  static_cast<void>(linked_libs);
+  static_cast<void>(target_triple);
+  static_cast<void>(pie);
+
+  throw LinkError{formatError(argv_front,
+                              "the compiler was built without the internal "
+                              "linker, use --linker to specify an external "
+                              "linker")};
+#endif
+}
+
+} // namespace twinkle::link
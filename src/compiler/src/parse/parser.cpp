@@ -11,6 +11,8 @@
 #include <twinkle/codegen/type.hpp>
 #include <twinkle/codegen/kind.hpp>
 #include <twinkle/parse/exception.hpp>
+#include <twinkle/support/file.hpp>
+#include <pthread.h>
 
 namespace x3     = boost::spirit::x3;
 namespace fusion = boost::fusion;
@@ -252,6 +254,12 @@ struct BuiltinMacroSymbols : UnicodeSymbols<codegen::BuiltinMacroKind> {
       (U"__builtin_huge_valf", codegen::BuiltinMacroKind::huge_valf)
       (U"__builtin_huge_val", codegen::BuiltinMacroKind::huge_val)
       (U"__builtin_infinity", codegen::BuiltinMacroKind::infinity_)
+      (U"__ATOMIC_RELAXED", codegen::BuiltinMacroKind::atomic_relaxed)
+      (U"__ATOMIC_CONSUME", codegen::BuiltinMacroKind::atomic_consume)
+      (U"__ATOMIC_ACQUIRE", codegen::BuiltinMacroKind::atomic_acquire)
+      (U"__ATOMIC_RELEASE", codegen::BuiltinMacroKind::atomic_release)
+      (U"__ATOMIC_ACQ_REL", codegen::BuiltinMacroKind::atomic_acq_rel)
+      (U"__ATOMIC_SEQ_CST", codegen::BuiltinMacroKind::atomic_seq_cst)
     ;
     // clang-format on
   }
@@ -285,6 +293,9 @@ DECLARE_X3_RULE(user_defined_type, ast::UserDefinedType, "user defined type")
 DECLARE_X3_RULE(user_defined_template_type,
                 ast::UserDefinedTemplateType,
                 "user defined template type")
+DECLARE_X3_RULE(vector_type, ast::VectorType, "vector type")
+DECLARE_X3_RULE(task_type, ast::TaskType, "task type")
+DECLARE_X3_RULE(future_type, ast::FutureType, "future type")
 DECLARE_X3_RULE(type_primary, ast::Type, "type primary")
 
 //===----------------------------------------------------------------------===//
@@ -292,6 +303,7 @@ DECLARE_X3_RULE(type_primary, ast::Type, "type primary")
 //===----------------------------------------------------------------------===//
 
 DECLARE_X3_RULE_NO_ATTR(punct, "punctuation character")
+DECLARE_X3_RULE_NO_ATTR(keyword_end, "end of keyword")
 DECLARE_X3_RULE(identifier_internal, std::u32string, "identifier")
 DECLARE_X3_RULE(identifier, ast::Identifier, "identifier")
 DECLARE_X3_RULE(path_internal, std::u32string, "path")
@@ -310,6 +322,8 @@ DECLARE_X3_RULE(boolean_literal, bool, "boolean literal")
 DECLARE_X3_RULE(escape_char, unsigned char, "escape character")
 DECLARE_X3_RULE(string_literal, ast::StringLiteral, "string literal")
 DECLARE_X3_RULE(char_literal, ast::CharLiteral, "character literal")
+DECLARE_X3_RULE(attribute_arg, ast::AttrArg, "attribute argument")
+DECLARE_X3_RULE(attribute_item, ast::Attr, "attribute")
 DECLARE_X3_RULE(attribute, ast::Attrs, "attribute")
 DECLARE_X3_RULE(builtin_macro, ast::BuiltinMacro, "builtin macro")
 DECLARE_X3_RULE_NO_ATTR(space, "space")
@@ -346,6 +360,12 @@ DECLARE_X3_RULE(new_internal, ast::New, "new operation")
 DECLARE_X3_RULE(new_, ast::Expr, "new operation")
 DECLARE_X3_RULE(delete_internal, ast::Delete, "delete operation")
 DECLARE_X3_RULE(delete_, ast::Expr, "delete operation")
+DECLARE_X3_RULE(spawn_internal, ast::Spawn, "spawn operation")
+DECLARE_X3_RULE(spawn, ast::Expr, "spawn operation")
+DECLARE_X3_RULE(join_internal, ast::Join, "join operation")
+DECLARE_X3_RULE(join, ast::Expr, "join operation")
+DECLARE_X3_RULE(await_internal, ast::Await, "await operation")
+DECLARE_X3_RULE(await_, ast::Expr, "await operation")
 DECLARE_X3_RULE(dereference, ast::Expr, "dereference operation")
 DECLARE_X3_RULE(member_access, ast::Expr, "member access operation")
 DECLARE_X3_RULE(subscript, ast::Expr, "subscript operation")
@@ -374,6 +394,7 @@ DECLARE_X3_RULE(_while, ast::While, "while statement")
 DECLARE_X3_RULE(_for, ast::For, "for statement")
 DECLARE_X3_RULE(_break, ast::Break, "break statement")
 DECLARE_X3_RULE(_continue, ast::Continue, "continue statement")
+DECLARE_X3_RULE(_sync, ast::Sync, "sync statement")
 DECLARE_X3_RULE(match_case, ast::MatchCase, "match statement case")
 DECLARE_X3_RULE(match, ast::Match, "match statement")
 DECLARE_X3_RULE(stmt, ast::Stmt, "statement")
@@ -383,6 +404,7 @@ DECLARE_X3_RULE(stmt, ast::Stmt, "statement")
 //===----------------------------------------------------------------------===//
 
 DECLARE_X3_RULE(is_public, bool, "public")
+DECLARE_X3_RULE(is_async, bool, "async")
 DECLARE_X3_RULE(template_params, ast::TemplateParameters, "template parameters")
 DECLARE_X3_RULE_NO_ATTR(class_key, "class key")
 DECLARE_X3_RULE_NO_ATTR(union_key, "union key")
@@ -449,6 +471,10 @@ DECLARE_X3_RULE(translation_unit, ast::TranslationUnit, "translation unit")
 const auto punct_def
   = x3::unicode::punct | lit(U"^") | lit(U"\"") | lit(U"<") | lit(U">");
 
+// Keywords are not followed by a character of an identifier
+const auto keyword_end_def
+  = x3::no_skip[!((x3::unicode::graph - punct) | lit(U"_"))];
+
 const auto identifier_internal_def
   = x3::raw[x3::lexeme[(x3::unicode::graph - (x3::unicode::digit | punct)
                         | lit(U"_"))
@@ -506,8 +532,16 @@ const auto char_literal_def
   = lit(U"'") >> (char_ - (lit(U"'") | x3::eol | lit(U"\\")) | escape_char)
     > lit(U"'");
 
+// Named arguments are like 'width: 8'
+const auto attribute_arg_def = -(identifier_internal >> lit(U":"))
+                               >> (uint_32bit | string_literal);
+
+const auto attribute_item_def
+  = identifier_internal
+    >> -(lit(U"(") > (attribute_arg % lit(U",")) > lit(U")"));
+
 const auto attribute_def
-  = lit(U"[[") >> (identifier_internal % lit(U",")) > lit(U"]]");
+  = lit(U"[[") >> (attribute_item % lit(U",")) > lit(U"]]");
 
 // Do not use the expectation operator because it may be a comparison
 // operation
@@ -525,6 +559,7 @@ const auto builtin_macro_def = builtin_macro_symbols;
 const auto space_def = x3::unicode::space;
 
 BOOST_SPIRIT_DEFINE(punct)
+BOOST_SPIRIT_DEFINE(keyword_end)
 BOOST_SPIRIT_DEFINE(identifier_internal)
 BOOST_SPIRIT_DEFINE(identifier)
 BOOST_SPIRIT_DEFINE(path_internal)
@@ -543,6 +578,8 @@ BOOST_SPIRIT_DEFINE(boolean_literal)
 BOOST_SPIRIT_DEFINE(escape_char)
 BOOST_SPIRIT_DEFINE(string_literal)
 BOOST_SPIRIT_DEFINE(char_literal)
+BOOST_SPIRIT_DEFINE(attribute_arg)
+BOOST_SPIRIT_DEFINE(attribute_item)
 BOOST_SPIRIT_DEFINE(attribute)
 BOOST_SPIRIT_DEFINE(builtin_macro)
 BOOST_SPIRIT_DEFINE(space)
@@ -576,7 +613,18 @@ const auto user_defined_type_def = identifier;
 
 const auto user_defined_template_type_def = user_defined_type >> template_args;
 
-const auto type_primary_def = builtin_type | user_defined_template_type
+// Not expectations, since 'vec', 'task' and 'future' can also be variable
+// names in expressions
+const auto vector_type_def = lit(U"vec") >> lit(U"<") >> type_name >> lit(U",")
+                             >> uint_32bit >> lit(U">");
+
+const auto task_type_def = lit(U"task") >> lit(U"<") >> type_name >> lit(U">");
+
+const auto future_type_def
+  = lit(U"future") >> lit(U"<") >> type_name >> lit(U">");
+
+const auto type_primary_def = builtin_type | vector_type | task_type
+                              | future_type | user_defined_template_type
                               | user_defined_type
                               | (lit(U"(") >> type_name >> lit(U")"));
 
@@ -589,6 +637,9 @@ BOOST_SPIRIT_DEFINE(pointer_type_internal)
 BOOST_SPIRIT_DEFINE(pointer_type)
 BOOST_SPIRIT_DEFINE(user_defined_type)
 BOOST_SPIRIT_DEFINE(user_defined_template_type)
+BOOST_SPIRIT_DEFINE(vector_type)
+BOOST_SPIRIT_DEFINE(task_type)
+BOOST_SPIRIT_DEFINE(future_type)
 BOOST_SPIRIT_DEFINE(type_primary)
 
 //===----------------------------------------------------------------------===//
@@ -709,7 +760,20 @@ const auto new_internal_def = lit(U"new") >> x3::no_skip[space] > type_name
 const auto new__def = new_internal | delete_;
 
 const auto delete_internal_def = lit(U"delete") >> x3::no_skip[space] > expr;
-const auto delete__def         = delete_internal | member_access;
+const auto delete__def         = delete_internal | spawn;
+
+// If the operand cannot be parsed, the keyword may be an identifier
+const auto spawn_internal_def
+  = lit(U"spawn") >> x3::no_skip[space] >> member_access;
+const auto spawn_def = spawn_internal | join;
+
+const auto join_internal_def
+  = lit(U"join") >> keyword_end >> member_access;
+const auto join_def = join_internal | await_;
+
+const auto await_internal_def
+  = lit(U"await") >> keyword_end >> member_access;
+const auto await__def = await_internal | member_access;
 
 const auto member_access_def
   = subscript[action::assignAttrToVal]
@@ -769,6 +833,12 @@ BOOST_SPIRIT_DEFINE(new_internal)
 BOOST_SPIRIT_DEFINE(new_)
 BOOST_SPIRIT_DEFINE(delete_internal)
 BOOST_SPIRIT_DEFINE(delete_)
+BOOST_SPIRIT_DEFINE(spawn_internal)
+BOOST_SPIRIT_DEFINE(spawn)
+BOOST_SPIRIT_DEFINE(join_internal)
+BOOST_SPIRIT_DEFINE(join)
+BOOST_SPIRIT_DEFINE(await_internal)
+BOOST_SPIRIT_DEFINE(await_)
 BOOST_SPIRIT_DEFINE(dereference)
 BOOST_SPIRIT_DEFINE(member_access)
 BOOST_SPIRIT_DEFINE(subscript)
@@ -796,16 +866,18 @@ const auto variable_def_def = lit(U"let") > -variable_qualifier > identifier
 
 const auto _return_def = lit(U"return") > -expr;
 
-const auto _if_def
-  = lit(U"if") > lit(U"(") > expr > lit(U")") > stmt > -(lit(U"else") > stmt);
+const auto _if_def = -attribute >> lit(U"if") > lit(U"(") > expr > lit(U")")
+                     > stmt > -(lit(U"else") > stmt);
 
-const auto _loop_def = lit(U"loop") > stmt;
+const auto _loop_def = -attribute >> lit(U"loop") > stmt;
 
-const auto _while_def = lit(U"while") > lit(U"(") > expr /* Condition */
+const auto _while_def = -attribute >> lit(U"while") > lit(U"(")
+                        > expr /* Condition */
                         > lit(U")") > stmt;
 
 const auto _for_def
-  = lit(U"for") > lit(U"(") > -(assignment | variable_def)   /* Init */
+  = -attribute >> lit(U"for") > lit(U"(")
+    > -(assignment | variable_def)                           /* Init */
     > lit(U";") > -expr                                      /* Condition */
     > lit(U";") > -(prefix_increment_decrement | assignment) /* Loop */
     > lit(U")") > stmt;
@@ -814,6 +886,8 @@ const auto _break_def = lit(U"break") >> x3::attr(ast::Break{});
 
 const auto _continue_def = lit(U"continue") >> x3::attr(ast::Continue{});
 
+const auto _sync_def = lit(U"sync") >> keyword_end >> x3::attr(ast::Sync{});
+
 const auto match_case_def = expr > lit(U"=>") > stmt;
 
 const auto match_def
@@ -823,7 +897,7 @@ const auto stmt_def
   = lit(U";")                       /* Null statement */
     | lit(U"{") > *stmt > lit(U"}") /* Compound statement */
     | _loop | _while | _for | _if | match | _break >> lit(U";")
-    | _continue >> lit(U";") | _return >> lit(U";")
+    | _continue >> lit(U";") | _sync >> lit(U";") | _return >> lit(U";")
     | prefix_increment_decrement >> lit(U";") | assignment >> lit(U";")
     | variable_def >> lit(U";") | expr_stmt >> lit(U";");
 
@@ -838,6 +912,7 @@ BOOST_SPIRIT_DEFINE(_while)
 BOOST_SPIRIT_DEFINE(_for)
 BOOST_SPIRIT_DEFINE(_break)
 BOOST_SPIRIT_DEFINE(_continue)
+BOOST_SPIRIT_DEFINE(_sync)
 BOOST_SPIRIT_DEFINE(match_case)
 BOOST_SPIRIT_DEFINE(match)
 BOOST_SPIRIT_DEFINE(stmt)
@@ -848,6 +923,8 @@ BOOST_SPIRIT_DEFINE(stmt)
 
 const auto is_public_def = x3::matches[lit(U"pub")];
 
+const auto is_async_def = x3::matches[lit(U"async")];
+
 const auto template_params_def
   = -(lit(U"<") > (identifier % lit(U",")) > lit(U">"));
 
@@ -898,7 +975,12 @@ const auto function_proto_def
 const auto function_decl_def
   = lit(U"declare") >> lit(U"func") > function_proto > lit(U";");
 
-const auto function_def_def = is_public >> lit(U"func") > function_proto > stmt;
+// Attributes are parsed here for methods, since those of top level functions
+// are consumed by top_level_with_attr
+// If a top level function has another list, it is parsed here, and merged by
+// the code generator
+const auto function_def_def
+  = -attribute >> is_public >> is_async >> lit(U"func") > function_proto > stmt;
 
 const auto type_def_def
   = lit(U"typedef") > identifier > lit(U"=") > type_name > lit(U";");
@@ -919,6 +1001,7 @@ const auto top_level_list_def = *top_level_with_attr;
 
 BOOST_SPIRIT_DEFINE(name_space)
 BOOST_SPIRIT_DEFINE(is_public)
+BOOST_SPIRIT_DEFINE(is_async)
 BOOST_SPIRIT_DEFINE(template_params)
 BOOST_SPIRIT_DEFINE(class_key)
 BOOST_SPIRIT_DEFINE(union_key)
@@ -992,9 +1075,13 @@ Parser::Parser(std::string&& input, const std::filesystem::path& file)
 
 void Parser::parse()
 {
+  // Diagnostics are buffered and carried by the exception so that they are not
+  // interleaved when files are parsed in parallel
+  std::ostringstream diagnostics;
+
   x3::error_handler<InputIterator> error_handler{u32_first,
                                                  u32_last,
-                                                 std::cerr,
+                                                 diagnostics,
                                                  file.string()};
 
   const auto parser = x3::with<x3::error_handler_tag>(
@@ -1004,8 +1091,221 @@ void Parser::parse()
   if (!x3::phrase_parse(u32_first, u32_last, parser, syntax::skipper, ast)
       || u32_first != u32_last) {
     // Some error occurred in parsing.
-    throw ParseError{"compilation terminated."};
+    throw ParseError{diagnostics.str() + "compilation terminated."};
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Import cache
+//===----------------------------------------------------------------------===//
+
+namespace import_cache
+{
+
+namespace
+{
+
+struct Entry {
+  std::filesystem::file_time_type last_write_time;
+  std::uintmax_t                  file_size;
+
+  std::shared_ptr<const Parser::Result> result;
+};
+
+std::atomic<bool>                      is_enabled;
+std::mutex                             mutex;
+std::unordered_map<std::string, Entry> entries;
+std::vector<std::filesystem::path>     misses;
+
+} // namespace
+
+void enable()
+{
+  // The compile server fills the cache on a thread while it forks the
+  // compilations, so the cache is locked across fork, so that a child does not
+  // inherit it locked by the thread
+  static std::once_flag fork_handlers;
+
+  std::call_once(fork_handlers, [] {
+    pthread_atfork([] { mutex.lock(); },
+                   [] { mutex.unlock(); },
+                   [] { mutex.unlock(); });
+  });
+
+  is_enabled = true;
+}
+
+void disable()
+{
+  is_enabled = false;
+
+  const std::lock_guard lock{mutex};
+
+  entries.clear();
+  misses.clear();
+}
+
+[[nodiscard]] bool isEnabled()
+{
+  return is_enabled;
+}
+
+[[nodiscard]] std::shared_ptr<const Parser::Result>
+find(const std::filesystem::path& path)
+{
+  if (!is_enabled)
+    return nullptr;
+
+  const auto absolute_path = std::filesystem::absolute(path).lexically_normal();
+
+  const std::lock_guard lock{mutex};
+
+  if (const auto it = entries.find(absolute_path.string());
+      it != entries.end()) {
+    std::error_code ec;
+
+    const auto& [last_write_time, file_size, result] = it->second;
+
+    if (std::filesystem::last_write_time(absolute_path, ec) == last_write_time
+        && std::filesystem::file_size(absolute_path, ec) == file_size && !ec)
+      return result;
   }
+
+  misses.push_back(absolute_path);
+
+  return nullptr;
+}
+
+static void insertEntry(const std::filesystem::path& path, Entry&& entry)
+{
+  const std::lock_guard lock{mutex};
+
+  entries.insert_or_assign(
+    std::filesystem::absolute(path).lexically_normal().string(),
+    std::move(entry));
+}
+
+void insert(const std::string_view argv_front, const std::filesystem::path& path)
+{
+  // Modification time is taken before loading, so that a file modified while
+  // loading is parsed again next time
+  const auto last_write_time = std::filesystem::last_write_time(path);
+  const auto file_size       = std::filesystem::file_size(path);
+
+  insertEntry(path,
+              {last_write_time,
+               file_size,
+               std::make_shared<const Parser::Result>(
+                 Parser{loadFile(argv_front, path), path}.getResult())});
+}
+
+void insert(const std::filesystem::path&          path,
+            std::shared_ptr<const Parser::Result> result)
+{
+  if (!is_enabled)
+    return;
+
+  std::error_code ec;
+
+  const auto last_write_time = std::filesystem::last_write_time(path, ec);
+  const auto file_size       = std::filesystem::file_size(path, ec);
+
+  if (!ec)
+    insertEntry(path, {last_write_time, file_size, std::move(result)});
+}
+
+[[nodiscard]] std::vector<std::filesystem::path> getMisses()
+{
+  const std::lock_guard lock{mutex};
+  return misses;
+}
+
+} // namespace import_cache
+
+//===----------------------------------------------------------------------===//
+// Statistics
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+
+template <typename T>
+struct IsVariant : std::false_type {};
+
+template <typename... Ts>
+struct IsVariant<boost::variant<Ts...>> : std::true_type {};
+
+template <typename T>
+struct IsRecursiveWrapper : std::false_type {};
+
+template <typename T>
+struct IsRecursiveWrapper<boost::recursive_wrapper<T>> : std::true_type {};
+
+template <typename T>
+struct IsOptional : std::false_type {};
+
+template <typename T>
+struct IsOptional<std::optional<T>> : std::true_type {};
+
+// Walks the AST generically through its fusion adaptation and counts the
+// nodes by type
+struct AstNodeCounter {
+  template <typename T>
+  void operator()(const T& node) const
+  {
+    if constexpr (IsVariant<T>::value)
+      boost::apply_visitor(*this, node);
+    else if constexpr (IsRecursiveWrapper<T>::value)
+      (*this)(node.get());
+    else if constexpr (IsOptional<T>::value) {
+      if (node)
+        (*this)(*node);
+    }
+    else if constexpr (std::is_same_v<T, std::u32string>)
+      return;
+    else if constexpr (std::ranges::range<T>) {
+      for (const auto& r : node)
+        (*this)(r);
+    }
+    else if constexpr (std::is_same_v<T, ast::ClassMemberInit>) {
+      // Its fusion adaptation is only for the parser to assign the attribute
+      ++counts[kindName<T>()];
+      fusion::for_each(static_cast<const ast::Assignment&>(node), *this);
+    }
+    else if constexpr (fusion::traits::is_sequence<T>::value) {
+      ++counts[kindName<T>()];
+      fusion::for_each(node, *this);
+    }
+    else if constexpr (std::is_base_of_v<x3::position_tagged, T>)
+      ++counts[kindName<T>()];
+  }
+
+  std::map<std::string, std::size_t>& counts;
+
+private:
+  template <typename T>
+  [[nodiscard]] static const std::string& kindName()
+  {
+    static const auto name = [] {
+      auto name = boost::core::demangle(typeid(T).name());
+      boost::algorithm::erase_first(name, "twinkle::ast::");
+      return name;
+    }();
+
+    return name;
+  }
+};
+
+} // namespace
+
+[[nodiscard]] std::map<std::string, std::size_t>
+countAstNodes(const ast::TranslationUnit& ast)
+{
+  std::map<std::string, std::size_t> counts;
+
+  AstNodeCounter{counts}(ast);
+
+  return counts;
 }
 
 } // namespace twinkle::parse
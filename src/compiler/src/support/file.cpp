@@ -7,6 +7,12 @@
 
 #include <twinkle/support/file.hpp>
 #include <twinkle/support/utils.hpp>
+#include <boost/filesystem.hpp>
+
+#ifdef __linux__
+#include <sys/mman.h> // memfd_create
+#include <unistd.h>
+#endif
 
 namespace twinkle
 {
@@ -32,4 +38,109 @@ namespace twinkle
                 fmt::format("{}: Could not open file", path.string()))};
 }
 
+// Write std::string to a file
+void writeFile(const std::string_view       program_name,
+               const std::filesystem::path& path,
+               const std::string_view       data)
+{
+  if (auto file = std::ofstream{path, std::ios_base::binary}) {
+    if (file.write(data.data(), data.size()))
+      return;
+  }
+
+  throw FileError{
+    formatError(program_name,
+                fmt::format("{}: Could not write file", path.string()))};
+}
+
+// Files to be removed by removeTemporaryFiles
+static std::mutex               temporary_files_mutex;
+static std::vector<std::string> temporary_files;
+static std::vector<int>         memory_file_descriptors;
+
+[[nodiscard]] std::string createTemporaryFilepath(const std::string_view suffix)
+{
+  auto path = (boost::filesystem::temp_directory_path()
+               / boost::filesystem::unique_path())
+                .native()
+              + std::string{suffix};
+
+  const std::lock_guard lock{temporary_files_mutex};
+  temporary_files.push_back(path);
+
+  return path;
+}
+
+#ifdef __linux__
+
+// Returns std::nullopt if a memory file could not be created (e.g. too many
+// open files), so that the caller falls back to a temporary file
+[[nodiscard]] static std::optional<std::filesystem::path>
+createMemfd(const std::string_view name, const std::string_view data)
+{
+  // Not close-on-exec, since child processes read it through /dev/fd
+  const auto fd = memfd_create(std::string{name}.c_str(), 0);
+
+  if (fd < 0)
+    return std::nullopt;
+
+  for (auto p = data.data(), last = data.data() + data.size(); p != last;) {
+    const auto n = write(fd, p, static_cast<std::size_t>(last - p));
+
+    if (n < 0 && errno == EINTR)
+      continue;
+
+    if (n <= 0) {
+      close(fd);
+      return std::nullopt;
+    }
+
+    p += n;
+  }
+
+  const std::lock_guard lock{temporary_files_mutex};
+  memory_file_descriptors.push_back(fd);
+
+  return fmt::format("/dev/fd/{}", fd);
+}
+
+#endif
+
+[[nodiscard]] std::filesystem::path
+createMemoryFile(const std::string_view argv_front,
+                 const std::string_view name,
+                 const std::string_view data)
+{
+#ifdef __linux__
+  if (auto path = createMemfd(name, data))
+    return *path;
+#endif
+
+  const auto path
+    = createTemporaryFilepath(std::filesystem::path{name}.extension().native());
+
+  writeFile(argv_front, path, data);
+
+  return path;
+}
+
+void removeTemporaryFiles() noexcept
+{
+  const std::lock_guard lock{temporary_files_mutex};
+
+  for (const auto& r : temporary_files) {
+    std::error_code ec;
+    std::filesystem::remove(r, ec);
+  }
+
+  temporary_files.clear();
+
+#ifdef __linux__
+  for (const auto fd : memory_file_descriptors)
+    close(fd);
+#endif
+
+  memory_file_descriptors.clear();
+}
+
 } // namespace twinkle
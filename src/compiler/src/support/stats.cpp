@@ -0,0 +1,242 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#include <twinkle/support/stats.hpp>
+#include <twinkle/support/file.hpp>
+#include <twinkle/support/utils.hpp>
+
+namespace twinkle::stats
+{
+
+namespace
+{
+
+struct FileStats {
+  std::filesystem::path file;
+  std::size_t           bytes;
+  std::size_t           lines;
+};
+
+struct Counters {
+  std::vector<FileStats>             files;
+  std::map<std::string, std::size_t> ast_nodes;
+
+  std::map<TemplateKind, std::map<std::string, std::size_t>>
+    template_instantiations;
+
+  std::size_t functions;
+  std::size_t basic_blocks;
+  std::size_t instructions_before_fpm;
+  std::size_t instructions_after_fpm;
+};
+
+std::atomic<bool> is_enabled;
+std::mutex        mutex;
+Counters          counters;
+
+[[nodiscard]] std::string_view toString(const TemplateKind kind)
+{
+  switch (kind) {
+  case TemplateKind::function:
+    return "function";
+  case TemplateKind::class_:
+    return "class";
+  case TemplateKind::union_:
+    return "union";
+  }
+
+  unreachable();
+}
+
+[[nodiscard]] std::size_t countLines(const std::string_view source)
+{
+  const auto newlines
+    = static_cast<std::size_t>(std::count(source.begin(), source.end(), '\n'));
+
+  // The last line may not end with a newline
+  return !source.empty() && source.back() != '\n' ? newlines + 1 : newlines;
+}
+
+} // namespace
+
+[[nodiscard]] bool enabled() noexcept
+{
+  return is_enabled.load(std::memory_order_relaxed);
+}
+
+void addFile(const std::filesystem::path& file, const std::string_view source)
+{
+  if (!enabled())
+    return;
+
+  const std::lock_guard lock{mutex};
+  counters.files.push_back({file, source.size(), countLines(source)});
+}
+
+void addAstNodes(const std::map<std::string, std::size_t>& counts)
+{
+  if (!enabled())
+    return;
+
+  const std::lock_guard lock{mutex};
+
+  for (const auto& [kind, count] : counts)
+    counters.ast_nodes[kind] += count;
+}
+
+void addTemplateInstantiation(const TemplateKind kind, const std::string& name)
+{
+  if (!enabled())
+    return;
+
+  const std::lock_guard lock{mutex};
+  ++counters.template_instantiations[kind][name];
+}
+
+void addFunction(const std::size_t basic_blocks)
+{
+  if (!enabled())
+    return;
+
+  const std::lock_guard lock{mutex};
+  ++counters.functions;
+  counters.basic_blocks += basic_blocks;
+}
+
+void addFunctionPasses(const std::size_t instructions_before,
+                       const std::size_t instructions_after)
+{
+  if (!enabled())
+    return;
+
+  const std::lock_guard lock{mutex};
+  counters.instructions_before_fpm += instructions_before;
+  counters.instructions_after_fpm += instructions_after;
+}
+
+Collector::Collector(const std::string_view argv_front)
+  : argv_front{argv_front}
+{
+  counters = {};
+
+  llvm::EnableStatistics(false);
+  llvm::ResetStatistics();
+
+  is_enabled = true;
+}
+
+Collector::~Collector()
+{
+  is_enabled = false;
+}
+
+void Collector::print(std::ostream& os) const
+{
+  const std::lock_guard lock{mutex};
+
+  os << "===------------------------------------------------------------===\n"
+        "                        Compilation statistics\n"
+        "===------------------------------------------------------------===\n";
+
+  os << "\nFiles:\n";
+  for (const auto& [file, bytes, lines] : counters.files)
+    os << fmt::format("  {:>10} bytes {:>8} lines  {}\n",
+                      bytes,
+                      lines,
+                      file.string());
+
+  os << "\nAST nodes:\n";
+  for (const auto& [kind, count] : counters.ast_nodes)
+    os << fmt::format("  {:>10}  {}\n", count, kind);
+
+  for (const auto& [kind, instantiations] : counters.template_instantiations) {
+    os << fmt::format("\n{} template instantiations:\n", toString(kind));
+
+    for (const auto& [name, count] : instantiations)
+      os << fmt::format("  {:>10}  {}\n", count, name);
+  }
+
+  os << fmt::format("\nFunctions: {}\n"
+                    "Basic blocks: {}\n"
+                    "Instructions before function passes: {}\n"
+                    "Instructions after function passes: {}\n",
+                    counters.functions,
+                    counters.basic_blocks,
+                    counters.instructions_before_fpm,
+                    counters.instructions_after_fpm);
+
+  if (llvm::AreStatisticsEnabled()) {
+    std::string              str;
+    llvm::raw_string_ostream stream{str};
+    llvm::PrintStatistics(stream);
+    os << '\n' << stream.str();
+  }
+
+  os << std::flush;
+}
+
+void Collector::writeJSON(const std::filesystem::path& file) const
+{
+  std::string str;
+
+  {
+    const std::lock_guard lock{mutex};
+
+    llvm::raw_string_ostream stream{str};
+    llvm::json::OStream      json{stream, 2};
+
+    json.object([&] {
+      json.attributeArray("files", [&] {
+        for (const auto& [file, bytes, lines] : counters.files) {
+          json.object([&, &file = file, &bytes = bytes, &lines = lines] {
+            json.attribute("file", file.string());
+            json.attribute("bytes", static_cast<std::int64_t>(bytes));
+            json.attribute("lines", static_cast<std::int64_t>(lines));
+          });
+        }
+      });
+
+      json.attributeObject("ast_nodes", [&] {
+        for (const auto& [kind, count] : counters.ast_nodes)
+          json.attribute(kind, static_cast<std::int64_t>(count));
+      });
+
+      json.attributeObject("template_instantiations", [&] {
+        for (const auto& [kind, instantiations] :
+             counters.template_instantiations) {
+          json.attributeObject(toString(kind), [&] {
+            for (const auto& [name, count] : instantiations)
+              json.attribute(name, static_cast<std::int64_t>(count));
+          });
+        }
+      });
+
+      json.attribute("functions",
+                     static_cast<std::int64_t>(counters.functions));
+      json.attribute("basic_blocks",
+                     static_cast<std::int64_t>(counters.basic_blocks));
+      json.attribute(
+        "instructions_before_function_passes",
+        static_cast<std::int64_t>(counters.instructions_before_fpm));
+      json.attribute(
+        "instructions_after_function_passes",
+        static_cast<std::int64_t>(counters.instructions_after_fpm));
+
+      // Keyed by 'DEBUG_TYPE.name'
+      json.attributeObject("llvm", [&] {
+        for (const auto& [name, value] : llvm::GetStatistics())
+          json.attribute(name, static_cast<std::int64_t>(value));
+      });
+    });
+
+    stream << '\n';
+  }
+
+  writeFile(argv_front, file, str);
+}
+
+} // namespace twinkle::stats
@@ -0,0 +1,65 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#include <twinkle/support/time_trace.hpp>
+#include <twinkle/support/exception.hpp>
+#include <twinkle/support/utils.hpp>
+
+namespace twinkle
+{
+
+// Set before worker threads start, so they are only read concurrently
+static unsigned int time_trace_granularity;
+static std::string  time_trace_process_name;
+
+TimeTraceProfiler::TimeTraceProfiler(const unsigned int     granularity,
+                                     const std::string_view argv_front)
+  : argv_front{argv_front}
+{
+  time_trace_granularity  = granularity;
+  time_trace_process_name = std::filesystem::path{argv_front}.filename();
+
+  llvm::timeTraceProfilerInitialize(granularity, time_trace_process_name);
+}
+
+TimeTraceProfiler::~TimeTraceProfiler()
+{
+  llvm::timeTraceProfilerCleanup();
+}
+
+void TimeTraceProfiler::write(const std::string& file,
+                              const std::string& fallback) const
+{
+  if (auto err = llvm::timeTraceProfilerWrite(file, fallback)) {
+    throw ErrorBase{formatError(
+      argv_front,
+      fmt::format("failed to write time trace: {}",
+                  llvm::toString(std::move(err))))};
+  }
+}
+
+[[nodiscard]] unsigned int getTimeTraceGranularity() noexcept
+{
+  return time_trace_granularity;
+}
+
+TimeTraceThread::TimeTraceThread(const bool enabled)
+  : enabled{enabled}
+{
+  if (enabled) {
+    llvm::timeTraceProfilerInitialize(time_trace_granularity,
+                                      time_trace_process_name);
+  }
+}
+
+TimeTraceThread::~TimeTraceThread()
+{
+  if (enabled)
+    llvm::timeTraceProfilerFinishThread();
+}
+
+} // namespace twinkle
@@ -11,7 +11,10 @@
 #include <fmt/color.h>
 #include <fmt/core.h>
 #include <fmt/ostream.h>
+#include <cctype>
 #include <iostream>
+#include <string>
+#include <utility>
 
 namespace program_options = boost::program_options;
 
@@ -33,9 +36,35 @@ namespace
      "', Assembly file is '" EMIT_ASM_ARG "', "
      "object file is '" EMIT_OBJ_ARG "', LLVM IR is '" EMIT_LLVMIR_ARG "'.\n"
      "If there are multiple input files, compile each to the target. Not linked.")
-    ("Opt,O", program_options::value<unsigned int>()->default_value(twinkle::DEFAULT_OPT_LEVEL),
+    ("output-dir", program_options::value<std::string>()->default_value(""),
+     "Write the output files to the specified directory instead of the "
+     "current directory.")
+    ("Opt,O", program_options::value<std::string>()->default_value(std::to_string(twinkle::DEFAULT_OPT_LEVEL)),
      "Specify the optimization level.\n"
-     "Possible values are 0 1 2 3 and the meaning is the same as clang.")
+     "Possible values are 0 1 2 3 s z and the meaning is the same as clang.\n"
+     "The same pipeline is used for both JIT and other compilation.")
+    ("passes", program_options::value<std::string>(),
+     "Replace the optimization pipeline with the specified one, in the same "
+     "format as opt's -passes (e.g. 'function(sroa,instcombine)').\n"
+     "The code generation level is still set by -O.")
+    ("profile-generate",
+     "Instrument the program to count the executions of its functions and "
+     "branches. At exit, the program writes the profile (default_%m.profraw) "
+     "to its current directory. "
+     "Merge the profiles with 'llvm-profdata merge'.\n"
+     "Not available in JIT compilation.")
+    ("profile-generate-dir", program_options::value<std::string>(),
+     "Write the profile of --profile-generate to the specified directory "
+     "instead. Implies --profile-generate.")
+    ("profile-use", program_options::value<std::string>(),
+     "Optimize with the specified profile (.profdata) collected by "
+     "--profile-generate. Functions are matched by their mangled names.")
+    ("profile-sample-use", program_options::value<std::string>(),
+     "Optimize with the specified sample profile, which is converted from "
+     "perf data of a program built with -g (e.g. by create_llvm_prof). "
+     "Implies -g.")
+    ("debug-line-tables,g", "Emit line tables for perf and symbolizing stack traces. "
+     "No debug information of types and variables is emitted.")
     ("link,l", program_options::value<std::vector<std::string>>()->multitoken(),
      "Specify library names to be linked.\n"
      "The -l option is passed directly to the linker.")
@@ -45,6 +74,65 @@ namespace
      "If llvm is specified for the emit option, this option is disabled.")
     ("target", program_options::value<std::string>(),
      "Specify the name of the target processor.")
+    ("mcpu", program_options::value<std::string>(),
+     "Specify the target CPU (e.g. 'skylake'). 'native' selects the host CPU "
+     "and its features.\n"
+     "By default, 'generic' is used, and the host CPU is used in JIT "
+     "compilation.")
+    ("mattr", program_options::value<std::string>(),
+     "Enable or disable target features (e.g. '+avx2,-fma').")
+    ("jobs,j", program_options::value<unsigned int>()->default_value(twinkle::DEFAULT_JOBS),
+     "Specify the number of threads to compile input files in parallel.\n"
+     "If 0 is specified, the number of hardware threads is used.\n"
+     "Diagnostics are output in the order of the input files.")
+    ("codegen-partitions", program_options::value<unsigned int>()->default_value(twinkle::DEFAULT_CODEGEN_PARTITIONS),
+     "Split each module into the specified number of partitions and generate "
+     "code for them in parallel.\n"
+     "Each partition is output as a separate file. "
+     "Used only when emitting object or assembly files.")
+    ("cache-dir", program_options::value<std::string>(),
+     "Cache objects in the specified directory and reuse them when neither the "
+     "input file nor the files it imports have changed.\n"
+     "The directory can be shared by multiple processes and machines (e.g. on NFS).")
+    ("cache-policy", program_options::value<std::string>()->default_value(""),
+     "Set the eviction policy of the cache. "
+     "e.g. 'cache_size_bytes=1g:prune_after=24h'\n"
+     "The format is the same as the cache policy of LLVM's LTO.")
+    ("linker", program_options::value<std::string>(),
+     "Link with the specified external linker driver (e.g. gcc, clang).\n"
+     "By default, executables are linked in-process by lld if the compiler "
+     "was built with it, otherwise by gcc.")
+    ("runtime", program_options::value<std::string>(),
+     "Link executables with the specified runtime archive (libtwinkle_rt.a) "
+     "instead of the one installed with the compiler.")
+    ("lto", "Perform link time optimization. Only for executables.\n"
+     "By default, all input files are linked and optimized as a whole program "
+     "into a single object.")
+    ("lto-mode", program_options::value<std::string>(),
+     "Set the kind of link time optimization. Implies --lto.\n"
+     "'" LTO_FULL_ARG "' is the default. "
+     "'" LTO_THIN_ARG "' imports functions across files using per-module summaries "
+     "and optimizes each module in parallel. If --cache-dir is specified, "
+     "the objects of unchanged modules are reused.")
+    ("time-trace", "Write a Chrome trace (chrome://tracing, Perfetto) of where "
+     "compile time is spent to <first input file stem>.time-trace in the "
+     "output directory.")
+    ("time-trace-file", program_options::value<std::string>(),
+     "Write the time trace to the specified file instead. Implies --time-trace.")
+    ("time-trace-granularity", program_options::value<unsigned int>()->default_value(twinkle::DEFAULT_TIME_TRACE_GRANULARITY),
+     "Minimum duration of time trace events in microseconds.")
+    ("stats", "Print statistics of the compilation to stderr: bytes and lines "
+     "parsed, AST nodes, template instantiations, functions, basic blocks, "
+     "IR instructions and LLVM's statistics.")
+    ("stats-file", program_options::value<std::string>(),
+     "Write the statistics to the specified file as JSON.")
+    ("server", program_options::value<std::string>(),
+     "Run as a compile server listening on the specified Unix domain socket. "
+     "The server keeps the targets initialized and the imported files parsed "
+     "between compilations, and serves several compilations concurrently.")
+    ("connect", program_options::value<std::string>(),
+     "Compile by the compile server listening on the specified Unix domain "
+     "socket. Diagnostics are written to the terminal of this process.")
     ("input-file", program_options::value<std::vector<std::string>>(),
      "Input file. Non-optional arguments are equivalent to this.")
     ;
@@ -90,6 +178,25 @@ std::ostream& writeHelp(std::ostream&                               ostm,
   return ostm << desc;
 }
 
+// Returns the optimization level and the size level
+[[nodiscard]] std::pair<unsigned int, unsigned int>
+getOptLevels(const program_options::variables_map& v_map)
+{
+  const auto arg = v_map["Opt"].as<std::string>();
+
+  // Same as clang, -Os and -Oz are based on -O2
+  if (arg == "s")
+    return {2, 1};
+  else if (arg == "z")
+    return {2, 2};
+
+  if (arg.size() != 1 || !std::isdigit(static_cast<unsigned char>(arg.front())))
+    throw program_options::invalid_option_value{arg};
+
+  // The range is checked by the code generator
+  return {static_cast<unsigned int>(arg.front() - '0'), 0};
+}
+
 std::vector<std::string>
 getLinkedLibs(const program_options::variables_map& v_map)
 {
@@ -99,6 +206,38 @@ getLinkedLibs(const program_options::variables_map& v_map)
   return v_map["link"].as<std::vector<std::string>>();
 }
 
+// For a flag with an option giving its path, which implies the flag in the
+// same way as --lto-mode implies --lto
+// Returns the path, an empty string if only the flag is given, or std::nullopt
+// if neither is given
+[[nodiscard]] std::optional<std::string>
+getOptionalPath(const program_options::variables_map& v_map,
+                const std::string&                    flag,
+                const std::string&                    path_option)
+{
+  if (v_map.contains(path_option))
+    return v_map[path_option].as<std::string>();
+
+  if (v_map.contains(flag))
+    return "";
+
+  return std::nullopt;
+}
+
+// The kind is a separate option, since an optional value of --lto would take
+// the following input file as its value
+[[nodiscard]] std::optional<std::string>
+getLtoMode(const program_options::variables_map& v_map)
+{
+  if (v_map.contains("lto-mode"))
+    return twinkle::stringToLower(v_map["lto-mode"].as<std::string>());
+
+  if (v_map.contains("lto"))
+    return LTO_FULL_ARG;
+
+  return std::nullopt;
+}
+
 } // namespace
 
 namespace twinkle
@@ -126,20 +265,75 @@ try {
 
   auto input_files = getInputFiles(v_map);
 
-  if (input_files.empty()) {
+  if (input_files.empty() && !v_map.contains("server")) {
     std::cerr << formatError(*argv, "no input files\n") << std::flush;
     std::exit(EXIT_FAILURE);
   }
 
-  return {std::move(input_files),
-          v_map.contains("JIT"),
-          stringToLower(v_map["emit"].as<std::string>()),
-          v_map["Opt"].as<unsigned int>(),
-          stringToLower(v_map["relocation-model"].as<std::string>()),
-          getLinkedLibs(v_map),
-          v_map.contains("target")
-            ? std::make_optional(v_map["target"].as<std::string>())
-            : std::nullopt};
+  const auto [opt_level, size_level] = getOptLevels(v_map);
+
+  return {
+    .input_files = std::move(input_files),
+    .jit         = v_map.contains("JIT"),
+    .emit_target = stringToLower(v_map["emit"].as<std::string>()),
+    .output_dir  = v_map["output-dir"].as<std::string>(),
+    .opt_level   = opt_level,
+    .size_level  = size_level,
+    .passes      = v_map.contains("passes")
+                     ? std::make_optional(v_map["passes"].as<std::string>())
+                     : std::nullopt,
+    .profile_generate = getOptionalPath(v_map,
+                                        "profile-generate",
+                                        "profile-generate-dir"),
+    .profile_use
+    = v_map.contains("profile-use")
+        ? std::make_optional(v_map["profile-use"].as<std::string>())
+        : std::nullopt,
+    .profile_sample_use
+    = v_map.contains("profile-sample-use")
+        ? std::make_optional(v_map["profile-sample-use"].as<std::string>())
+        : std::nullopt,
+    .debug_line_tables = v_map.contains("debug-line-tables"),
+    .relocation_model
+    = stringToLower(v_map["relocation-model"].as<std::string>()),
+    .linked_libs   = getLinkedLibs(v_map),
+    .target_triple = v_map.contains("target")
+                       ? std::make_optional(v_map["target"].as<std::string>())
+                       : std::nullopt,
+    .mcpu  = v_map.contains("mcpu")
+               ? std::make_optional(v_map["mcpu"].as<std::string>())
+               : std::nullopt,
+    .mattr = v_map.contains("mattr")
+               ? std::make_optional(v_map["mattr"].as<std::string>())
+               : std::nullopt,
+    .jobs               = v_map["jobs"].as<unsigned int>(),
+    .codegen_partitions = v_map["codegen-partitions"].as<unsigned int>(),
+    .cache_dir = v_map.contains("cache-dir")
+                   ? std::make_optional(v_map["cache-dir"].as<std::string>())
+                   : std::nullopt,
+    .cache_policy = v_map["cache-policy"].as<std::string>(),
+    .linker       = v_map.contains("linker")
+                      ? std::make_optional(v_map["linker"].as<std::string>())
+                      : std::nullopt,
+    .runtime      = v_map.contains("runtime")
+                      ? std::make_optional(v_map["runtime"].as<std::string>())
+                      : std::nullopt,
+    .lto        = getLtoMode(v_map),
+    .time_trace = getOptionalPath(v_map, "time-trace", "time-trace-file"),
+    .time_trace_granularity
+    = v_map["time-trace-granularity"].as<unsigned int>(),
+    .stats = v_map.contains("stats"),
+    .stats_file
+    = v_map.contains("stats-file")
+        ? std::make_optional(v_map["stats-file"].as<std::string>())
+        : std::nullopt,
+    .server  = v_map.contains("server")
+                 ? std::make_optional(v_map["server"].as<std::string>())
+                 : std::nullopt,
+    .connect = v_map.contains("connect")
+                 ? std::make_optional(v_map["connect"].as<std::string>())
+                 : std::nullopt,
+  };
 }
 catch (const program_options::error& err) {
   std::cerr << formatError(*argv, err.what())
@@ -6,6 +6,7 @@
  */
 
 #include "cmd.hpp"
+#include "server.hpp"
 #include <twinkle/compile/compile.hpp>
 #include <cstdlib>
 #include <iostream>
@@ -13,13 +14,15 @@
 // If the 'system' function could not be run, return std::nullopt; otherwise,
 // return linker exit status
 [[nodiscard]] std::optional<int>
-callLinker(const std::vector<std::filesystem::path>& files,
+callLinker(const std::string&                        linker,
+           const std::filesystem::path&              output_file,
+           const std::vector<std::filesystem::path>& files,
            const std::vector<std::string>&           linked_libs)
 {
   if (!system(nullptr))
     return std::nullopt;
 
-  std::string command = "gcc";
+  std::string command = linker + " -o " + output_file.string();
 
   for (const auto& r : files)
     command += (' ' + r.string());
@@ -27,14 +30,17 @@ callLinker(const std::vector<std::filesystem::path>& files,
   for (const auto& r : linked_libs)
     command += (" -l" + r);
 
+  // The runtime of parallel loops and tasks uses threads
+  command += " -pthread";
+
   return system(command.c_str());
 }
 
-int main(const int argc, const char* const* const argv)
+// Returns the exit status
+[[nodiscard]] int compileAndLink(const twinkle::Context& context,
+                                 const std::string_view  argv_front)
 {
-  const auto context = twinkle::parseCmdlineOption(argc, argv);
-
-  const auto result = twinkle::compile(context, *argv);
+  const auto result = twinkle::compile(context, argv_front);
 
   if (!result)
     return EXIT_FAILURE;
@@ -46,10 +52,18 @@ int main(const int argc, const char* const* const argv)
       && std::holds_alternative<twinkle::AOTResult>(*result)) {
     const auto& aotresult = std::get<twinkle::AOTResult>(*result);
 
+    if (!context.linker && twinkle::hasInternalLinker())
+      return twinkle::linkInProcess(context,
+                                    aotresult.created_files,
+                                    argv_front);
+
     {
       // Call linker
       const auto linker_exit_status
-        = callLinker(aotresult.created_files, context.linked_libs);
+        = callLinker(context.linker.value_or("gcc"),
+                     twinkle::getExecutablePath(context),
+                     aotresult.created_files,
+                     context.linked_libs);
 
       if (linker_exit_status)
         return *linker_exit_status;
@@ -62,3 +76,27 @@ int main(const int argc, const char* const* const argv)
 
   return EXIT_SUCCESS;
 }
+
+// Compile and link, and return the exit status
+[[nodiscard]] int runDriver(const twinkle::Context& context,
+                            const std::string_view  argv_front)
+{
+  const auto exit_status = compileAndLink(context, argv_front);
+
+  twinkle::cleanupTemporaryFiles();
+
+  return exit_status;
+}
+
+int main(const int argc, const char* const* const argv)
+{
+  const auto context = twinkle::parseCmdlineOption(argc, argv);
+
+  if (context.server)
+    return twinkle::runServer(*context.server, *argv, runDriver);
+
+  if (context.connect)
+    return twinkle::runClient(*context.connect, argc, argv);
+
+  return runDriver(context, *argv);
+}
@@ -0,0 +1,539 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#include "server.hpp"
+#include "cmd.hpp"
+#include <twinkle/compile/compile.hpp>
+#include <twinkle/support/utils.hpp>
+#include <fmt/core.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stop_token>
+#include <thread>
+#include <vector>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Protocol
+//
+// Request: the standard streams of the client are passed as ancillary data of
+// a single byte, followed by [u32 count] and count strings of [u32 length]
+// [bytes]. The first string is the working directory of the client, and the
+// rest are the arguments.
+//
+// Response: [i32 exit status] after the compilation has finished.
+
+namespace
+{
+
+constexpr std::size_t n_passed_fds = 3; // stdin, stdout, stderr
+
+[[nodiscard]] bool writeAll(const int fd, const void* data, std::size_t size)
+{
+  auto p = static_cast<const char*>(data);
+
+  while (size) {
+    const auto n = write(fd, p, size);
+
+    if (n < 0 && errno == EINTR)
+      continue;
+
+    if (n <= 0)
+      return false;
+
+    p += n;
+    size -= static_cast<std::size_t>(n);
+  }
+
+  return true;
+}
+
+[[nodiscard]] bool readAll(const int fd, void* data, std::size_t size)
+{
+  auto p = static_cast<char*>(data);
+
+  while (size) {
+    const auto n = read(fd, p, size);
+
+    if (n < 0 && errno == EINTR)
+      continue;
+
+    if (n <= 0)
+      return false;
+
+    p += n;
+    size -= static_cast<std::size_t>(n);
+  }
+
+  return true;
+}
+
+[[nodiscard]] bool sendStrings(const int                       fd,
+                               const std::vector<std::string>& strs)
+{
+  const auto count = static_cast<std::uint32_t>(strs.size());
+
+  if (!writeAll(fd, &count, sizeof count))
+    return false;
+
+  for (const auto& r : strs) {
+    const auto length = static_cast<std::uint32_t>(r.size());
+
+    if (!writeAll(fd, &length, sizeof length)
+        || !writeAll(fd, r.data(), length))
+      return false;
+  }
+
+  return true;
+}
+
+[[nodiscard]] std::optional<std::vector<std::string>>
+receiveStrings(const int fd)
+{
+  std::uint32_t count;
+
+  if (!readAll(fd, &count, sizeof count))
+    return std::nullopt;
+
+  std::vector<std::string> strs;
+
+  for (std::uint32_t i = 0; i < count; ++i) {
+    std::uint32_t length;
+
+    if (!readAll(fd, &length, sizeof length))
+      return std::nullopt;
+
+    auto& str = strs.emplace_back(length, '\0');
+
+    if (!readAll(fd, str.data(), length))
+      return std::nullopt;
+  }
+
+  return strs;
+}
+
+[[nodiscard]] bool sendFds(const int                            sock,
+                           const std::array<int, n_passed_fds>& fds)
+{
+  char byte = 0;
+
+  iovec iov{&byte, sizeof byte};
+
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof fds)]{};
+
+  msghdr msg{};
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control;
+  msg.msg_controllen = sizeof control;
+
+  auto const cmsg  = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type  = SCM_RIGHTS;
+  cmsg->cmsg_len   = CMSG_LEN(sizeof fds);
+  std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof fds);
+
+  return sendmsg(sock, &msg, 0) == sizeof byte;
+}
+
+[[nodiscard]] std::optional<std::array<int, n_passed_fds>>
+receiveFds(const int sock)
+{
+  char byte;
+
+  iovec iov{&byte, sizeof byte};
+
+  std::array<int, n_passed_fds> fds;
+
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof fds)]{};
+
+  msghdr msg{};
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control;
+  msg.msg_controllen = sizeof control;
+
+  if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != sizeof byte)
+    return std::nullopt;
+
+  auto const cmsg = CMSG_FIRSTHDR(&msg);
+
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+      || cmsg->cmsg_len != CMSG_LEN(sizeof fds))
+    return std::nullopt;
+
+  std::memcpy(fds.data(), CMSG_DATA(cmsg), sizeof fds);
+
+  return fds;
+}
+
+[[nodiscard]] std::optional<sockaddr_un>
+createAddress(const std::string& socket_path)
+{
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+
+  if (sizeof addr.sun_path <= socket_path.size())
+    return std::nullopt;
+
+  std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+  return addr;
+}
+
+[[nodiscard]] int toExitStatus(const int wait_status)
+{
+  if (WIFEXITED(wait_status))
+    return WEXITSTATUS(wait_status);
+
+  if (WIFSIGNALED(wait_status))
+    return 128 + WTERMSIG(wait_status);
+
+  return EXIT_FAILURE;
+}
+
+// A compilation running in a forked process
+struct Job {
+  pid_t pid;
+
+  // Connection to the client
+  int connection;
+
+  // Read end of the pipe, to which the process writes the imported files
+  // missed in the import cache
+  int report;
+
+  std::string report_data;
+};
+
+// Parses the imported files missed by the compilations on a thread, so that
+// the server keeps accepting requests meanwhile
+// The compilations forked before a file is cached parse it themselves
+struct ImportCacheWarmer {
+  explicit ImportCacheWarmer(const std::string_view argv_front)
+    : thread{[this, argv_front](const std::stop_token stop_token) {
+      run(stop_token, argv_front);
+    }}
+  {
+  }
+
+  void push(std::vector<std::string>&& files)
+  {
+    {
+      const std::lock_guard lock{mutex};
+
+      queue.insert(queue.end(),
+                   std::make_move_iterator(files.begin()),
+                   std::make_move_iterator(files.end()));
+    }
+
+    condition.notify_one();
+  }
+
+private:
+  void run(const std::stop_token stop_token, const std::string_view argv_front)
+  {
+    for (;;) {
+      std::vector<std::string> files;
+
+      {
+        std::unique_lock lock{mutex};
+
+        if (!condition.wait(lock, stop_token, [&] { return !queue.empty(); }))
+          return;
+
+        files.swap(queue);
+      }
+
+      // The same file may be missed by several compilations
+      std::sort(files.begin(), files.end());
+      files.erase(std::unique(files.begin(), files.end()), files.end());
+
+      twinkle::warmImportCache(files, argv_front);
+    }
+  }
+
+  std::mutex                  mutex;
+  std::condition_variable_any condition;
+  std::vector<std::string>    queue;
+
+  // Declared last, so that it is stopped before the members above are
+  // destroyed
+  std::jthread thread;
+};
+
+// Runs in the forked process
+[[noreturn]] void runJob(const std::array<int, n_passed_fds>& fds,
+                         const std::vector<std::string>&      request,
+                         const int                            report,
+                         const twinkle::Driver                driver)
+{
+  for (std::size_t fd = 0; fd < n_passed_fds; ++fd) {
+    dup2(fds[fd], static_cast<int>(fd));
+    close(fds[fd]);
+  }
+
+  const auto& working_directory = request.front();
+
+  if (chdir(working_directory.c_str())) {
+    std::cerr << working_directory << ": " << std::strerror(errno)
+              << std::endl;
+    _exit(EXIT_FAILURE);
+  }
+
+  std::vector<const char*> argv;
+
+  for (auto it = std::next(request.begin()); it != request.end(); ++it)
+    argv.push_back(it->c_str());
+
+  argv.push_back(nullptr);
+
+  const auto argc = static_cast<int>(argv.size() - 1);
+
+  const auto context = twinkle::parseCmdlineOption(argc, argv.data());
+
+  const auto status = driver(context, argv.front());
+
+  {
+    std::string data;
+
+    for (const auto& r : twinkle::getImportCacheMisses())
+      data += r + '\n';
+
+    [[maybe_unused]] const auto written
+      = writeAll(report, data.data(), data.size());
+  }
+
+  // Static objects belong to the server, so they are not destroyed here
+  std::cout.flush();
+  std::cerr.flush();
+  std::fflush(nullptr);
+
+  _exit(status);
+}
+
+} // namespace
+
+namespace twinkle
+{
+
+[[nodiscard]] int runServer(const std::string&     socket_path,
+                            const std::string_view argv_front,
+                            const Driver           driver)
+{
+  const auto addr = createAddress(socket_path);
+
+  if (!addr) {
+    std::cerr << formatError(argv_front,
+                             fmt::format("{}: socket path is too long",
+                                         socket_path))
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const auto sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  // Remove the socket left by the previous server
+  unlink(socket_path.c_str());
+
+  if (sock < 0
+      || bind(sock, reinterpret_cast<const sockaddr*>(&*addr), sizeof *addr)
+      || listen(sock, SOMAXCONN)) {
+    std::cerr << formatError(argv_front,
+                             fmt::format("{}: {}",
+                                         socket_path,
+                                         std::strerror(errno)))
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Writing to a client that has gone away must not kill the server
+  std::signal(SIGPIPE, SIG_IGN);
+
+  initializeServer();
+
+  ImportCacheWarmer warmer{argv_front};
+
+  std::vector<Job> jobs;
+
+  for (;;) {
+    std::vector<pollfd> pfds{
+      {sock, POLLIN, 0}
+    };
+
+    for (const auto& r : jobs)
+      pfds.push_back({r.report, POLLIN, 0});
+
+    if (poll(pfds.data(), pfds.size(), -1) < 0) {
+      if (errno == EINTR)
+        continue;
+
+      std::cerr << formatError(argv_front, std::strerror(errno)) << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Finished jobs
+    // Walk backwards, since the finished jobs are erased
+    for (auto idx = jobs.size(); idx--;) {
+      if (!pfds[idx + 1].revents)
+        continue;
+
+      auto& job = jobs[idx];
+
+      char       buffer[4096];
+      const auto n = read(job.report, buffer, sizeof buffer);
+
+      if (n < 0 && errno == EINTR)
+        continue;
+
+      if (0 < n) {
+        job.report_data.append(buffer, static_cast<std::size_t>(n));
+        continue;
+      }
+
+      // The process has closed the pipe, so it is exiting
+      int wait_status;
+      while (waitpid(job.pid, &wait_status, 0) < 0 && errno == EINTR)
+        ;
+
+      const auto exit_status
+        = static_cast<std::int32_t>(toExitStatus(wait_status));
+
+      [[maybe_unused]] const auto written
+        = writeAll(job.connection, &exit_status, sizeof exit_status);
+
+      close(job.connection);
+      close(job.report);
+
+      std::vector<std::string> misses;
+      {
+        std::istringstream stream{job.report_data};
+
+        for (std::string line; std::getline(stream, line);)
+          misses.push_back(std::move(line));
+      }
+
+      jobs.erase(std::next(jobs.begin(), static_cast<std::ptrdiff_t>(idx)));
+
+      // Parsed in the server, so that the following compilations inherit them
+      warmer.push(std::move(misses));
+    }
+
+    if (!(pfds.front().revents & POLLIN))
+      continue;
+
+    // New request
+    const auto connection = accept4(sock, nullptr, nullptr, SOCK_CLOEXEC);
+
+    if (connection < 0)
+      continue;
+
+    const auto fds     = receiveFds(connection);
+    const auto request = fds ? receiveStrings(connection) : std::nullopt;
+
+    int report[2];
+
+    if (!request || request->size() < 2 || pipe2(report, O_CLOEXEC)) {
+      if (fds) {
+        for (const auto fd : *fds)
+          close(fd);
+      }
+
+      close(connection);
+      continue;
+    }
+
+    const auto pid = fork();
+
+    if (pid == 0) {
+      close(sock);
+      close(connection);
+      close(report[0]);
+
+      for (const auto& r : jobs) {
+        close(r.connection);
+        close(r.report);
+      }
+
+      runJob(*fds, *request, report[1], driver);
+    }
+
+    for (const auto fd : *fds)
+      close(fd);
+
+    close(report[1]);
+
+    if (pid < 0) {
+      close(report[0]);
+      close(connection);
+      continue;
+    }
+
+    jobs.push_back({pid, connection, report[0], {}});
+  }
+}
+
+[[nodiscard]] int runClient(const std::string&       socket_path,
+                            const int                argc,
+                            const char* const* const argv)
+{
+  const auto addr = createAddress(socket_path);
+
+  const auto sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  if (!addr || sock < 0
+      || connect(sock,
+                 reinterpret_cast<const sockaddr*>(&*addr),
+                 sizeof *addr)) {
+    std::cerr << formatError(
+      *argv,
+      fmt::format("could not connect to the compile server: {}: {}",
+                  socket_path,
+                  addr ? std::strerror(errno) : "socket path is too long"))
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<std::string> request{std::filesystem::current_path().string()};
+
+  for (int i = 0; i < argc; ++i)
+    request.emplace_back(argv[i]);
+
+  std::int32_t exit_status;
+
+  if (!sendFds(sock, {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO})
+      || !sendStrings(sock, request)
+      || !readAll(sock, &exit_status, sizeof exit_status)) {
+    std::cerr << formatError(*argv,
+                             "the compile server closed the connection")
+              << std::endl;
+    close(sock);
+    return EXIT_FAILURE;
+  }
+
+  close(sock);
+
+  return exit_status;
+}
+
+} // namespace twinkle
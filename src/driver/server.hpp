@@ -0,0 +1,40 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#ifndef _66e6e9e9_a929_41e0_ab15_39e989550dae
+#define _66e6e9e9_a929_41e0_ab15_39e989550dae
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <context.hpp>
+#include <string_view>
+
+namespace twinkle
+{
+
+// Compile and link as the driver does, and return the exit status
+using Driver = int (*)(const Context& ctx, const std::string_view argv_front);
+
+// Serve compilations on the Unix domain socket until killed
+// Each compilation is run by driver in a process forked from the server, with
+// the standard streams and the working directory of the client, so that the
+// initialized targets and the import cache of the server are shared
+[[nodiscard]] int runServer(const std::string&     socket_path,
+                            const std::string_view argv_front,
+                            const Driver           driver);
+
+// Forward the arguments to the server and return the exit status of the
+// compilation
+[[nodiscard]] int runClient(const std::string&       socket_path,
+                            const int                argc,
+                            const char* const* const argv);
+
+} // namespace twinkle
+
+#endif
@@ -0,0 +1,192 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#include "async.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Number of coroutines resumed between the polls of the waiting file
+// descriptors, while there are scheduled coroutines
+#define POLL_INTERVAL 64
+
+// The frame of a switched-resume coroutine of LLVM begins with its resume and
+// destroy functions, and the resume function is set to null when the
+// coroutine is suspended at its final suspend point
+typedef struct {
+  void (*resume)(void* frame);
+  void (*destroy)(void* frame);
+} CoroutineFrame;
+
+static void resume(void* const coroutine)
+{
+  ((CoroutineFrame*)coroutine)->resume(coroutine);
+}
+
+static bool isDone(void* const coroutine)
+{
+  return !((CoroutineFrame*)coroutine)->resume;
+}
+
+static void* reallocOrAbort(void* const p, const size_t size)
+{
+  void* const new_p = realloc(p, size);
+
+  if (!new_p)
+    abort();
+
+  return new_p;
+}
+
+//===----------------------------------------------------------------------===//
+// Scheduled coroutines
+//===----------------------------------------------------------------------===//
+
+// Ring buffer, whose capacity is a power of 2
+static _Thread_local void** ready          = NULL;
+static _Thread_local size_t ready_capacity = 0;
+static _Thread_local size_t ready_head     = 0;
+static _Thread_local size_t ready_count    = 0;
+
+static void pushReady(void* const coroutine)
+{
+  if (ready_count == ready_capacity) {
+    const size_t capacity = ready_capacity ? ready_capacity * 2 : 64;
+
+    ready = reallocOrAbort(ready, sizeof(void*) * capacity);
+
+    // The wrapped part moves to the new half
+    for (size_t i = 0; i < ready_head; ++i)
+      ready[ready_capacity + i] = ready[i];
+
+    ready_capacity = capacity;
+  }
+
+  ready[(ready_head + ready_count) & (ready_capacity - 1)] = coroutine;
+  ++ready_count;
+}
+
+static void* popReady(void)
+{
+  void* const coroutine = ready[ready_head];
+
+  ready_head = (ready_head + 1) & (ready_capacity - 1);
+  --ready_count;
+
+  return coroutine;
+}
+
+//===----------------------------------------------------------------------===//
+// Coroutines waiting for file descriptors
+//===----------------------------------------------------------------------===//
+
+static _Thread_local struct pollfd* waiting_fds        = NULL;
+static _Thread_local void**         waiting_coroutines = NULL;
+static _Thread_local size_t         waiting_capacity   = 0;
+static _Thread_local size_t         waiting_count      = 0;
+
+// Schedule the coroutines whose events occurred
+// With a timeout of -1, blocks until one of them occurs
+static void pollWaiting(const int timeout)
+{
+  if (poll(waiting_fds, waiting_count, timeout) < 0) {
+    if (errno == EINTR)
+      return;
+
+    perror("twinkle: poll");
+    abort();
+  }
+
+  for (size_t i = 0; i < waiting_count;) {
+    if (!waiting_fds[i].revents) {
+      ++i;
+      continue;
+    }
+
+    pushReady(waiting_coroutines[i]);
+
+    // The last one takes its place
+    --waiting_count;
+    waiting_fds[i]        = waiting_fds[waiting_count];
+    waiting_coroutines[i] = waiting_coroutines[waiting_count];
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Executor
+//===----------------------------------------------------------------------===//
+
+static _Thread_local unsigned int resumed_since_poll = 0;
+
+// Resume a scheduled coroutine, or wait for file descriptors if there is none
+// Returns false if no coroutine is scheduled or waiting
+static bool step(void)
+{
+  // Polled at intervals, so that the waiting coroutines are not starved by
+  // the ones that keep yielding
+  if (waiting_count
+      && (!ready_count || POLL_INTERVAL <= resumed_since_poll)) {
+    pollWaiting(ready_count ? 0 : -1);
+    resumed_since_poll = 0;
+  }
+
+  if (!ready_count)
+    return waiting_count != 0;
+
+  ++resumed_since_poll;
+  resume(popReady());
+
+  return true;
+}
+
+//===----------------------------------------------------------------------===//
+// Entry points
+//===----------------------------------------------------------------------===//
+
+void __twinkle_async_schedule(void* const coroutine)
+{
+  pushReady(coroutine);
+}
+
+void __twinkle_async_wait_fd(void* const   coroutine,
+                             const int32_t fd,
+                             const int16_t events)
+{
+  if (waiting_count == waiting_capacity) {
+    waiting_capacity = waiting_capacity ? waiting_capacity * 2 : 16;
+
+    waiting_fds = reallocOrAbort(waiting_fds,
+                                 sizeof(struct pollfd) * waiting_capacity);
+    waiting_coroutines
+      = reallocOrAbort(waiting_coroutines, sizeof(void*) * waiting_capacity);
+  }
+
+  waiting_fds[waiting_count]
+    = (struct pollfd){.fd = fd, .events = events, .revents = 0};
+  waiting_coroutines[waiting_count] = coroutine;
+  ++waiting_count;
+}
+
+void __twinkle_async_block_on(void* const coroutine)
+{
+  while (!isDone(coroutine)) {
+    if (!step()) {
+      fputs("twinkle: await never completes, since no async function is "
+            "scheduled or waiting\n",
+            stderr);
+      abort();
+    }
+  }
+}
+
+void __twinkle_async_run(void)
+{
+  while (step())
+    ;
+}
@@ -0,0 +1,50 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#ifndef _34b8bde2_1ab8_4ba1_8926_25ae70888cf3
+#define _34b8bde2_1ab8_4ba1_8926_25ae70888cf3
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Single-threaded executor of async functions
+// Coroutines are the handles of the switched-resume coroutines of LLVM, which
+// are suspended when they are passed, and each thread has its own executor
+
+// Resume the coroutine after the ones already scheduled
+void __twinkle_async_schedule(void* coroutine);
+
+// Resume the coroutine when one of the events of poll(2) occurs on the file
+// descriptor
+void __twinkle_async_wait_fd(void* coroutine, int32_t fd, int16_t events);
+
+// Run the executor until the coroutine is suspended at its final suspend
+// point
+// Aborts if nothing can resume the coroutine
+void __twinkle_async_block_on(void* coroutine);
+
+// Run the executor until no coroutine is scheduled or waiting
+void __twinkle_async_run(void);
+
+// Allocate and free the frames of coroutines that are not elided
+// The default ones in async_frame.c keep small frames for reuse, and a program
+// replaces both by defining them
+void* __twinkle_async_frame_alloc(int64_t size);
+void  __twinkle_async_frame_free(void* frame, int64_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,86 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+// Separate from the executor, so that the archive member is not linked when
+// a program defines its own allocator
+
+#include "async.h"
+#include <stdlib.h>
+
+// Frames up to this size are kept for reuse by the thread, in size classes of
+// FRAME_SIZE_CLASS bytes
+#define SMALL_FRAME_SIZE 1024
+#define FRAME_SIZE_CLASS 64
+
+// Upper limit of the number of frames kept for each size class
+#define MAX_FREE_FRAMES 256
+
+#define SIZE_CLASS_COUNT (SMALL_FRAME_SIZE / FRAME_SIZE_CLASS)
+
+typedef struct FreeFrame {
+  struct FreeFrame* next;
+} FreeFrame;
+
+static _Thread_local FreeFrame*   free_frames[SIZE_CLASS_COUNT];
+static _Thread_local unsigned int free_frame_counts[SIZE_CLASS_COUNT];
+
+static size_t getSizeClass(const int64_t size)
+{
+  return (size_t)(size - 1) / FRAME_SIZE_CLASS;
+}
+
+void* __twinkle_async_frame_alloc(const int64_t size)
+{
+  if (SMALL_FRAME_SIZE < size) {
+    void* const frame = malloc(size);
+
+    if (!frame)
+      abort();
+
+    return frame;
+  }
+
+  const size_t size_class = getSizeClass(size);
+
+  FreeFrame* const frame = free_frames[size_class];
+
+  if (frame) {
+    free_frames[size_class] = frame->next;
+    --free_frame_counts[size_class];
+
+    return frame;
+  }
+
+  // The whole size class, so that it can be reused for any size of the class
+  void* const new_frame = malloc((size_class + 1) * FRAME_SIZE_CLASS);
+
+  if (!new_frame)
+    abort();
+
+  return new_frame;
+}
+
+void __twinkle_async_frame_free(void* const frame, const int64_t size)
+{
+  if (SMALL_FRAME_SIZE < size) {
+    free(frame);
+    return;
+  }
+
+  const size_t size_class = getSizeClass(size);
+
+  if (free_frame_counts[size_class] == MAX_FREE_FRAMES) {
+    free(frame);
+    return;
+  }
+
+  FreeFrame* const free_frame = frame;
+
+  free_frame->next        = free_frames[size_class];
+  free_frames[size_class] = free_frame;
+  ++free_frame_counts[size_class];
+}
@@ -0,0 +1,240 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#include "parallel.h"
+#include "task.h"
+#include "threads.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Number of chunks per thread when the runtime chooses the chunk size
+#define CHUNKS_PER_THREAD 8
+
+//===----------------------------------------------------------------------===//
+// Chunk ranges
+//===----------------------------------------------------------------------===//
+
+// Chunks from begin to end packed into one word, so that the owner and the
+// thieves can update them with a compare exchange
+typedef uint64_t Range;
+
+static Range packRange(const uint32_t begin, const uint32_t end)
+{
+  return ((uint64_t)end << 32) | begin;
+}
+
+static uint32_t rangeBegin(const Range range)
+{
+  return (uint32_t)range;
+}
+
+static uint32_t rangeEnd(const Range range)
+{
+  return (uint32_t)(range >> 32);
+}
+
+// Aligned to a cache line, since it is written by each thread
+typedef struct {
+  _Alignas(64) _Atomic Range range;
+} Worker;
+
+//===----------------------------------------------------------------------===//
+// Loop
+//===----------------------------------------------------------------------===//
+
+typedef struct {
+  twinkle_loop_body body;
+  void*             context;
+  int64_t           begin;
+  int64_t           end;
+  int64_t           chunk;
+} Loop;
+
+static Worker workers[TWINKLE_MAX_THREADS];
+
+static void runChunk(const Loop* const loop, const uint32_t idx)
+{
+  const int64_t begin = loop->begin + (int64_t)idx * loop->chunk;
+  const int64_t end = (uint64_t)loop->end - (uint64_t)begin
+                          < (uint64_t)loop->chunk
+                        ? loop->end
+                        : begin + loop->chunk;
+
+  loop->body(loop->context, begin, end);
+}
+
+// Take the first chunk of the range of the thread
+static bool takeChunk(Worker* const worker, uint32_t* const idx)
+{
+  Range range = atomic_load_explicit(&worker->range, memory_order_relaxed);
+
+  while (rangeBegin(range) < rangeEnd(range)) {
+    if (atomic_compare_exchange_weak_explicit(
+          &worker->range,
+          &range,
+          packRange(rangeBegin(range) + 1, rangeEnd(range)),
+          memory_order_relaxed,
+          memory_order_relaxed)) {
+      *idx = rangeBegin(range);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Steal the latter half of the chunks of another thread
+// Returns false if no thread has chunks left
+static bool stealChunks(const unsigned int thread_count, const unsigned int id)
+{
+  for (unsigned int i = 1; i < thread_count; ++i) {
+    Worker* const victim = &workers[(id + i) % thread_count];
+
+    Range range = atomic_load_explicit(&victim->range, memory_order_relaxed);
+
+    while (rangeBegin(range) < rangeEnd(range)) {
+      const uint32_t middle
+        = rangeBegin(range) + (rangeEnd(range) - rangeBegin(range)) / 2;
+
+      if (atomic_compare_exchange_weak_explicit(
+            &victim->range,
+            &range,
+            packRange(rangeBegin(range), middle),
+            memory_order_relaxed,
+            memory_order_relaxed)) {
+        // The range of this thread is empty, so no one else changes it
+        atomic_store_explicit(&workers[id].range,
+                              packRange(middle, rangeEnd(range)),
+                              memory_order_relaxed);
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+// A thread may return while another thread is moving stolen chunks, but the
+// other thread runs them
+static void runWorker(const Loop* const  loop,
+                      const unsigned int thread_count,
+                      const unsigned int id)
+{
+  do {
+    uint32_t idx;
+
+    while (takeChunk(&workers[id], &idx))
+      runChunk(loop, idx);
+  } while (stealChunks(thread_count, id));
+}
+
+//===----------------------------------------------------------------------===//
+// Workers
+//===----------------------------------------------------------------------===//
+
+// Parallel loops of different threads run one at a time
+static pthread_mutex_t loop_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static _Thread_local bool in_parallel_loop = false;
+
+// Data of the task running a worker
+typedef struct {
+  const Loop*  loop;
+  unsigned int thread_count;
+  unsigned int id;
+} WorkerTask;
+
+static void runWorkerTask(void* const data)
+{
+  const WorkerTask* const task = data;
+
+  // The thread may be in a loop already, if it runs this task while waiting
+  // for another one
+  const bool outer_in_parallel_loop = in_parallel_loop;
+
+  in_parallel_loop = true;
+  runWorker(task->loop, task->thread_count, task->id);
+  in_parallel_loop = outer_in_parallel_loop;
+}
+
+//===----------------------------------------------------------------------===//
+// Entry point
+//===----------------------------------------------------------------------===//
+
+void __twinkle_parallel_for(const int64_t           begin,
+                            const int64_t           end,
+                            int64_t                 chunk,
+                            const twinkle_loop_body body,
+                            void* const             context)
+{
+  if (end <= begin)
+    return;
+
+  if (in_parallel_loop) {
+    body(context, begin, end);
+    return;
+  }
+
+  const unsigned int thread_count = __twinkle_thread_count();
+
+  const uint64_t iterations = (uint64_t)end - (uint64_t)begin;
+
+  if (chunk <= 0) {
+    chunk = (int64_t)(iterations / (thread_count * CHUNKS_PER_THREAD));
+
+    if (chunk == 0)
+      chunk = 1;
+  }
+
+  // The chunk indices must fit in 32 bits
+  if ((uint64_t)chunk < iterations / UINT32_MAX + 1)
+    chunk = (int64_t)(iterations / UINT32_MAX + 1);
+
+  const uint64_t chunks = (iterations + (uint64_t)chunk - 1) / (uint64_t)chunk;
+
+  if (thread_count == 1 || chunks == 1) {
+    body(context, begin, end);
+    return;
+  }
+
+  const Loop loop = {body, context, begin, end, chunk};
+
+  pthread_mutex_lock(&loop_mutex);
+
+  for (unsigned int id = 0; id < thread_count; ++id) {
+    atomic_store_explicit(
+      &workers[id].range,
+      packRange((uint32_t)(chunks * id / thread_count),
+                (uint32_t)(chunks * (id + 1) / thread_count)),
+      memory_order_relaxed);
+  }
+
+  // The workers run as tasks, so that parallel loops and tasks share the
+  // threads of the task runtime
+  // Spawning orders the ranges and the loop before the tasks run
+  in_parallel_loop = true;
+
+  twinkle_task_group group = {NULL};
+
+  for (unsigned int id = 1; id < thread_count; ++id) {
+    const WorkerTask task = {&loop, thread_count, id};
+    __twinkle_spawn(&group, runWorkerTask, &task, sizeof(task));
+  }
+
+  runWorker(&loop, thread_count, 0);
+
+  // Waiting for the tasks orders the writes of the iterations before the
+  // return
+  // The thread runs other tasks while waiting, and the loops in them run
+  // serially, since this thread holds the mutex
+  __twinkle_task_group_exit(&group);
+
+  in_parallel_loop = false;
+
+  pthread_mutex_unlock(&loop_mutex);
+}
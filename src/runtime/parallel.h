@@ -0,0 +1,44 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#ifndef _3c1f6a2e_5b7d_4e0a_9f43_8d2b6c7e1a05
+#define _3c1f6a2e_5b7d_4e0a_9f43_8d2b6c7e1a05
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Body of a parallel loop, which runs the iterations from begin to end
+typedef void (*twinkle_loop_body)(void* context, int64_t begin, int64_t end);
+
+// Run the iterations from begin to end of a parallel loop on the threads of the
+// runtime, and return when all of them are done
+// The iterations are divided into chunks of the size, or of a size chosen by
+// the runtime if it is 0. The chunks are distributed evenly to the threads,
+// and idle threads steal half of the remaining chunks of another thread
+// The number of threads is TWINKLE_NUM_THREADS if it is set, otherwise the
+// number of online processors
+// The threads run as tasks (see task.h), so parallel loops and tasks share
+// one pool of threads
+// Parallel loops in a parallel loop run serially on the thread
+void __twinkle_parallel_for(int64_t           begin,
+                            int64_t           end,
+                            int64_t           chunk,
+                            twinkle_loop_body body,
+                            void*             context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,429 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#include "task.h"
+#include "threads.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Capacity of the deque of a thread
+#define DEQUE_SIZE 4096
+
+// Tasks whose data is at most this size are reused by the thread
+#define SMALL_TASK_SIZE 64
+
+// Upper limit of the number of tasks kept for reuse by a thread
+#define MAX_FREE_TASKS 1024
+
+// Number of times an idle thread looks for tasks before it sleeps
+#define SPIN_COUNT 256
+
+struct twinkle_task {
+  twinkle_task_body body;
+
+  // Only used by the thread that spawned the task
+  twinkle_task_group* group;
+  twinkle_task*       prev;
+  twinkle_task*       next;
+  int64_t             capacity;
+
+  _Atomic bool done;
+
+  _Alignas(16) unsigned char data[];
+};
+
+//===----------------------------------------------------------------------===//
+// Deque
+//===----------------------------------------------------------------------===//
+
+// Work-stealing deque of Chase and Lev, with the memory orders of
+// "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al.)
+// The owner pushes and pops at the bottom, and thieves steal at the top
+typedef struct {
+  _Alignas(64) _Atomic int64_t top;
+  _Alignas(64) _Atomic int64_t bottom;
+  _Atomic(twinkle_task*) tasks[DEQUE_SIZE];
+} Deque;
+
+static bool pushTask(Deque* const deque, twinkle_task* const task)
+{
+  const int64_t bottom
+    = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  const int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+
+  if (bottom - top >= DEQUE_SIZE)
+    return false;
+
+  atomic_store_explicit(&deque->tasks[bottom % DEQUE_SIZE],
+                        task,
+                        memory_order_relaxed);
+  atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+
+  return true;
+}
+
+static twinkle_task* popTask(Deque* const deque)
+{
+  const int64_t bottom
+    = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+
+  atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+
+  int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+  if (bottom < top) {
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return NULL;
+  }
+
+  twinkle_task* task = atomic_load_explicit(&deque->tasks[bottom % DEQUE_SIZE],
+                                            memory_order_relaxed);
+
+  if (top == bottom) {
+    // The last task, which a thief may be stealing
+    if (!atomic_compare_exchange_strong_explicit(&deque->top,
+                                                 &top,
+                                                 top + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed))
+      task = NULL;
+
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+  }
+
+  return task;
+}
+
+// Returns NULL if the deque is empty or another thread took the task
+static twinkle_task* stealTask(Deque* const deque)
+{
+  int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  const int64_t bottom
+    = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+  if (bottom <= top)
+    return NULL;
+
+  twinkle_task* const task = atomic_load_explicit(
+    &deque->tasks[top % DEQUE_SIZE],
+    memory_order_relaxed);
+
+  if (!atomic_compare_exchange_strong_explicit(&deque->top,
+                                               &top,
+                                               top + 1,
+                                               memory_order_seq_cst,
+                                               memory_order_relaxed))
+    return NULL;
+
+  return task;
+}
+
+static bool isEmpty(Deque* const deque)
+{
+  return atomic_load(&deque->bottom) <= atomic_load(&deque->top);
+}
+
+//===----------------------------------------------------------------------===//
+// Threads
+//===----------------------------------------------------------------------===//
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+// Including the thread that spawned the first task
+static unsigned int thread_count = 1;
+
+static Deque* deques = NULL;
+
+// Idle threads sleep until a task is pushed
+static pthread_mutex_t sleep_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  sleep_cond  = PTHREAD_COND_INITIALIZER;
+static _Atomic unsigned int sleeping_threads = 0;
+
+// NULL on the threads other than the first one to spawn and those of the pool
+static _Thread_local Deque* own_deque = NULL;
+
+static _Thread_local uint32_t random_state = 0;
+
+// xorshift, to choose a thread to steal from
+static uint32_t nextRandom(void)
+{
+  uint32_t x = random_state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+
+  return random_state = x;
+}
+
+static void runTask(twinkle_task* const task)
+{
+  task->body(task->data);
+
+  atomic_store_explicit(&task->done, true, memory_order_release);
+}
+
+static twinkle_task* findTask(void)
+{
+  twinkle_task* task = own_deque ? popTask(own_deque) : NULL;
+
+  if (task)
+    return task;
+
+  const unsigned int start = nextRandom() % thread_count;
+
+  for (unsigned int i = 0; i < thread_count; ++i) {
+    Deque* const victim = &deques[(start + i) % thread_count];
+
+    if (victim == own_deque)
+      continue;
+
+    task = stealTask(victim);
+
+    if (task)
+      return task;
+  }
+
+  return NULL;
+}
+
+static bool hasTasks(void)
+{
+  for (unsigned int id = 0; id < thread_count; ++id) {
+    if (!isEmpty(&deques[id]))
+      return true;
+  }
+
+  return false;
+}
+
+// The increment of the sleeping threads is ordered before looking at the
+// deques, and pushing a task is ordered before looking at the sleeping threads
+// in wakeThread, so a task is not left while all threads sleep
+static void sleepUntilTasks(void)
+{
+  pthread_mutex_lock(&sleep_mutex);
+
+  atomic_fetch_add(&sleeping_threads, 1);
+
+  if (!hasTasks())
+    pthread_cond_wait(&sleep_cond, &sleep_mutex);
+
+  atomic_fetch_sub(&sleeping_threads, 1);
+
+  pthread_mutex_unlock(&sleep_mutex);
+}
+
+static void wakeThread(void)
+{
+  atomic_thread_fence(memory_order_seq_cst);
+
+  if (atomic_load_explicit(&sleeping_threads, memory_order_relaxed) == 0)
+    return;
+
+  pthread_mutex_lock(&sleep_mutex);
+  pthread_cond_signal(&sleep_cond);
+  pthread_mutex_unlock(&sleep_mutex);
+}
+
+static void* threadMain(void* const arg)
+{
+  const unsigned int id = (unsigned int)(uintptr_t)arg;
+
+  own_deque    = &deques[id];
+  random_state = id + 1;
+
+  for (unsigned int idle = 0;;) {
+    twinkle_task* const task = findTask();
+
+    if (task) {
+      runTask(task);
+      idle = 0;
+    }
+    else if (++idle < SPIN_COUNT)
+      sched_yield();
+    else {
+      sleepUntilTasks();
+      idle = 0;
+    }
+  }
+
+  return NULL;
+}
+
+// The calling thread becomes the first thread of the pool
+static void createThreads(void)
+{
+  const unsigned int count = __twinkle_thread_count();
+
+  deques = aligned_alloc(_Alignof(Deque), sizeof(Deque) * count);
+
+  if (!deques)
+    return;
+
+  memset(deques, 0, sizeof(Deque) * count);
+
+  // The deques of the threads that fail to start are just empty
+  thread_count = count;
+
+  own_deque    = &deques[0];
+  random_state = 1;
+
+  // The threads wait for tasks until the process exits
+  for (unsigned int id = 1; id < count; ++id) {
+    pthread_t      thread;
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    pthread_create(&thread, &attr, threadMain, (void*)(uintptr_t)id);
+
+    pthread_attr_destroy(&attr);
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Tasks
+//===----------------------------------------------------------------------===//
+
+// Tasks are freed by the thread that spawned them, so small ones are kept
+// for the next spawns of the thread
+static _Thread_local twinkle_task* free_tasks      = NULL;
+static _Thread_local unsigned int  free_task_count = 0;
+
+static twinkle_task* allocateTask(const int64_t size)
+{
+  if (size <= SMALL_TASK_SIZE && free_tasks) {
+    twinkle_task* const task = free_tasks;
+
+    free_tasks = task->next;
+    --free_task_count;
+
+    return task;
+  }
+
+  const int64_t capacity = size <= SMALL_TASK_SIZE ? SMALL_TASK_SIZE : size;
+
+  twinkle_task* const task = malloc(sizeof(twinkle_task) + capacity);
+
+  if (!task)
+    abort();
+
+  task->capacity = capacity;
+
+  return task;
+}
+
+static void freeTask(twinkle_task* const task)
+{
+  if (task->capacity != SMALL_TASK_SIZE || free_task_count == MAX_FREE_TASKS) {
+    free(task);
+    return;
+  }
+
+  task->next = free_tasks;
+  free_tasks = task;
+  ++free_task_count;
+}
+
+static void unlinkTask(twinkle_task* const task)
+{
+  if (task->prev)
+    task->prev->next = task->next;
+  else
+    task->group->head = task->next;
+
+  if (task->next)
+    task->next->prev = task->prev;
+}
+
+// Run other tasks until the task is done
+static void waitTask(twinkle_task* const task)
+{
+  while (!atomic_load_explicit(&task->done, memory_order_acquire)) {
+    twinkle_task* const other = findTask();
+
+    if (other)
+      runTask(other);
+    else
+      sched_yield();
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Entry points
+//===----------------------------------------------------------------------===//
+
+twinkle_task* __twinkle_spawn(twinkle_task_group* const group,
+                              const twinkle_task_body   body,
+                              const void* const         data,
+                              const int64_t             size)
+{
+  if (!own_deque)
+    pthread_once(&pool_once, createThreads);
+
+  twinkle_task* const task = allocateTask(size);
+
+  task->body  = body;
+  task->group = group;
+  task->prev  = NULL;
+  task->next  = group->head;
+
+  atomic_init(&task->done, false);
+
+  memcpy(task->data, data, size);
+
+  if (group->head)
+    group->head->prev = task;
+
+  group->head = task;
+
+  if (own_deque && thread_count != 1 && pushTask(own_deque, task))
+    wakeThread();
+  else
+    runTask(task);
+
+  return task;
+}
+
+void __twinkle_join(twinkle_task* const task,
+                    void* const         result,
+                    const int64_t       size)
+{
+  waitTask(task);
+
+  if (result)
+    memcpy(result, task->data, size);
+
+  unlinkTask(task);
+  freeTask(task);
+}
+
+void __twinkle_sync(twinkle_task_group* const group)
+{
+  for (twinkle_task* task = group->head; task; task = task->next)
+    waitTask(task);
+}
+
+void __twinkle_task_group_exit(twinkle_task_group* const group)
+{
+  while (group->head) {
+    twinkle_task* const task = group->head;
+
+    waitTask(task);
+
+    group->head = task->next;
+    freeTask(task);
+  }
+}
@@ -0,0 +1,59 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#ifndef _d5a07c3e_91b4_4c28_a6f0_3e8b52d9c7a4
+#define _d5a07c3e_91b4_4c28_a6f0_3e8b52d9c7a4
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Function that runs a task on its data
+typedef void (*twinkle_task_body)(void* data);
+
+typedef struct twinkle_task twinkle_task;
+
+// Tasks spawned by a call of a function, which must be zero initialized
+// Only the thread running the function uses it, since the call does not move
+// to another thread
+typedef struct {
+  twinkle_task* head;
+} twinkle_task_group;
+
+// Copy the data to a new task of the group, and push it to the deque of the
+// thread, from which idle threads steal
+// The task runs on the thread at once if the thread has no deque or the deque
+// is full
+// The copy of the data is aligned to 16 bytes
+twinkle_task* __twinkle_spawn(twinkle_task_group* group,
+                              twinkle_task_body   body,
+                              const void*         data,
+                              int64_t             size);
+
+// Wait for the task, copy the first bytes of its data to the result, and free
+// it
+// While waiting, the thread runs the tasks of its deque and steals the tasks
+// of others
+void __twinkle_join(twinkle_task* task, void* result, int64_t size);
+
+// Wait for all tasks of the group, which can be joined later
+void __twinkle_sync(twinkle_task_group* group);
+
+// Wait for and free the tasks of the group that have not been joined
+void __twinkle_task_group_exit(twinkle_task_group* group);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
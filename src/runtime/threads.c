@@ -0,0 +1,23 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#include "threads.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+unsigned int __twinkle_thread_count(void)
+{
+  const char* const env = getenv("TWINKLE_NUM_THREADS");
+
+  long count = env ? strtol(env, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (count < 1)
+    count = 1;
+
+  return count < TWINKLE_MAX_THREADS ? (unsigned int)count
+                                     : TWINKLE_MAX_THREADS;
+}
@@ -0,0 +1,22 @@
+/**
+ * These codes are licensed under MIT License
+ * See the LICENSE for details
+ *
+ * Copyright (c) 2022 Hiramoto Ittou
+ */
+
+#ifndef _8e4b2d71_0c9a_4f6e_b35d_72a1e9c04f18
+#define _8e4b2d71_0c9a_4f6e_b35d_72a1e9c04f18
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+// Upper limit of the number of threads
+#define TWINKLE_MAX_THREADS 256
+
+// Number of threads the runtime runs, including the calling thread
+// TWINKLE_NUM_THREADS if it is set, otherwise the number of online processors
+unsigned int __twinkle_thread_count(void);
+
+#endif
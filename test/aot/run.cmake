@@ -0,0 +1,113 @@
+# Compile a test case by the driver in WORK_DIR, and check the results
+#
+# The case has these lines (semicolons and unbalanced square brackets cannot be
+# used):
+#   // ARGS: <arguments of the driver, where %S is the directory of the case>
+#   // EXIT: <exit status of a.out, which is run only if this is given>
+#   // CHECK: <regular expression that the emitted LLVM IR must match>
+#   // FILE: <file written to WORK_DIR> <regular expression that it must match>
+#   // ERROR: <regular expression that the diagnostics must match, when the
+#   //         compilation must fail>
+#
+# The temporary files of the driver must be removed by the time it exits
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR}/tmp)
+
+get_filename_component(CASE_DIR ${CASE} DIRECTORY)
+get_filename_component(CASE_NAME ${CASE} NAME_WE)
+
+file(STRINGS ${CASE} DIRECTIVES REGEX "^// (ARGS|EXIT|CHECK|FILE|ERROR): ")
+
+set(ARGS "")
+set(CHECKS "")
+set(CHECKED_FILES "")
+set(FILE_CHECKS "")
+
+foreach(DIRECTIVE ${DIRECTIVES})
+  if(DIRECTIVE MATCHES "^// ARGS: (.*)$")
+    string(REPLACE "%S" ${CASE_DIR} ARGS_LINE ${CMAKE_MATCH_1})
+    separate_arguments(ARGS_LINE UNIX_COMMAND ${ARGS_LINE})
+    list(APPEND ARGS ${ARGS_LINE})
+  elseif(DIRECTIVE MATCHES "^// EXIT: (.*)$")
+    set(EXIT ${CMAKE_MATCH_1})
+  elseif(DIRECTIVE MATCHES "^// CHECK: (.*)$")
+    list(APPEND CHECKS ${CMAKE_MATCH_1})
+  elseif(DIRECTIVE MATCHES "^// FILE: ([^ ]+) (.*)$")
+    list(APPEND CHECKED_FILES ${CMAKE_MATCH_1})
+    list(APPEND FILE_CHECKS ${CMAKE_MATCH_2})
+  elseif(DIRECTIVE MATCHES "^// ERROR: (.*)$")
+    set(ERROR ${CMAKE_MATCH_1})
+  endif()
+endforeach()
+
+execute_process(
+  COMMAND ${CMAKE_COMMAND} -E env TMPDIR=${WORK_DIR}/tmp
+          ${TWINKLE} ${ARGS} ${CASE}
+  WORKING_DIRECTORY ${WORK_DIR}
+  RESULT_VARIABLE STATUS
+  OUTPUT_VARIABLE OUTPUT
+  ERROR_VARIABLE OUTPUT
+)
+
+file(GLOB TEMPORARY_FILES ${WORK_DIR}/tmp/*)
+
+if(TEMPORARY_FILES)
+  message(FATAL_ERROR "${CASE_NAME}: temporary files left: ${TEMPORARY_FILES}")
+endif()
+
+if(DEFINED ERROR)
+  if(STATUS EQUAL 0)
+    message(FATAL_ERROR "${CASE_NAME}: compilation succeeded unexpectedly")
+  endif()
+
+  if(NOT OUTPUT MATCHES "${ERROR}")
+    message(FATAL_ERROR "${CASE_NAME}: '${ERROR}' not found in\n${OUTPUT}")
+  endif()
+
+  return()
+endif()
+
+if(NOT STATUS EQUAL 0)
+  message(FATAL_ERROR "${CASE_NAME}: compilation failed (${STATUS})\n${OUTPUT}")
+endif()
+
+if(DEFINED EXIT)
+  execute_process(
+    COMMAND ${WORK_DIR}/a.out
+    WORKING_DIRECTORY ${WORK_DIR}
+    RESULT_VARIABLE STATUS
+  )
+
+  if(NOT STATUS EQUAL EXIT)
+    message(FATAL_ERROR "${CASE_NAME}: exited with ${STATUS}, ${EXIT} expected")
+  endif()
+endif()
+
+if(CHECKS)
+  file(READ ${WORK_DIR}/${CASE_NAME}.ll IR)
+
+  foreach(CHECK ${CHECKS})
+    if(NOT IR MATCHES "${CHECK}")
+      message(FATAL_ERROR "${CASE_NAME}: '${CHECK}' not found in the IR")
+    endif()
+  endforeach()
+endif()
+
+set(FILE_IDX 0)
+
+foreach(CHECKED_FILE ${CHECKED_FILES})
+  list(GET FILE_CHECKS ${FILE_IDX} FILE_CHECK)
+  math(EXPR FILE_IDX "${FILE_IDX} + 1")
+
+  if(NOT EXISTS ${WORK_DIR}/${CHECKED_FILE})
+    message(FATAL_ERROR "${CASE_NAME}: ${CHECKED_FILE} was not written")
+  endif()
+
+  file(READ ${WORK_DIR}/${CHECKED_FILE} CONTENT)
+
+  if(NOT CONTENT MATCHES "${FILE_CHECK}")
+    message(FATAL_ERROR
+            "${CASE_NAME}: '${FILE_CHECK}' not found in ${CHECKED_FILE}")
+  endif()
+endforeach()
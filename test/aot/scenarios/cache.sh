@@ -0,0 +1,79 @@
+#!/usr/bin/env bash
+#
+# These codes are licensed under MIT License
+# See the LICENSE for details
+#
+# Copyright (c) 2022 Hiramoto Ittou
+#
+# Check that objects are reused from --cache-dir, and compiled again when a
+# file imported by the input file changes.
+#
+# Usage: cache.sh path/to/twinkle work_dir
+
+set -eu
+
+readonly twinkle=$1
+readonly workdir=$2
+
+rm -rf "$workdir"
+mkdir -p "$workdir"
+cd "$workdir"
+
+# The template is instantiated in main.o, so main.o depends on box.twk
+cat > box.twk <<'TWK'
+pub class Box<T> {
+  func get() -> T
+  {
+    return 58;
+  }
+}
+TWK
+
+cat > main.twk <<'TWK'
+import "./box.twk";
+
+func main() -> i32
+{
+  let b: Box<i32>;
+  return b.get();
+}
+TWK
+
+# Compiles and runs the program, and checks its exit status
+# The parsed files are recorded in stats.json, which lists none if all objects
+# are reused
+build() {
+  local expect=$1
+  local status=0
+
+  "$twinkle" --cache-dir cache --stats-file stats.json main.twk box.twk
+  ./a.out || status=$?
+
+  if [ "$status" != "$expect" ]; then
+    echo "exited with $status, $expect expected" >&2
+    exit 1
+  fi
+}
+
+build 58
+
+if ! grep -q '"file": ".*main.twk"' stats.json; then
+  echo "main.twk was not compiled on the first build" >&2
+  exit 1
+fi
+
+build 58
+
+if grep -q '"file":' stats.json; then
+  echo "objects were not reused from the cache" >&2
+  exit 1
+fi
+
+sed -i 's/return 58/return 59/' box.twk
+
+build 59
+
+if ! grep -q '"file": ".*main.twk"' stats.json; then
+  echo "main.twk was not compiled again after box.twk changed" >&2
+  exit 1
+fi
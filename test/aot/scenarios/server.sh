@@ -0,0 +1,97 @@
+#!/usr/bin/env bash
+#
+# These codes are licensed under MIT License
+# See the LICENSE for details
+#
+# Copyright (c) 2022 Hiramoto Ittou
+#
+# Check that compilations through the compile server (--server, --connect)
+# produce working programs, see changes of imported files, and forward
+# diagnostics and exit statuses to the client.
+#
+# Usage: server.sh path/to/twinkle work_dir
+
+set -eu
+
+readonly twinkle=$1
+readonly workdir=$2
+
+rm -rf "$workdir"
+mkdir -p "$workdir"
+cd "$workdir"
+
+readonly socket=$workdir/twinkle.sock
+
+"$twinkle" --server "$socket" &
+readonly server=$!
+trap 'kill "$server"' EXIT
+
+for _ in $(seq 100); do
+  [ -S "$socket" ] && break
+  sleep 0.1
+done
+
+cat > value.twk <<'TWK'
+pub class Value<T> {
+  func get() -> T
+  {
+    return 58;
+  }
+}
+TWK
+
+cat > main.twk <<'TWK'
+import "./value.twk";
+
+func main() -> i32
+{
+  let v: Value<i32>;
+  return v.get();
+}
+TWK
+
+# Compiles by the server and runs the program, and checks its exit status
+build() {
+  local expect=$1
+  local status=0
+
+  "$twinkle" --connect "$socket" main.twk value.twk
+  ./a.out || status=$?
+
+  if [ "$status" != "$expect" ]; then
+    echo "exited with $status, $expect expected" >&2
+    exit 1
+  fi
+}
+
+build 58
+
+# value.twk is cached by the server after the first compilation
+build 58
+
+# The server tells changed files by their modification times and sizes, and
+# the size is kept
+sleep 1
+sed -i 's/return 58/return 59/' value.twk
+
+build 59
+
+cat > error.twk <<'TWK'
+func main() -> i32
+{
+  return undefined;
+}
+TWK
+
+status=0
+"$twinkle" --connect "$socket" error.twk 2> diagnostics || status=$?
+
+if [ "$status" = 0 ]; then
+  echo "the erroneous compilation succeeded" >&2
+  exit 1
+fi
+
+if ! grep -q "undefined" diagnostics; then
+  echo "diagnostics were not forwarded to the client" >&2
+  exit 1
+fi
@@ -208,6 +208,16 @@ namespace test
     {     "union_generics_single_instantiation",  58},
     {                            "size_of_type",  58},
     {                "call_namespaced_function", 116},
+    {                           "target_clones",  58},
+    {                         "loop_attributes",  58},
+    {                     "function_attributes",  58},
+    {                            "vector_types",  58},
+    {                       "builtin_functions",  58},
+    {                       "atomic_operations",  58},
+    {                            "parallel_for",  58},
+    {                             "spawn_tasks",  58},
+    {                         "async_functions",  58},
+    {                                "async_io",  58},
   };
 
   const auto it = expects.find(test_name);
@@ -9,6 +9,7 @@
 #include <twinkle/compile/compile.hpp>
 #include <context.hpp>
 #include <filesystem>
+#include <cstdlib>
 #include <sstream>
 #include <iostream>
 #include <unordered_map>
@@ -22,58 +23,56 @@ namespace fs = std::filesystem;
 namespace test
 {
 
-[[nodiscard]] std::optional<int> runTest(const fs::directory_entry& test_path)
+// Test cases in a directory are linked and executed as one program
+// If emit_target is set, it is compiled ahead of time to output_dir instead
+[[nodiscard]] twinkle::Context
+createContext(const fs::directory_entry& test_path,
+              std::string&&              emit_target = "",
+              std::string&&              output_dir  = "")
 {
-#if SUPPRESS_COMPILE_ERROR_OUTPUT
-  // Suppresses compile error output
-  std::cerr.setstate(std::ios::failbit);
-#endif
+  std::vector<std::string> paths;
 
   if (test_path.is_directory()) {
-    std::vector<std::string> paths;
-
     for (const auto& path : fs::recursive_directory_iterator(test_path))
       paths.push_back(path.path().string());
+  }
+  else
+    paths.push_back(test_path.path().string());
 
-    const auto result
-      = twinkle::compile(twinkle::Context{std::move(paths),
-                                          true,
-                                          "", // JIT compile, so it's empty
-                                          twinkle::DEFAULT_OPT_LEVEL,
-                                          "pic",
-                                          {},
-                                          std::nullopt},
-                         "test");
-
-#if SUPPRESS_COMPILE_ERROR_OUTPUT
-    std::cerr.clear();
-#endif
+  const auto jit = emit_target.empty();
+
+  // The other options are the defaults of the command line
+  return {.input_files = std::move(paths),
+          .jit         = jit,
+          .emit_target = std::move(emit_target), // Empty for JIT compile
+          .output_dir  = std::move(output_dir)};
+}
+
+// Creates a new directory in the temporary directory
+[[nodiscard]] fs::path createUniqueDirectory()
+{
+  auto path
+    = (fs::temp_directory_path() / "twinkle_batch_test.XXXXXX").string();
 
-    if (result)
-      return std::get<twinkle::JITResult>(*result).exit_status;
-    else
-      return std::nullopt;
+  if (!mkdtemp(path.data())) {
+    fmt::print(stderr, "could not create a directory: {}\n", path);
+    std::exit(EXIT_FAILURE);
   }
-  else {
-    const auto result = twinkle::compile(
-      twinkle::Context{std::vector<std::string>{test_path.path()},
-                       true,
-                       "", // JIT compile, so it's empty
-                       twinkle::DEFAULT_OPT_LEVEL,
-                       "pic",
-                       {},
-                       std::nullopt},
-      "test");
-
-#if SUPPRESS_COMPILE_ERROR_OUTPUT
-    std::cerr.clear();
+
+  return path;
+}
+
+[[nodiscard]] std::optional<int>
+getExitStatus(const twinkle::BatchResult& batch_result)
+{
+#if !SUPPRESS_COMPILE_ERROR_OUTPUT
+  std::cerr << batch_result.diagnostics;
 #endif
 
-    if (result)
-      return std::get<twinkle::JITResult>(*result).exit_status;
-    else
-      return std::nullopt;
-  }
+  if (batch_result.result)
+    return std::get<twinkle::JITResult>(*batch_result.result).exit_status;
+  else
+    return std::nullopt;
 }
 
 } // namespace test
@@ -92,10 +91,24 @@ int main(const int argc, const char* const* const argv)
   std::size_t pass_c{};
   std::size_t fail_c{};
 
+  std::vector<fs::directory_entry> paths;
+  std::vector<twinkle::Context>    contexts;
+
   for (const auto& path : fs::directory_iterator(argv[1])) {
+    paths.push_back(path);
+    contexts.push_back(test::createContext(path));
+  }
+
+  // Test programs are executed in this process by JIT, so they are run one at
+  // a time
+  const auto batch_results = twinkle::compileBatch(contexts, "test", 1);
+
+  for (std::size_t idx = 0; idx < paths.size(); ++idx) {
+    const auto& path = paths[idx];
+
     std::cerr << path.path().stem().string();
 
-    const auto result = test::runTest(path);
+    const auto result = test::getExitStatus(batch_results[idx]);
     const auto expect = test::getExpect(path.path().stem().string());
 
     if (!expect) {
@@ -126,6 +139,39 @@ int main(const int argc, const char* const* const argv)
     ++fail_c;
   }
 
+  // Test cases are compiled again to object files concurrently, to check that
+  // the jobs of a batch do not interfere with each other
+  // Each job writes its objects to a directory of its own, since test cases
+  // in different directories may have the same file names
+  std::vector<twinkle::Context> object_contexts;
+  std::vector<fs::path>         output_dirs;
+
+  for (const auto& path : paths) {
+    output_dirs.push_back(test::createUniqueDirectory());
+
+    object_contexts.push_back(
+      test::createContext(path, EMIT_OBJ_ARG, output_dirs.back().string()));
+  }
+
+  // All hardware threads
+  const auto object_results
+    = twinkle::compileBatch(object_contexts, "test", 0);
+
+  for (const auto& output_dir : output_dirs)
+    fs::remove_all(output_dir);
+
+  for (std::size_t idx = 0; idx < paths.size(); ++idx) {
+    if (object_results[idx].result)
+      continue;
+
+    std::cerr << object_results[idx].diagnostics;
+    fmt::print(stderr,
+               fg(fmt::terminal_color::bright_red),
+               "{} Failed in parallel batch compilation!\n",
+               paths[idx].path().stem().string());
+    ++fail_c;
+  }
+
   std::cerr << "--------------------\n";
   std::cerr << "| " + fmt::format(fg(fmt::terminal_color::bright_red), "Failed")
                  + ": "